@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ *
+ * SPI Transfer Latency Benchmark C++ Example
+ *
+ * This example code is in the Public Domain (or CC0 licensed, at your option.)
+ *
+ * Unless required by applicable law or agreed to in writing, this
+ * software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include "sdkconfig.h"
+#include <cstdio>
+#include <functional>
+#include "esp_timer.h"
+#include "spi_host_cxx.hpp"
+
+using namespace std;
+using namespace idf;
+
+static const size_t ITERATIONS = 1000;
+
+namespace {
+static const MOSI MOSI_PIN(CONFIG_SPI_MOSI);
+static const MISO MISO_PIN(CONFIG_SPI_MISO);
+static const SCLK SCLK_PIN(CONFIG_SPI_SCLK);
+static const CS     CS_PIN(CONFIG_SPI_CS);
+}
+
+/**
+ * Run \c transfer ITERATIONS times and print the average duration of a single transfer.
+ */
+static void measure(const char *name, function<void()> transfer)
+{
+    // warm up caches and let the driver allocate its resources
+    transfer();
+
+    int64_t start = esp_timer_get_time();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        transfer();
+    }
+    int64_t duration = esp_timer_get_time() - start;
+
+    printf("%-28s %8.2f us per transfer\n", name, static_cast<float>(duration) / ITERATIONS);
+}
+
+extern "C" void app_main(void)
+{
+    try {
+        SPIMaster master(SPINum(CONFIG_SPI_NUM),
+                MOSI_PIN,
+                MISO_PIN,
+                SCLK_PIN);
+
+        shared_ptr<SPIDevice> spi_dev = master.create_dev(CS_PIN, Frequency::MHz(10));
+
+        // a typical register read: register address followed by a dummy byte clocking out the value
+        const vector<uint8_t> write_data = {0x75 | 0x80, 0x00};
+        uint8_t tx_buffer[2] = {0x75 | 0x80, 0x00};
+        uint8_t rx_buffer[2];
+
+        printf("Average latency of %zu two-byte transfers at 10 MHz:\n", ITERATIONS);
+        measure("queued", [&]() { spi_dev->transfer(write_data).get(); });
+        measure("queued, caller-owned buffers", [&]() { spi_dev->transfer(tx_buffer, rx_buffer, 2).get(); });
+        measure("polling", [&]() { spi_dev->polling_transfer(tx_buffer, rx_buffer, 2); });
+
+        // the bus is acquired once for all transfers instead of once per transfer
+        {
+            SPIDevice::BusSession session(*spi_dev);
+            measure("queued, bus session", [&]() { spi_dev->transfer(tx_buffer, rx_buffer, 2).get(); });
+            measure("polling, bus session", [&]() { spi_dev->polling_transfer(tx_buffer, rx_buffer, 2); });
+        }
+    } catch (const SPIException &e) {
+        printf("SPI Exception with error: %s (0x%X)\n", e.what(), e.error);
+        printf("Couldn't run benchmark!\n");
+    }
+
+    printf("Done\n");
+}
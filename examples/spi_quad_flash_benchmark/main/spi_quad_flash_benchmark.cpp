@@ -0,0 +1,145 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ *
+ * SPI Quad Flash Read Throughput Benchmark C++ Example
+ *
+ * This example code is in the Public Domain (or CC0 licensed, at your option.)
+ *
+ * Unless required by applicable law or agreed to in writing, this
+ * software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include "sdkconfig.h"
+#include <cstdio>
+#include <deque>
+#include "esp_timer.h"
+#include "spi_host_cxx.hpp"
+
+using namespace std;
+using namespace idf;
+
+static const size_t READ_SIZE = 64 * 1024;
+static const size_t CHUNK_SIZE = 4096;
+static const size_t QUEUE_DEPTH = 2;
+
+namespace {
+static const MOSI MOSI_PIN(CONFIG_SPI_MOSI);
+static const MISO MISO_PIN(CONFIG_SPI_MISO);
+static const SCLK SCLK_PIN(CONFIG_SPI_SCLK);
+static const QSPIWP WP_PIN(CONFIG_SPI_WP);
+static const QSPIHD HD_PIN(CONFIG_SPI_HD);
+static const CS     CS_PIN(CONFIG_SPI_CS);
+}
+
+static SPIPhaseBits phases(uint8_t command_bits, uint8_t address_bits, uint8_t dummy_bits)
+{
+    SPIPhaseBits phase_bits;
+    phase_bits.command_bits = command_bits;
+    phase_bits.address_bits = address_bits;
+    phase_bits.dummy_bits = dummy_bits;
+    return phase_bits;
+}
+
+/**
+ * A read command of a typical quad SPI NOR flash, e.g. of the W25Q series.
+ */
+struct ReadCommand {
+    const char *name;
+    SPILineMode line_mode;
+    uint8_t cmd;
+    SPIPhaseBits phase_bits;
+
+    /**
+     * The I/O commands send 8 mode bits after the 24-bit address, which are sent as part of the address.
+     */
+    bool with_mode_bits;
+};
+
+static const ReadCommand READ_COMMANDS[] = {
+    {"Read (1-1-1)", SPILineMode::SINGLE, 0x03, phases(8, 24, 0), false},
+    {"Fast Read (1-1-1)", SPILineMode::SINGLE, 0x0B, phases(8, 24, 8), false},
+    {"Dual Output (1-1-2)", SPILineMode::DUAL, 0x3B, phases(8, 24, 8), false},
+    {"Dual I/O (1-2-2)", SPILineMode::DIO, 0xBB, phases(8, 32, 0), true},
+    {"Quad Output (1-1-4)", SPILineMode::QUAD, 0x6B, phases(8, 24, 8), false},
+    {"Quad I/O (1-4-4)", SPILineMode::QIO, 0xEB, phases(8, 32, 4), true},
+};
+
+/**
+ * Read READ_SIZE bytes from address 0 in chunks, keeping up to QUEUE_DEPTH reads in flight.
+ */
+static vector<uint8_t> read_flash(SPIDevice &flash, const ReadCommand &command)
+{
+    vector<uint8_t> data;
+    data.reserve(READ_SIZE);
+    deque<SPIFuture> in_flight;
+
+    for (size_t addr = 0; addr < READ_SIZE; addr += CHUNK_SIZE) {
+        if (in_flight.size() == QUEUE_DEPTH) {
+            vector<uint8_t> chunk = in_flight.front().get();
+            data.insert(data.end(), chunk.begin(), chunk.end());
+            in_flight.pop_front();
+        }
+
+        uint64_t sent_addr = command.with_mode_bits ? addr << 8 : addr;
+        in_flight.push_back(flash.read(command.line_mode, command.phase_bits, command.cmd, sent_addr, CHUNK_SIZE));
+    }
+
+    while (!in_flight.empty()) {
+        vector<uint8_t> chunk = in_flight.front().get();
+        data.insert(data.end(), chunk.begin(), chunk.end());
+        in_flight.pop_front();
+    }
+
+    return data;
+}
+
+extern "C" void app_main(void)
+{
+    try {
+        SPIMaster master(SPINum(CONFIG_SPI_NUM),
+                MOSI_PIN,
+                MISO_PIN,
+                SCLK_PIN,
+                WP_PIN,
+                HD_PIN,
+                SPI_DMAConfig::AUTO(),
+                SPITransferSize(CHUNK_SIZE));
+
+        // The data lines are bidirectional in the dual and quad modes, so the device has to be half-duplex.
+        SPIDeviceConfig config;
+        config.phase_bits = phases(8, 24, 0);
+        config.half_duplex = true;
+        shared_ptr<SPIDevice> flash = master.create_dev(CS_PIN,
+                Frequency::MHz(CONFIG_SPI_FREQ_MHZ),
+                QueueSize(QUEUE_DEPTH),
+                config);
+
+        vector<uint8_t> id = flash->read(SPILineMode::SINGLE, phases(8, 0, 0), 0x9F, 0, 3).get();
+        printf("Flash JEDEC ID: %02X %02X %02X\n", id[0], id[1], id[2]);
+
+        printf("Reading %zu KiB in %zu byte chunks at %d MHz:\n", READ_SIZE / 1024, CHUNK_SIZE, CONFIG_SPI_FREQ_MHZ);
+        vector<uint8_t> reference;
+        for (const ReadCommand &command : READ_COMMANDS) {
+            int64_t start = esp_timer_get_time();
+            vector<uint8_t> data = read_flash(*flash, command);
+            int64_t duration = esp_timer_get_time() - start;
+
+            if (reference.empty()) {
+                reference = data;
+            }
+
+            printf("%-20s %8.2f MB/s%s\n",
+                    command.name,
+                    static_cast<float>(READ_SIZE) / static_cast<float>(duration),
+                    data == reference ? "" : " (data mismatch)");
+        }
+    } catch (const SPIException &e) {
+        printf("SPI Exception with error: %s (0x%X)\n", e.what(), e.error);
+        printf("Couldn't run benchmark!\n");
+    }
+
+    printf("Done\n");
+}
@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <deque>
 #include "catch.hpp"
 #include "gpio_cxx.hpp"
 #include "driver/spi_master.h"
@@ -98,12 +100,16 @@ struct SPIDevFix;
 struct SPITransactionDescriptorFix;
 struct SPITransactionTimeoutFix;
 struct SPITransactionFix;
+struct SPIQueueFix;
+struct SPIPollingFix;
 
 static SPIFix *g_fixture;
 static SPIDevFix *g_dev_fixture;
 static SPITransactionDescriptorFix *g_trans_desc_fixture;
 static SPITransactionTimeoutFix *g_trans_timeout_fixture;
 static SPITransactionFix *g_trans_fixture;
+static SPIQueueFix *g_queue_fixture;
+static SPIPollingFix *g_polling_fixture;
 
 struct SPIFix : public CMockFixture {
     SPIFix(spi_host_device_t host_id = spi_host_device_t(1),
@@ -301,6 +307,120 @@ struct SPITransactionDescriptorFix {
     std::vector<uint8_t> rx_data;
 };
 
+/**
+ * Emulates the transaction queue of a device in loopback: the results are returned in the order the transactions
+ * have been queued, the received data is the sent data.
+ */
+struct SPIQueueFix {
+    SPIQueueFix(size_t transactions, size_t bus_acquisitions = 1) : queued(), started()
+    {
+        spi_device_queue_trans_AddCallback(queue_trans_cb);
+        spi_device_get_trans_result_AddCallback(get_trans_result_cb);
+
+        for (size_t i = 0; i < bus_acquisitions; i++) {
+            spi_device_acquire_bus_ExpectAnyArgsAndReturn(ESP_OK);
+            spi_device_release_bus_ExpectAnyArgs();
+        }
+        for (size_t i = 0; i < transactions; i++) {
+            spi_device_queue_trans_ExpectAnyArgsAndReturn(ESP_OK);
+            spi_device_get_trans_result_ExpectAnyArgsAndReturn(ESP_OK);
+        }
+
+        g_queue_fixture = this;
+    }
+
+    ~SPIQueueFix()
+    {
+        spi_device_get_trans_result_AddCallback(nullptr);
+        spi_device_queue_trans_AddCallback(nullptr);
+        g_queue_fixture = nullptr;
+    }
+
+    static esp_err_t queue_trans_cb(spi_device_handle_t handle,
+            spi_transaction_t* trans_desc,
+            TickType_t ticks_to_wait,
+            int cmock_num_calls)
+    {
+        g_queue_fixture->queued.push_back(trans_desc);
+        g_queue_fixture->started.push_back(trans_desc);
+        return ESP_OK;
+    }
+
+    static esp_err_t get_trans_result_cb(spi_device_handle_t handle,
+            spi_transaction_t** trans_desc,
+            TickType_t ticks_to_wait,
+            int cmock_num_calls)
+    {
+        spi_transaction_t *finished = g_queue_fixture->queued.front();
+        g_queue_fixture->queued.pop_front();
+
+        uint8_t *rx_data = static_cast<uint8_t*>(finished->rx_buffer);
+        if (finished->tx_buffer && rx_data) {
+            const uint8_t *tx_data = static_cast<const uint8_t*>(finished->tx_buffer);
+            std::copy(tx_data, tx_data + finished->length / 8, rx_data);
+        } else if (rx_data) {
+            // receive-only transactions receive the byte indices
+            for (size_t i = 0; i < finished->rxlength / 8; i++) {
+                rx_data[i] = static_cast<uint8_t>(i);
+            }
+        }
+        *trans_desc = finished;
+
+        return ESP_OK;
+    }
+
+    std::deque<spi_transaction_t*> queued;
+
+    /**
+     * All transaction descriptors queued so far, in order.
+     */
+    std::vector<spi_transaction_t*> started;
+};
+
+/**
+ * Emulates polling transactions of a device in loopback, the received data is the sent data.
+ */
+struct SPIPollingFix {
+    SPIPollingFix(size_t transactions = 1) : flags(0), length(0)
+    {
+        spi_device_polling_start_AddCallback(polling_start_cb);
+
+        for (size_t i = 0; i < transactions; i++) {
+            spi_device_polling_start_ExpectAnyArgsAndReturn(ESP_OK);
+            spi_device_polling_end_ExpectAnyArgsAndReturn(ESP_OK);
+        }
+
+        g_polling_fixture = this;
+    }
+
+    ~SPIPollingFix()
+    {
+        spi_device_polling_start_AddCallback(nullptr);
+        g_polling_fixture = nullptr;
+    }
+
+    static esp_err_t polling_start_cb(spi_device_handle_t handle,
+            spi_transaction_t* trans_desc,
+            TickType_t ticks_to_wait,
+            int cmock_num_calls)
+    {
+        g_polling_fixture->flags = trans_desc->flags;
+        g_polling_fixture->length = trans_desc->length;
+
+        if (trans_desc->flags & SPI_TRANS_USE_TXDATA) {
+            std::copy(trans_desc->tx_data, trans_desc->tx_data + trans_desc->length / 8, trans_desc->rx_data);
+        } else {
+            const uint8_t *tx_data = static_cast<const uint8_t*>(trans_desc->tx_buffer);
+            std::copy(tx_data, tx_data + trans_desc->length / 8, static_cast<uint8_t*>(trans_desc->rx_buffer));
+        }
+
+        return ESP_OK;
+    }
+
+    uint32_t flags;
+    size_t length;
+};
+
 struct I2CMasterFix {
     I2CMasterFix(i2c_port_t port_arg = 0) : i2c_conf(), port(port_arg)
     {
@@ -349,14 +469,28 @@ struct I2CSlaveFix {
 };
 #endif
 
+enum class CmdLinkAlloc {
+    HEAP,
+    STATIC
+};
+
 struct I2CCmdLinkFix
 {
-    I2CCmdLinkFix(uint8_t expected_addr, i2c_rw_t type = I2C_MASTER_WRITE) : dummy_handle(reinterpret_cast<i2c_cmd_handle_t>(0xbeef))
+    I2CCmdLinkFix(uint8_t expected_addr, i2c_rw_t type = I2C_MASTER_WRITE, CmdLinkAlloc alloc = CmdLinkAlloc::HEAP)
+        : dummy_handle(reinterpret_cast<i2c_cmd_handle_t>(0xbeef))
     {
-        i2c_cmd_link_create_ExpectAndReturn(&dummy_handle);
+        if (alloc == CmdLinkAlloc::STATIC) {
+            i2c_cmd_link_create_static_ExpectAnyArgsAndReturn(&dummy_handle);
+        } else {
+            i2c_cmd_link_create_ExpectAndReturn(&dummy_handle);
+        }
         i2c_master_start_ExpectAndReturn(&dummy_handle, ESP_OK);
         i2c_master_write_byte_ExpectAndReturn(&dummy_handle, expected_addr << 1 | type, true, ESP_OK);
-        i2c_cmd_link_delete_Expect(&dummy_handle);
+        if (alloc == CmdLinkAlloc::STATIC) {
+            i2c_cmd_link_delete_static_Expect(&dummy_handle);
+        } else {
+            i2c_cmd_link_delete_Expect(&dummy_handle);
+        }
     }
 
     i2c_cmd_handle_t dummy_handle;
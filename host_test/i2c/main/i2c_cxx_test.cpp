@@ -13,10 +13,19 @@
 */
 #define CATCH_CONFIG_MAIN
 #include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <thread>
+#include <algorithm>
 #include "unity.h"
 #include "freertos/portmacro.h"
 #include "driver/i2c.h"
 #include "i2c_cxx.hpp"
+#include "i2c_register_cxx.hpp"
+#include "i2c_arbiter_cxx.hpp"
+#include "i2c_slave_stream_cxx.hpp"
+#include "i2c_poller_cxx.hpp"
+#include "i2c_eeprom_cxx.hpp"
 #include "system_cxx.hpp"
 #include "test_fixtures.hpp"
 
@@ -24,6 +33,7 @@
 
 extern "C" {
 #include "Mocki2c.h"
+#include "Mockesp_timer.h"
 }
 
 // TODO: IDF-2693, function definition just to satisfy linker, mock esp_common instead
@@ -34,6 +44,85 @@ const char *esp_err_to_name(esp_err_t code) {
 using namespace std;
 using namespace idf;
 
+/**
+ * Number of calls to the global operator new while counting is enabled by an AllocationCounter.
+ */
+static size_t g_allocations = 0;
+static bool g_count_allocations = false;
+
+void *operator new(size_t size)
+{
+    if (g_count_allocations) {
+        g_allocations++;
+    }
+
+    void *memory = malloc(size);
+    if (!memory) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+/**
+ * Counts the heap allocations done through operator new during its lifetime.
+ */
+struct AllocationCounter {
+    AllocationCounter()
+    {
+        g_allocations = 0;
+        g_count_allocations = true;
+    }
+
+    ~AllocationCounter()
+    {
+        g_count_allocations = false;
+    }
+
+    size_t count()
+    {
+        return g_allocations;
+    }
+};
+
+/**
+ * Transfer which doesn't access the bus but only reports the thread it has been executed in.
+ */
+struct ThreadIdTransfer {
+    typedef thread::id TransferReturnT;
+
+    thread::id do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr)
+    {
+        return this_thread::get_id();
+    }
+};
+
+/**
+ * Transfer which doesn't access the bus but appends its id to a log, optionally after a gate has been opened.
+ */
+struct LoggingTransfer {
+    typedef void TransferReturnT;
+
+    LoggingTransfer(int id_arg, vector<int> &log_arg, shared_future<void> gate_arg = shared_future<void>())
+        : id(id_arg), log(log_arg), gate(gate_arg) { }
+
+    void do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr)
+    {
+        if (gate.valid()) {
+            gate.wait();
+        }
+        log.push_back(id);
+    }
+
+    int id;
+    vector<int> &log;
+    shared_future<void> gate;
+};
+
 TEST_CASE("I2CNumber")
 {
     CMockFixture fix;
@@ -190,6 +279,89 @@ TEST_CASE("I2CWrite calls driver correctly")
     write.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47));
 }
 
+TEST_CASE("I2CCommandLink static buffer too small throws")
+{
+    CMockFixture fix;
+    uint8_t buffer[1];
+    i2c_cmd_link_create_static_ExpectAndReturn(buffer, sizeof(buffer), nullptr);
+
+    CHECK_THROWS_AS(I2CCommandLink(buffer, sizeof(buffer)), I2CException&);
+}
+
+TEST_CASE("I2CWrite do_transfer with static command link calls driver correctly")
+{
+    CMockFixture fix;
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+    uint8_t buffer[256];
+    uint8_t expected_write [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(expected_write);
+
+    i2c_cmd_link_create_static_ExpectAndReturn(buffer, sizeof(buffer), &dummy_handle);
+    i2c_master_start_ExpectAndReturn(&dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&dummy_handle, 0x47 << 1 | I2C_MASTER_WRITE, true, ESP_OK);
+    i2c_master_write_ExpectWithArrayAndReturn(&dummy_handle, expected_write, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+    i2c_cmd_link_delete_static_Expect(&dummy_handle);
+
+    I2CCommandLink cmd_link(buffer, sizeof(buffer));
+    cmd_link.start();
+    cmd_link.write_byte(0x47 << 1 | I2C_MASTER_WRITE);
+    cmd_link.write(expected_write, WRITE_SIZE);
+    cmd_link.stop();
+    cmd_link.execute_transfer(I2CNumber::I2C0(), chrono::milliseconds(1000));
+}
+
+TEST_CASE("I2CCommandLinkPool exhaustion throws ESP_ERR_NO_MEM")
+{
+    CMockFixture fix;
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+    i2c_cmd_link_create_static_IgnoreAndReturn(&dummy_handle);
+    i2c_cmd_link_delete_static_Ignore();
+
+    I2CCommandLinkPool pool;
+    vector<unique_ptr<I2CCommandLink> > links;
+    for (size_t i = 0; i < I2CCommandLinkPool::CAPACITY; i++) {
+        links.emplace_back(new I2CCommandLink(pool, chrono::milliseconds(0)));
+    }
+    CHECK(pool.available() == 0);
+
+    try {
+        I2CCommandLink exhausted(pool, chrono::milliseconds(10));
+        FAIL("no exception thrown");
+    } catch (const I2CException &e) {
+        CHECK(e.error == ESP_ERR_NO_MEM);
+    }
+
+    links.pop_back();
+    CHECK(pool.available() == 1);
+    I2CCommandLink link(pool, chrono::milliseconds(0));
+    CHECK(pool.available() == 0);
+}
+
+TEST_CASE("I2CCommandLinkPool waits until a command link is released")
+{
+    CMockFixture fix;
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+    i2c_cmd_link_create_static_IgnoreAndReturn(&dummy_handle);
+    i2c_cmd_link_delete_static_Ignore();
+
+    I2CCommandLinkPool pool;
+    vector<unique_ptr<I2CCommandLink> > links;
+    for (size_t i = 0; i < I2CCommandLinkPool::CAPACITY; i++) {
+        links.emplace_back(new I2CCommandLink(pool, chrono::milliseconds(0)));
+    }
+
+    thread releaser([&links]() {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        links.pop_back();
+    });
+    I2CCommandLink link(pool, chrono::milliseconds(1000));
+    releaser.join();
+
+    CHECK(pool.available() == 0);
+}
+
 TEST_CASE("I2CRead do_transfer fails at read")
 {
     CMockFixture fix;
@@ -276,6 +448,155 @@ TEST_CASE("I2CComposed calls driver correctly")
     }
 }
 
+TEST_CASE("I2CInlineComposed result has a view on each read")
+{
+    CMockFixture fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ);
+    uint8_t READ_DATA_0 [] = {0xAB, 0xBA};
+    uint8_t READ_DATA_1 [] = {0x01, 0x02, 0x03};
+    uint8_t expected_write [] = {0x47};
+
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, 2, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA_0, sizeof(READ_DATA_0));
+    i2c_master_start_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&cmd_fix.dummy_handle, 0x47 << 1 | I2C_MASTER_WRITE, true, ESP_OK);
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, expected_write, 1, 1, true, ESP_OK);
+    i2c_master_start_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&cmd_fix.dummy_handle, 0x47 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, 3, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA_1, sizeof(READ_DATA_1));
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CInlineComposed composed_transfer;
+    composed_transfer.add_read(2);
+    composed_transfer.add_write({0x47});
+    composed_transfer.add_read(3);
+
+    I2CComposedResult result = composed_transfer.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47));
+
+    REQUIRE(result.size() == 2);
+    CHECK(result.data() == vector<uint8_t>({0xAB, 0xBA, 0x01, 0x02, 0x03}));
+    CHECK(result[0].to_vector() == vector<uint8_t>({0xAB, 0xBA}));
+    CHECK(result[1].to_vector() == vector<uint8_t>({0x01, 0x02, 0x03}));
+    CHECK(result[1].data() == result.data().data() + 2);
+    CHECK_THROWS_AS(result[2], I2CException&);
+
+    // the result keeps the reads of its execution
+    composed_transfer.add_read(1);
+    CHECK(result.size() == 2);
+}
+
+/**
+ * Execute an I2CInlineComposed transfer with \c pairs write-read pairs and return the number of heap allocations
+ * done by the execution.
+ */
+static size_t composed_transfer_allocations(size_t pairs)
+{
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+
+    i2c_cmd_link_create_ExpectAndReturn(&dummy_handle);
+    for (size_t i = 0; i < pairs; i++) {
+        i2c_master_start_ExpectAndReturn(&dummy_handle, ESP_OK);
+        i2c_master_write_byte_ExpectAndReturn(&dummy_handle, 0x47 << 1 | I2C_MASTER_WRITE, true, ESP_OK);
+        i2c_master_write_ExpectAnyArgsAndReturn(ESP_OK);
+        i2c_master_start_ExpectAndReturn(&dummy_handle, ESP_OK);
+        i2c_master_write_byte_ExpectAndReturn(&dummy_handle, 0x47 << 1 | I2C_MASTER_READ, true, ESP_OK);
+        i2c_master_read_ExpectAnyArgsAndReturn(ESP_OK);
+    }
+    i2c_master_stop_ExpectAndReturn(&dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+    i2c_cmd_link_delete_Expect(&dummy_handle);
+
+    I2CInlineComposed composed_transfer;
+    for (size_t i = 0; i < pairs; i++) {
+        composed_transfer.add_write({static_cast<uint8_t>(i)});
+        composed_transfer.add_read(2);
+    }
+
+    AllocationCounter allocations;
+    I2CComposedResult result = composed_transfer.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47));
+    CHECK(result.size() == pairs);
+    return allocations.count();
+}
+
+TEST_CASE("I2CInlineComposed execution allocates independently of the number of steps")
+{
+    CMockFixture fix;
+
+    size_t single_pair = composed_transfer_allocations(1);
+    size_t many_pairs = composed_transfer_allocations(16);
+
+    // only the read buffer, which is moved into the result
+    CHECK(single_pair == many_pairs);
+    CHECK(many_pairs == 1);
+}
+
+TEST_CASE("I2CStaticComposed calls driver correctly")
+{
+    CMockFixture fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE);
+    uint8_t expected_write [] = {0x47, 0x48, 0x49};
+    const size_t WRITE_SIZE = sizeof(expected_write);
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const size_t READ_SIZE = sizeof(READ_DATA);
+
+    // the write-read transaction with repeated start:
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, expected_write, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_start_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&cmd_fix.dummy_handle, 0x47 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, READ_SIZE, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, READ_SIZE);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CStaticComposed<I2CWriteStep<WRITE_SIZE>, I2CReadStep<READ_SIZE> > composed_transfer(
+            I2CWriteStep<WRITE_SIZE>({0x47, 0x48, 0x49}),
+            I2CReadStep<READ_SIZE>());
+
+    tuple<array<uint8_t, READ_SIZE> > read_result = composed_transfer.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47));
+
+    for (size_t i = 0; i < READ_SIZE; i++) {
+        CHECK(READ_DATA[i] == get<0>(read_result)[i]);
+    }
+}
+
+TEST_CASE("I2CMaster synchronous static composed transfer doesn't allocate")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    uint8_t expected_write [] = {0x47};
+    const size_t WRITE_SIZE = sizeof(expected_write);
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const size_t READ_SIZE = sizeof(READ_DATA);
+
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, expected_write, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_start_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&cmd_fix.dummy_handle, 0x47 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, READ_SIZE, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, READ_SIZE);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CStaticComposed<I2CWriteStep<WRITE_SIZE>, I2CReadStep<READ_SIZE> > composed_transfer(
+            I2CWriteStep<WRITE_SIZE>({0x47}),
+            I2CReadStep<READ_SIZE>());
+
+    AllocationCounter allocations;
+    tuple<array<uint8_t, READ_SIZE> > read_result = master.sync_transfer(I2CAddress(0x47), composed_transfer);
+    size_t allocation_count = allocations.count();
+
+    CHECK(allocation_count == 0);
+    CHECK(get<0>(read_result)[0] == 0xAB);
+    CHECK(get<0>(read_result)[1] == 0xBA);
+}
+
 TEST_CASE("I2CWrite transfer calls driver correctly")
 {
     CMockFixture fix;
@@ -297,13 +618,190 @@ TEST_CASE("I2CWrite transfer calls driver correctly")
     master.transfer(I2CAddress(0x47), writer);
 }
 
-TEST_CASE("I2CMaster synchronous write")
+TEST_CASE("I2CTransferWorker zero queue size throws")
+{
+    I2CWorkerConfig worker_config;
+    worker_config.queue_size = 0;
+
+    CHECK_THROWS_AS(I2CTransferWorker worker(worker_config), I2CException&);
+}
+
+TEST_CASE("I2CMaster worker executes all transfers in the same thread")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CWorkerConfig worker_config;
+    worker_config.queue_size = 2;
+    const size_t TRANSFER_NUM = 8;
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000), worker_config);
+    vector<future<thread::id> > results;
+    for (size_t i = 0; i < TRANSFER_NUM; i++) {
+        results.push_back(master.transfer(I2CAddress(0x47), make_shared<ThreadIdTransfer>()));
+    }
+
+    thread::id worker_id = results[0].get();
+    CHECK(worker_id != this_thread::get_id());
+    for (size_t i = 1; i < TRANSFER_NUM; i++) {
+        CHECK(results[i].get() == worker_id);
+    }
+}
+
+TEST_CASE("I2CWrite transfer with worker calls driver correctly")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE);
+    uint8_t expected_write [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(expected_write);
+    const size_t EXPECTED_DATA_LEN = WRITE_SIZE;
+
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, expected_write, WRITE_SIZE, EXPECTED_DATA_LEN, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000), I2CWorkerConfig());
+    std::vector<uint8_t> WRITE_BYTES = {0xAB, 0xBA};
+    auto writer = make_shared<I2CWrite>(WRITE_BYTES);
+    master.transfer(I2CAddress(0x47), writer).get();
+}
+
+TEST_CASE("I2CInlineRead transfer by value with worker calls driver correctly")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ);
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const size_t READ_SIZE = sizeof(READ_DATA);
+
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, READ_SIZE, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, READ_SIZE);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000), I2CWorkerConfig());
+    vector<uint8_t> result = master.transfer(I2CAddress(0x47), I2CInlineRead(READ_SIZE)).get();
+    CHECK(result == vector<uint8_t>(READ_DATA, READ_DATA + READ_SIZE));
+}
+
+TEST_CASE("I2CInlineWrite transfer by reference calls driver correctly")
 {
     CMockFixture fix;
     I2CMasterFix master_fix;
     I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE);
     uint8_t expected_write [] = {0xAB, 0xBA};
     const size_t WRITE_SIZE = sizeof(expected_write);
+
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, expected_write, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CInlineWrite writer({0xAB, 0xBA});
+    master.transfer(I2CAddress(0x47), std::ref(writer)).get();
+}
+
+TEST_CASE("I2CMaster transfer by value passes exception to future")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ);
+
+    i2c_master_read_ExpectAnyArgsAndReturn(ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAnyArgsAndReturn(ESP_ERR_TIMEOUT);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000), I2CWorkerConfig());
+    future<vector<uint8_t> > result = master.transfer(I2CAddress(0x47), I2CInlineRead(2));
+    CHECK_THROWS_AS(result.get(), I2CTransferException&);
+}
+
+static_assert(is_base_of<I2CTransfer<void>, I2CWrite>::value, "I2CWrite must be an I2CTransfer");
+static_assert(is_base_of<I2CTransfer<vector<uint8_t> >, I2CRead>::value, "I2CRead must be an I2CTransfer");
+
+TEST_CASE("I2CRead can be used through the I2CTransfer interface")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ);
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const size_t READ_SIZE = sizeof(READ_DATA);
+
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, READ_SIZE, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, READ_SIZE);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    shared_ptr<I2CTransfer<vector<uint8_t> > > reader = make_shared<I2CRead>(READ_SIZE);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000), I2CWorkerConfig());
+    vector<uint8_t> result = master.transfer(I2CAddress(0x47), reader).get();
+    CHECK(result == vector<uint8_t>(READ_DATA, READ_DATA + READ_SIZE));
+}
+
+// Not inlined into the benchmark, so that the code size of both variants can be compared with
+// "nm -S --size-sort" on the test binary.
+__attribute__((noinline)) vector<uint8_t> virtual_read_call(I2CTransfer<vector<uint8_t> > &xfer,
+        I2CCommandLinkPool &pool)
+{
+    return xfer.do_transfer(pool, chrono::milliseconds(0), I2CNumber::I2C0(), I2CAddress(0x47));
+}
+
+__attribute__((noinline)) vector<uint8_t> inline_read_call(I2CInlineRead &xfer, I2CCommandLinkPool &pool)
+{
+    return xfer.do_transfer(pool, chrono::milliseconds(0), I2CNumber::I2C0(), I2CAddress(0x47));
+}
+
+/**
+ * Time per call of func, averaged over iterations calls.
+ */
+template<typename FuncT>
+static chrono::nanoseconds time_per_call(size_t iterations, FuncT func)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        func();
+    }
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start) / iterations;
+}
+
+TEST_CASE("Benchmark virtual vs. inline transfer dispatch", "[.][benchmark]")
+{
+    CMockFixture fix;
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+    const size_t ITERATIONS = 100000;
+
+    i2c_cmd_link_create_static_IgnoreAndReturn(&dummy_handle);
+    i2c_cmd_link_delete_static_Ignore();
+    i2c_master_start_IgnoreAndReturn(ESP_OK);
+    i2c_master_write_byte_IgnoreAndReturn(ESP_OK);
+    i2c_master_read_IgnoreAndReturn(ESP_OK);
+    i2c_master_stop_IgnoreAndReturn(ESP_OK);
+    i2c_master_cmd_begin_IgnoreAndReturn(ESP_OK);
+
+    I2CCommandLinkPool pool;
+    I2CRead virtual_read(2);
+    I2CInlineRead inline_read(2);
+
+    chrono::nanoseconds virtual_time = time_per_call(ITERATIONS, [&]() { virtual_read_call(virtual_read, pool); });
+    chrono::nanoseconds inline_time = time_per_call(ITERATIONS, [&]() { inline_read_call(inline_read, pool); });
+
+    printf("transfer dispatch: virtual %lld ns/call, inline %lld ns/call\n",
+            static_cast<long long>(virtual_time.count()),
+            static_cast<long long>(inline_time.count()));
+    printf("transfer object size: virtual %zu bytes, inline %zu bytes\n", sizeof(I2CRead), sizeof(I2CInlineRead));
+    CHECK(sizeof(I2CInlineRead) < sizeof(I2CRead));
+}
+
+TEST_CASE("I2CMaster synchronous write")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    uint8_t expected_write [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(expected_write);
     const size_t EXPECTED_DATA_LEN = WRITE_SIZE;
 
     // note that this behavior is not entirely correct, in th real driver, only i2c_master_cmd_begin()
@@ -321,7 +819,7 @@ TEST_CASE("I2CMaster synchronous read")
 {
     CMockFixture fix;
     I2CMasterFix master_fix;
-    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ);
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ, CmdLinkAlloc::STATIC);
     uint8_t READ_DATA [] = {0xAB, 0xBA};
     const size_t READ_SIZE = sizeof(READ_DATA);
 
@@ -346,7 +844,7 @@ TEST_CASE("I2CMaster syncronous transfer (read and write)")
 {
     CMockFixture fix;
     I2CMasterFix master_fix;
-    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE);
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
     i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
     uint8_t expected_write [] = {0x47, 0x48, 0x49};
     const size_t WRITE_SIZE = sizeof(expected_write);
@@ -376,30 +874,979 @@ TEST_CASE("I2CMaster syncronous transfer (read and write)")
     }
 }
 
-#if SOC_I2C_SUPPORT_SLAVE
-TEST_CASE("I2CSlave parameter configuration fails")
+TEST_CASE("I2CMaster synchronous raw buffer transfers with invalid arguments throw")
 {
     CMockFixture fix;
-    i2c_param_config_ExpectAnyArgsAndReturn(ESP_FAIL);
+    I2CMasterFix master_fix;
+    uint8_t buffer [] = {0x47};
 
-    CHECK_THROWS_AS(I2CSlave(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), I2CAddress(0x47), 64, 64), I2CException&);
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    CHECK_THROWS_AS(master.sync_write(I2CAddress(0x47), nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(master.sync_write(I2CAddress(0x47), buffer, 0), I2CException&);
+    CHECK_THROWS_AS(master.sync_read(I2CAddress(0x47), nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(master.sync_read(I2CAddress(0x47), buffer, 0), I2CException&);
+    CHECK_THROWS_AS(master.sync_transfer(I2CAddress(0x47), buffer, 1, nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(master.sync_transfer(I2CAddress(0x47), nullptr, 1, buffer, 1), I2CException&);
 }
 
-TEST_CASE("I2CSlave driver installation fails")
+TEST_CASE("I2CMaster synchronous raw buffer write doesn't allocate")
 {
     CMockFixture fix;
-    i2c_param_config_IgnoreAndReturn(ESP_OK);
-    i2c_driver_install_IgnoreAndReturn(ESP_FAIL);
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    const uint8_t WRITE_DATA [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(WRITE_DATA);
 
-    CHECK_THROWS_AS(I2CSlave (I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), I2CAddress(0x47), 64, 64), I2CException&);
-}
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, WRITE_DATA, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
 
-TEST_CASE("I2CSlave calls driver functions correctly")
-{
-    CMockFixture fix;
-    I2CSlaveFix slave_fix(CreateAnd::SUCCEED);
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    AllocationCounter allocations;
+    master.sync_write(I2CAddress(0x47), WRITE_DATA, WRITE_SIZE);
+    size_t allocation_count = allocations.count();
 
-    I2CSlave slave(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), I2CAddress(0x47), 64, 64);
+    CHECK(allocation_count == 0);
+}
+
+TEST_CASE("I2CMaster synchronous raw buffer read doesn't allocate")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ, CmdLinkAlloc::STATIC);
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const size_t READ_SIZE = sizeof(READ_DATA);
+    uint8_t read_buffer [READ_SIZE] = {};
+
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, read_buffer, READ_SIZE, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, READ_SIZE);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    AllocationCounter allocations;
+    master.sync_read(I2CAddress(0x47), read_buffer, READ_SIZE);
+    size_t allocation_count = allocations.count();
+
+    CHECK(allocation_count == 0);
+    CHECK(read_buffer[0] == 0xAB);
+    CHECK(read_buffer[1] == 0xBA);
+}
+
+TEST_CASE("I2CMaster synchronous raw buffer transfer doesn't allocate")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    const uint8_t WRITE_DATA [] = {0x47, 0x48, 0x49};
+    const size_t WRITE_SIZE = sizeof(WRITE_DATA);
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const size_t READ_SIZE = sizeof(READ_DATA);
+    uint8_t read_buffer [READ_SIZE] = {};
+
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, WRITE_DATA, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_start_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&cmd_fix.dummy_handle, 0x47 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, read_buffer, READ_SIZE, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, READ_SIZE);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    AllocationCounter allocations;
+    master.sync_transfer(I2CAddress(0x47), WRITE_DATA, WRITE_SIZE, read_buffer, READ_SIZE);
+    size_t allocation_count = allocations.count();
+
+    CHECK(allocation_count == 0);
+    CHECK(read_buffer[0] == 0xAB);
+    CHECK(read_buffer[1] == 0xBA);
+}
+
+TEST_CASE("I2CResult reports value and error")
+{
+    I2CResult<int> success(47);
+    I2CResult<int> failure = I2CResult<int>::failure(ESP_FAIL);
+    I2CResult<int> invalid = I2CResult<int>::failure(ESP_ERR_INVALID_ARG);
+    I2CResult<> void_success;
+    I2CResult<> void_failure(ESP_ERR_TIMEOUT);
+
+    CHECK(success.ok());
+    CHECK(success.error() == ESP_OK);
+    CHECK(success.value() == 47);
+    CHECK(!failure);
+    CHECK(failure.error() == ESP_FAIL);
+    CHECK(failure.value_or(0) == 0);
+    CHECK_THROWS_AS(failure.value(), I2CTransferException&);
+    CHECK_THROWS_AS(invalid.value(), I2CException&);
+    CHECK(void_success.ok());
+    CHECK_NOTHROW(void_success.value());
+    CHECK(void_failure.error() == ESP_ERR_TIMEOUT);
+    CHECK_THROWS_AS(void_failure.value(), I2CTransferException&);
+}
+
+TEST_CASE("I2CMaster try transfers with invalid arguments return error")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    uint8_t buffer [] = {0x47};
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    CHECK(master.try_write(I2CAddress(0x47), nullptr, 1).error() == ESP_ERR_INVALID_ARG);
+    CHECK(master.try_write(I2CAddress(0x47), buffer, 0).error() == ESP_ERR_INVALID_ARG);
+    CHECK(master.try_read(I2CAddress(0x47), nullptr, 1).error() == ESP_ERR_INVALID_ARG);
+    CHECK(master.try_read(I2CAddress(0x47), buffer, 0).error() == ESP_ERR_INVALID_ARG);
+    CHECK(master.try_transfer(I2CAddress(0x47), buffer, 1, nullptr, 1).error() == ESP_ERR_INVALID_ARG);
+    CHECK(master.try_transfer(I2CAddress(0x47), nullptr, 1, buffer, 1).error() == ESP_ERR_INVALID_ARG);
+}
+
+TEST_CASE("I2CMaster try_write returns NACK without throwing")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    const uint8_t WRITE_DATA [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(WRITE_DATA);
+
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, WRITE_DATA, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CResult<> result = master.try_write(I2CAddress(0x47), WRITE_DATA, WRITE_SIZE);
+
+    CHECK(!result);
+    CHECK(result.error() == ESP_FAIL);
+}
+
+TEST_CASE("I2CMaster try_write stops recording at first error")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    const uint8_t WRITE_DATA [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(WRITE_DATA);
+
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, WRITE_DATA, WRITE_SIZE, WRITE_SIZE, true, ESP_ERR_NO_MEM);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    CHECK(master.try_write(I2CAddress(0x47), WRITE_DATA, WRITE_SIZE).error() == ESP_ERR_NO_MEM);
+}
+
+TEST_CASE("I2CMaster try_read returns read data in array")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ, CmdLinkAlloc::STATIC);
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const size_t READ_SIZE = sizeof(READ_DATA);
+
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, READ_SIZE, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, READ_SIZE);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CResult<array<uint8_t, READ_SIZE> > result = master.try_read<READ_SIZE>(I2CAddress(0x47));
+
+    REQUIRE(result.ok());
+    CHECK(result.value()[0] == 0xAB);
+    CHECK(result.value()[1] == 0xBA);
+}
+
+TEST_CASE("I2CMaster sync_write throws transfer exception on NACK")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    const uint8_t WRITE_DATA [] = {0xAB};
+
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, WRITE_DATA, 1, 1, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    CHECK_THROWS_AS(master.sync_write(I2CAddress(0x47), WRITE_DATA, 1), I2CTransferException&);
+}
+
+/**
+ * Expect the probes of I2CMaster::scan(), only the devices in \c present acknowledge.
+ */
+static void expect_scan(i2c_cmd_handle_t *dummy_handle, const vector<uint8_t> &present)
+{
+    for (uint8_t addr = 0x08; addr <= 0x77; addr++) {
+        bool found = find(present.begin(), present.end(), addr) != present.end();
+        i2c_cmd_link_create_static_ExpectAnyArgsAndReturn(dummy_handle);
+        i2c_master_start_ExpectAndReturn(dummy_handle, ESP_OK);
+        i2c_master_write_byte_ExpectAndReturn(dummy_handle, addr << 1 | I2C_MASTER_WRITE, true, ESP_OK);
+        i2c_master_stop_ExpectAndReturn(dummy_handle, ESP_OK);
+        i2c_master_cmd_begin_ExpectAndReturn(0, dummy_handle, 10 / portTICK_PERIOD_MS, found ? ESP_OK : ESP_FAIL);
+        i2c_cmd_link_delete_static_Expect(dummy_handle);
+    }
+}
+
+TEST_CASE("I2CMaster scan probes all non-reserved addresses")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+    expect_scan(&dummy_handle, {0x08, 0x47, 0x77});
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    bitset<128> found = master.scan();
+
+    CHECK(found.count() == 3);
+    CHECK(found.test(0x08));
+    CHECK(found.test(0x47));
+    CHECK(found.test(0x77));
+    CHECK(master.is_present(I2CAddress(0x47)));
+    CHECK(!master.is_present(I2CAddress(0x48)));
+}
+
+TEST_CASE("I2CMaster transfers to addresses absent in scan fail fast")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+    expect_scan(&dummy_handle, {0x47});
+    uint8_t buffer [] = {0x01};
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    master.scan();
+
+    CHECK(master.try_write(I2CAddress(0x48), buffer, 1).error() == ESP_ERR_NOT_FOUND);
+    CHECK(master.try_read(I2CAddress(0x48), buffer, 1).error() == ESP_ERR_NOT_FOUND);
+    CHECK(master.try_transfer(I2CAddress(0x48), buffer, 1, buffer, 1).error() == ESP_ERR_NOT_FOUND);
+    CHECK_THROWS_AS(master.sync_write(I2CAddress(0x48), buffer, 1), I2CTransferException&);
+
+    I2CBatch batch;
+    batch.add_write(I2CAddress(0x48), buffer, 1);
+    CHECK(master.sync_batch(batch) == 1);
+    CHECK(batch.get_error(0) == ESP_ERR_NOT_FOUND);
+
+    master.forget_presence();
+    CHECK(master.is_present(I2CAddress(0x48)));
+}
+
+TEST_CASE("I2CMaster scan of several buses with empty master throws")
+{
+    CHECK_THROWS_AS(I2CMaster::scan({shared_ptr<I2CMaster>()}), I2CException&);
+    CHECK(I2CMaster::scan(vector<shared_ptr<I2CMaster> >()).empty());
+}
+
+TEST_CASE("I2CStatistics without devices throws")
+{
+    CHECK_THROWS_AS(I2CStatistics(0), I2CException&);
+}
+
+TEST_CASE("I2CStatistics records results and latencies per address")
+{
+    I2CStatistics stats(4);
+
+    stats.record(0x47, 2, ESP_OK, 100);
+    stats.record(0x47, 3, ESP_FAIL, 300);
+    stats.record(0x47, 0, ESP_ERR_TIMEOUT, 20000);
+    stats.record(0x47, 0, ESP_ERR_INVALID_STATE, 128);
+    stats.record(0x48, 1, ESP_OK, 50);
+
+    I2CAddressStats result = stats.get(I2CAddress(0x47));
+    CHECK(result.address == 0x47);
+    CHECK(result.transactions == 4);
+    CHECK(result.bytes == 5);
+    CHECK(result.nacks == 1);
+    CHECK(result.timeouts == 1);
+    CHECK(result.errors == 1);
+    CHECK(result.total_latency_us == 20528);
+    CHECK(result.max_latency_us == 20000);
+    CHECK(result.latency_histogram[0] == 1);
+    CHECK(result.latency_histogram[1] == 1);
+    CHECK(result.latency_histogram[2] == 1);
+    CHECK(result.latency_histogram[I2CAddressStats::LATENCY_BUCKETS - 1] == 1);
+
+    CHECK(stats.get(I2CAddress(0x48)).transactions == 1);
+    CHECK(stats.get(I2CAddress(0x49)).transactions == 0);
+    CHECK(stats.snapshot().size() == 2);
+}
+
+TEST_CASE("I2CStatistics ignores new addresses when full and can be reset")
+{
+    I2CStatistics stats(1);
+
+    stats.record(0x47, 1, ESP_OK, 100);
+    stats.record(0x48, 1, ESP_OK, 100);
+
+    vector<I2CAddressStats> snapshot = stats.snapshot();
+    REQUIRE(snapshot.size() == 1);
+    CHECK(snapshot[0].address == 0x47);
+    CHECK(stats.get(I2CAddress(0x48)).transactions == 0);
+
+    stats.reset();
+    CHECK(stats.snapshot().empty());
+    stats.record(0x48, 1, ESP_OK, 100);
+    CHECK(stats.get(I2CAddress(0x48)).transactions == 1);
+}
+
+TEST_CASE("I2CBatch with invalid arguments throws")
+{
+    I2CBatch batch;
+    uint8_t buffer [] = {0x47};
+
+    CHECK_THROWS_AS(batch.add_write(I2CAddress(0x47), nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(batch.add_write(I2CAddress(0x47), buffer, 0), I2CException&);
+    CHECK_THROWS_AS(batch.add_read(I2CAddress(0x47), nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(batch.add_read(I2CAddress(0x47), buffer, 0), I2CException&);
+    CHECK_THROWS_AS(batch.add_transfer(I2CAddress(0x47), buffer, 1, nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(batch.add_transfer(I2CAddress(0x47), nullptr, 1, buffer, 1), I2CException&);
+    CHECK_THROWS_AS(batch.get_error(0), I2CException&);
+    CHECK(batch.size() == 0);
+}
+
+TEST_CASE("I2CBatch entries are not executed before sync_batch")
+{
+    I2CBatch batch;
+    uint8_t buffer [] = {0x47};
+
+    CHECK(batch.add_write(I2CAddress(0x47), buffer, 1) == 0);
+    CHECK(batch.add_read(I2CAddress(0x48), buffer, 1) == 1);
+    CHECK(batch.size() == 2);
+    CHECK(batch.get_error(1) == ESP_ERR_INVALID_STATE);
+
+    batch.clear();
+    CHECK(batch.size() == 0);
+}
+
+TEST_CASE("I2CMaster sync_batch continues after NACK and reports errors per entry")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t WRITE_DATA [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(WRITE_DATA);
+    const uint8_t REG_ADDR [] = {0x01};
+    uint8_t READ_DATA [] = {0xCD};
+    uint8_t read_buffer [1] = {};
+    uint8_t transfer_buffer [1] = {};
+
+    I2CCmdLinkFix write_cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&write_cmd_fix.dummy_handle, WRITE_DATA, WRITE_SIZE, WRITE_SIZE, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&write_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &write_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CCmdLinkFix read_cmd_fix(0x48, I2C_MASTER_READ, CmdLinkAlloc::STATIC);
+    i2c_master_read_ExpectAndReturn(&read_cmd_fix.dummy_handle, read_buffer, 1, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&read_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &read_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+
+    I2CCmdLinkFix transfer_cmd_fix(0x49, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&transfer_cmd_fix.dummy_handle, REG_ADDR, 1, 1, true, ESP_OK);
+    i2c_master_start_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, 0x49 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, transfer_buffer, 1, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, 1);
+    i2c_master_stop_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &transfer_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CBatch batch;
+    batch.add_write(I2CAddress(0x47), WRITE_DATA, WRITE_SIZE);
+    batch.add_read(I2CAddress(0x48), read_buffer, sizeof(read_buffer));
+    batch.add_transfer(I2CAddress(0x49), REG_ADDR, sizeof(REG_ADDR), transfer_buffer, sizeof(transfer_buffer));
+
+    AllocationCounter allocations;
+    size_t failed = master.sync_batch(batch);
+    size_t allocation_count = allocations.count();
+
+    CHECK(failed == 1);
+    CHECK(allocation_count == 0);
+    CHECK(batch.get_error(0) == ESP_OK);
+    CHECK(batch.get_error(1) == ESP_FAIL);
+    CHECK(batch.get_error(2) == ESP_OK);
+    CHECK(transfer_buffer[0] == 0xCD);
+}
+
+// CMock keeps the pointers to the expected and returned data, hence they have to outlive the test
+static void expect_register_read(I2CCmdLinkFix &cmd_fix, const uint8_t *reg_addr, uint8_t *read_data)
+{
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, reg_addr, 1, 1, true, ESP_OK);
+    i2c_master_start_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&cmd_fix.dummy_handle, 0x47 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, 1, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(read_data, 1);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+}
+
+static void expect_register_write(I2CCmdLinkFix &cmd_fix, const uint8_t *data, size_t data_len)
+{
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle, data, data_len, data_len, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+}
+
+static constexpr array<I2CRegister, 4> TEST_REGISTERS = {{
+    {0x10, false, true},
+    {0x11, false, true},
+    {0x12, false, false},
+    {0x13, true, false},
+}};
+
+static constexpr array<I2CRegister, 2> DUPLICATE_REGISTERS = {{ {0x10, false, true}, {0x10, true, false} }};
+static constexpr array<I2CRegister, 2> UNSORTED_REGISTERS = {{ {0x11, false, true}, {0x10, true, false} }};
+
+static_assert(i2c_register_map_ascending(TEST_REGISTERS), "test register map is rejected");
+static_assert(!i2c_register_map_ascending(DUPLICATE_REGISTERS), "duplicate register addresses are accepted");
+static_assert(!i2c_register_map_ascending(UNSORTED_REGISTERS), "unsorted register addresses are accepted");
+
+TEST_CASE("I2CRegisterDevice without master throws")
+{
+    CMockFixture fix;
+
+    CHECK_THROWS_AS(I2CRegisterDevice<TEST_REGISTERS>(nullptr, I2CAddress(0x47)), I2CException&);
+}
+
+TEST_CASE("I2CRegisterDevice access to unknown register throws")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CRegisterDevice<TEST_REGISTERS> device(master, I2CAddress(0x47));
+
+    CHECK_THROWS_AS(device.read(0x14), I2CException&);
+    CHECK_THROWS_AS(device.write(0x0F, 0), I2CException&);
+    CHECK_THROWS_AS(device.update_bits(0x20, 0x01, 0x01), I2CException&);
+}
+
+TEST_CASE("I2CRegisterDevice reads non-volatile register from the bus only once")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t REG_ADDR = 0x11;
+    uint8_t READ_DATA = 0xAB;
+    I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    expect_register_read(cmd_fix, &REG_ADDR, &READ_DATA);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CRegisterDevice<TEST_REGISTERS> device(master, I2CAddress(0x47));
+
+    CHECK(device.read(0x11) == 0xAB);
+    CHECK(device.read(0x11) == 0xAB);
+}
+
+TEST_CASE("I2CRegisterDevice reads volatile register from the bus each time")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t REG_ADDR = 0x13;
+    uint8_t FIRST_READ_DATA = 0xAB;
+    uint8_t SECOND_READ_DATA = 0xBA;
+    I2CCmdLinkFix first_cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    expect_register_read(first_cmd_fix, &REG_ADDR, &FIRST_READ_DATA);
+    I2CCmdLinkFix second_cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    expect_register_read(second_cmd_fix, &REG_ADDR, &SECOND_READ_DATA);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CRegisterDevice<TEST_REGISTERS> device(master, I2CAddress(0x47));
+
+    CHECK(device.read(0x13) == 0xAB);
+    CHECK(device.read(0x13) == 0xBA);
+}
+
+TEST_CASE("I2CRegisterDevice flush merges writes to adjacent registers")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t EXPECTED_BURST [] = {0x10, 0x01, 0x02, 0x03};
+    const uint8_t EXPECTED_SINGLE [] = {0x13, 0x04};
+    I2CCmdLinkFix first_cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    expect_register_write(first_cmd_fix, EXPECTED_BURST, sizeof(EXPECTED_BURST));
+    I2CCmdLinkFix second_cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    expect_register_write(second_cmd_fix, EXPECTED_SINGLE, sizeof(EXPECTED_SINGLE));
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CRegisterDevice<TEST_REGISTERS> device(master, I2CAddress(0x47));
+
+    // 0x12 doesn't auto-increment, so 0x13 starts a new write
+    device.write(0x13, 0x04);
+    device.write(0x11, 0x02);
+    device.write(0x10, 0x01);
+    device.write(0x12, 0x03);
+    CHECK(device.has_pending_writes());
+
+    device.flush();
+
+    CHECK(!device.has_pending_writes());
+    CHECK(device.read(0x11) == 0x02);
+}
+
+TEST_CASE("I2CRegisterDevice update_bits reads once and writes only changed values")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t REG_ADDR = 0x12;
+    uint8_t READ_DATA = 0xF0;
+    const uint8_t EXPECTED_WRITE [] = {0x12, 0xF3};
+    I2CCmdLinkFix read_cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    expect_register_read(read_cmd_fix, &REG_ADDR, &READ_DATA);
+    I2CCmdLinkFix write_cmd_fix(0x47, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    expect_register_write(write_cmd_fix, EXPECTED_WRITE, sizeof(EXPECTED_WRITE));
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CRegisterDevice<TEST_REGISTERS> device(master, I2CAddress(0x47));
+
+    device.update_bits(0x12, 0x0F, 0x01);
+    device.update_bits(0x12, 0x02, 0x02);
+    device.flush();
+
+    device.update_bits(0x12, 0xF0, 0xF0);
+    CHECK(!device.has_pending_writes());
+    device.flush();
+}
+
+TEST_CASE("I2CBusArbiter with invalid arguments throws")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CArbiterConfig zero_queue_config;
+    zero_queue_config.queue_sizes[1] = 0;
+
+    CHECK_THROWS_AS(I2CBusArbiter(nullptr), I2CException&);
+    CHECK_THROWS_AS(I2CBusArbiter(master, zero_queue_config), I2CException&);
+
+    I2CBusArbiter arbiter(master);
+    const I2CPageLayout LAYOUT = {16, 1, chrono::milliseconds(0)};
+    CHECK_THROWS_AS(arbiter.paged_write(I2CPriority::LOW, I2CAddress(0x50), 0, {}, LAYOUT), I2CException&);
+    CHECK_THROWS_AS(arbiter.paged_write(I2CPriority::LOW, I2CAddress(0x50), 0, {0x01}, {0, 1, chrono::milliseconds(0)}),
+            I2CException&);
+    CHECK_THROWS_AS(arbiter.paged_write(I2CPriority::LOW, I2CAddress(0x50), 0, {0x01}, {16, 5, chrono::milliseconds(0)}),
+            I2CException&);
+    CHECK_THROWS_AS(arbiter.transfer(I2CPriority::HIGH, I2CAddress(0x47), shared_ptr<ThreadIdTransfer>()), I2CException&);
+}
+
+TEST_CASE("I2CBusArbiter executes higher priority class first")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    vector<int> log;
+    promise<void> gate;
+
+    {
+        I2CBusArbiter arbiter(master);
+        future<void> first = arbiter.transfer(I2CPriority::LOW,
+                I2CAddress(0x47),
+                make_shared<LoggingTransfer>(1, log, gate.get_future().share()));
+        future<void> low = arbiter.transfer(I2CPriority::LOW, I2CAddress(0x47), make_shared<LoggingTransfer>(2, log));
+        future<void> high = arbiter.transfer(I2CPriority::HIGH, I2CAddress(0x47), make_shared<LoggingTransfer>(3, log));
+        gate.set_value();
+
+        first.get();
+        low.get();
+        high.get();
+
+        CHECK(arbiter.get_stats(I2CPriority::LOW).transactions == 2);
+        CHECK(arbiter.get_stats(I2CPriority::HIGH).transactions == 1);
+        CHECK(arbiter.get_stats(I2CPriority::NORMAL).transactions == 0);
+        CHECK(arbiter.get_stats(I2CPriority::LOW).waiting == 0);
+    }
+
+    REQUIRE(log.size() == 3);
+    auto high_pos = find(log.begin(), log.end(), 3);
+    auto low_pos = find(log.begin(), log.end(), 2);
+    CHECK(high_pos < low_pos);
+}
+
+TEST_CASE("I2CBusArbiter splits paged write at page boundaries")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t EXPECTED_FIRST_PAGE [] = {0x00, 0x0E, 0x01, 0x02};
+    const uint8_t EXPECTED_SECOND_PAGE [] = {0x00, 0x10, 0x03};
+    I2CCmdLinkFix first_cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&first_cmd_fix.dummy_handle,
+            EXPECTED_FIRST_PAGE,
+            sizeof(EXPECTED_FIRST_PAGE),
+            sizeof(EXPECTED_FIRST_PAGE),
+            true,
+            ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&first_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &first_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+    I2CCmdLinkFix second_cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&second_cmd_fix.dummy_handle,
+            EXPECTED_SECOND_PAGE,
+            sizeof(EXPECTED_SECOND_PAGE),
+            sizeof(EXPECTED_SECOND_PAGE),
+            true,
+            ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&second_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &second_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CBusArbiter arbiter(master);
+    const I2CPageLayout LAYOUT = {16, 2, chrono::milliseconds(1)};
+
+    arbiter.paged_write(I2CPriority::LOW, I2CAddress(0x50), 0x0E, {0x01, 0x02, 0x03}, LAYOUT).get();
+
+    CHECK(arbiter.get_stats(I2CPriority::LOW).transactions == 2);
+}
+
+TEST_CASE("I2CBusArbiter paged write failure is passed to future")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t EXPECTED_FIRST_PAGE [] = {0x0E, 0x01, 0x02};
+    I2CCmdLinkFix cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle,
+            EXPECTED_FIRST_PAGE,
+            sizeof(EXPECTED_FIRST_PAGE),
+            sizeof(EXPECTED_FIRST_PAGE),
+            true,
+            ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CBusArbiter arbiter(master);
+    const I2CPageLayout LAYOUT = {16, 1, chrono::milliseconds(0)};
+
+    future<void> result = arbiter.paged_write(I2CPriority::NORMAL, I2CAddress(0x50), 0x0E, {0x01, 0x02, 0x03}, LAYOUT);
+
+    CHECK_THROWS_AS(result.get(), I2CTransferException&);
+}
+
+TEST_CASE("I2CPoller with invalid arguments throws")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CPollSchedule schedule;
+
+    CHECK_THROWS_AS(schedule.add_read(nullptr, I2CAddress(0x47), 2, chrono::milliseconds(10)), I2CException&);
+    CHECK_THROWS_AS(schedule.add_read(master, I2CAddress(0x47), 0, chrono::milliseconds(10)), I2CException&);
+    CHECK_THROWS_AS(schedule.add_read(master, I2CAddress(0x47), 2, chrono::milliseconds(0)), I2CException&);
+    CHECK_THROWS_AS(I2CPoller(schedule, [](const I2CSample&) { }), I2CException&);
+
+    schedule.add_read(master, I2CAddress(0x47), 2, chrono::milliseconds(10));
+    CHECK_THROWS_AS(I2CPoller(schedule, nullptr), I2CException&);
+}
+
+TEST_CASE("I2CPoller delivers timestamped samples of each read")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    const uint8_t WRITE_DATA [] = {0x10};
+    I2CCmdLinkFix read_cmd_fix(0x47, I2C_MASTER_READ, CmdLinkAlloc::STATIC);
+    i2c_master_read_ExpectAndReturn(&read_cmd_fix.dummy_handle, nullptr, 2, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, 2);
+    i2c_master_stop_ExpectAndReturn(&read_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &read_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+    I2CCmdLinkFix transfer_cmd_fix(0x48, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&transfer_cmd_fix.dummy_handle, WRITE_DATA, 1, 1, true, ESP_OK);
+    i2c_master_start_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, 0x48 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, nullptr, 1, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_stop_ExpectAndReturn(&transfer_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &transfer_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CPollSchedule schedule;
+    // long periods, so only the first read of each entry is executed during the test
+    size_t read_id = schedule.add_read(master, I2CAddress(0x47), 2, chrono::milliseconds(100000));
+    size_t transfer_id = schedule.add_read(master, I2CAddress(0x48), {0x10}, 1, chrono::milliseconds(100000));
+
+    mutex samples_mutex;
+    condition_variable samples_changed;
+    vector<I2CSample> samples;
+    vector<vector<uint8_t> > data;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    {
+        I2CPoller poller(schedule, [&](const I2CSample &sample) {
+            lock_guard<mutex> lock(samples_mutex);
+            samples.push_back(sample);
+            data.push_back(sample.data.to_vector());
+            samples_changed.notify_all();
+        });
+        CHECK(poller.get_bus_count() == 1);
+
+        unique_lock<mutex> lock(samples_mutex);
+        samples_changed.wait_for(lock, chrono::seconds(1), [&]() { return samples.size() == 2; });
+        CHECK(poller.get_sample_count() == 2);
+        CHECK(poller.get_missed_count() == 0);
+    }
+
+    REQUIRE(samples.size() == 2);
+    CHECK(samples[0].id == read_id);
+    CHECK(samples[0].error == ESP_OK);
+    CHECK(samples[0].timestamp >= start);
+    CHECK(data[0] == vector<uint8_t>({0xAB, 0xBA}));
+    CHECK(samples[1].id == transfer_id);
+    CHECK(samples[1].error == ESP_FAIL);
+    CHECK(samples[1].timestamp >= samples[0].timestamp);
+    CHECK(data[1].empty());
+}
+
+TEST_CASE("I2CEEPROM with invalid layout throws")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+
+    CHECK_THROWS_AS(I2CEEPROM(nullptr, I2CAddress(0x50), {16, 2, chrono::milliseconds(5)}), I2CException&);
+    CHECK_THROWS_AS(I2CEEPROM(master, I2CAddress(0x50), {0, 2, chrono::milliseconds(5)}), I2CException&);
+    CHECK_THROWS_AS(I2CEEPROM(master, I2CAddress(0x50), {16, 0, chrono::milliseconds(5)}), I2CException&);
+    CHECK_THROWS_AS(I2CEEPROM(master, I2CAddress(0x50), {16, 5, chrono::milliseconds(5)}), I2CException&);
+
+    I2CEEPROM eeprom(master, I2CAddress(0x50), {16, 2, chrono::milliseconds(5)});
+    CHECK_THROWS_AS(eeprom.write(0, nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(eeprom.write(0, vector<uint8_t>()), I2CException&);
+}
+
+TEST_CASE("I2CEEPROM splits write at page boundaries and polls for acknowledge")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t EXPECTED_FIRST_PAGE [] = {0x00, 0x0E, 0x01, 0x02};
+    const uint8_t EXPECTED_SECOND_PAGE [] = {0x00, 0x10, 0x03};
+    I2CCmdLinkFix first_cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&first_cmd_fix.dummy_handle,
+            EXPECTED_FIRST_PAGE,
+            sizeof(EXPECTED_FIRST_PAGE),
+            sizeof(EXPECTED_FIRST_PAGE),
+            true,
+            ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&first_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &first_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+    // the device is still busy storing the first page
+    I2CCmdLinkFix busy_cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&busy_cmd_fix.dummy_handle,
+            EXPECTED_SECOND_PAGE,
+            sizeof(EXPECTED_SECOND_PAGE),
+            sizeof(EXPECTED_SECOND_PAGE),
+            true,
+            ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&busy_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &busy_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+    I2CCmdLinkFix second_cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&second_cmd_fix.dummy_handle,
+            EXPECTED_SECOND_PAGE,
+            sizeof(EXPECTED_SECOND_PAGE),
+            sizeof(EXPECTED_SECOND_PAGE),
+            true,
+            ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&second_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &second_cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+    // final poll until the second page is stored
+    I2CCmdLinkFix probe_cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_stop_ExpectAndReturn(&probe_cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &probe_cmd_fix.dummy_handle, 10 / portTICK_PERIOD_MS, ESP_OK);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CEEPROM eeprom(master, I2CAddress(0x50), {16, 2, chrono::milliseconds(1000)});
+
+    I2CEEPROMWriteStats stats = eeprom.write(0x0E, {0x01, 0x02, 0x03});
+
+    CHECK(stats.bytes == 3);
+    CHECK(stats.pages == 2);
+    CHECK(stats.ack_polls == 1);
+}
+
+TEST_CASE("I2CEEPROM write throws timeout if device doesn't acknowledge within write cycle time")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t EXPECTED_PAGE [] = {0x0E, 0x01};
+    I2CCmdLinkFix cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle,
+            EXPECTED_PAGE,
+            sizeof(EXPECTED_PAGE),
+            sizeof(EXPECTED_PAGE),
+            true,
+            ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CEEPROM eeprom(master, I2CAddress(0x50), {16, 1, chrono::milliseconds(0)});
+
+    try {
+        eeprom.write(0x0E, {0x01});
+        FAIL("no exception thrown");
+    } catch (const I2CTransferException &e) {
+        CHECK(e.error == ESP_ERR_TIMEOUT);
+    }
+}
+
+TEST_CASE("I2CEEPROM reads sequentially from memory address")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    const uint8_t EXPECTED_ADDR [] = {0x01, 0x20};
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+    I2CCmdLinkFix cmd_fix(0x50, I2C_MASTER_WRITE, CmdLinkAlloc::STATIC);
+    i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle,
+            EXPECTED_ADDR,
+            sizeof(EXPECTED_ADDR),
+            sizeof(EXPECTED_ADDR),
+            true,
+            ESP_OK);
+    i2c_master_start_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&cmd_fix.dummy_handle, 0x50 << 1 | I2C_MASTER_READ, true, ESP_OK);
+    i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, 2, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+    i2c_master_read_IgnoreArg_data();
+    i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, 2);
+    i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+
+    auto master = make_shared<I2CMaster>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+    I2CEEPROM eeprom(master, I2CAddress(0x50), {64, 2, chrono::milliseconds(5)});
+
+    CHECK(eeprom.read(0x120, 2) == vector<uint8_t>({0xAB, 0xBA}));
+}
+
+TEST_CASE("I2CRingBuffer with zero or too large capacity throws")
+{
+    CHECK_THROWS_AS(I2CRingBuffer(0), I2CException&);
+    CHECK_THROWS_AS(I2CRingBuffer(SIZE_MAX / 2 + 1), I2CException&);
+}
+
+TEST_CASE("I2CRingBuffer peek returns contiguous regions up to the wrap-around")
+{
+    I2CRingBuffer ring(4);
+    const uint8_t DATA [] = {1, 2, 3, 4, 5, 6};
+
+    CHECK(ring.write(DATA, 3) == 3);
+    ring.consume(2);
+    CHECK(ring.size() == 1);
+
+    // 3 bytes fit, 2 of them after the wrap-around
+    CHECK(ring.write(DATA + 3, 3) == 3);
+    CHECK(ring.size() == 4);
+    CHECK(ring.write(DATA, 1) == 0);
+
+    I2CByteView first = ring.peek();
+    REQUIRE(first.size() == 2);
+    CHECK(first[0] == 3);
+    CHECK(first[1] == 4);
+    ring.consume(first.size());
+
+    I2CByteView second = ring.peek();
+    REQUIRE(second.size() == 2);
+    CHECK(second[0] == 5);
+    CHECK(second[1] == 6);
+
+    CHECK_THROWS_AS(ring.consume(3), I2CException&);
+}
+
+TEST_CASE("I2CRingBuffer producer writes in place")
+{
+    I2CRingBuffer ring(4);
+    uint8_t read_buffer [4];
+
+    size_t free_len;
+    uint8_t *region = ring.prepare(free_len);
+    REQUIRE(free_len == 4);
+    region[0] = 0xAB;
+    region[1] = 0xBA;
+    ring.commit(2);
+    CHECK_THROWS_AS(ring.commit(3), I2CException&);
+
+    CHECK(ring.read(read_buffer, sizeof(read_buffer)) == 2);
+    CHECK(read_buffer[0] == 0xAB);
+    CHECK(read_buffer[1] == 0xBA);
+    CHECK(ring.size() == 0);
+
+    // the free region ends at the end of the buffer
+    ring.prepare(free_len);
+    CHECK(free_len == 2);
+}
+
+TEST_CASE("I2CRingBuffer keeps data and size consistent across many wrap-arounds of its positions")
+{
+    // a capacity which isn't a power of two, the positions wrap at 10
+    I2CRingBuffer ring(5);
+    uint8_t next_write = 0;
+    uint8_t next_read = 0;
+
+    for (size_t i = 0; i < 1000; i++) {
+        size_t write_len = i % 5 + 1;
+        for (size_t j = 0; j < write_len; j++) {
+            if (ring.write(&next_write, 1) == 1) {
+                next_write++;
+            }
+        }
+        CHECK(ring.size() == static_cast<uint8_t>(next_write - next_read));
+
+        // the buffer is full exactly at the wrap-around of the positions sometimes, it must not appear empty
+        size_t free_len;
+        ring.prepare(free_len);
+        CHECK(free_len <= ring.capacity() - ring.size());
+
+        size_t read_len = (i * 3) % 5 + 1;
+        for (size_t j = 0; j < read_len; j++) {
+            uint8_t byte;
+            if (ring.read(&byte, 1) == 1) {
+                REQUIRE(byte == next_read);
+                next_read++;
+            }
+        }
+    }
+}
+
+TEST_CASE("I2CRingBuffer transports data between two threads")
+{
+    I2CRingBuffer ring(7);
+    const size_t DATA_LEN = 10000;
+    vector<uint8_t> received;
+
+    thread producer([&ring]() {
+        for (size_t i = 0; i < DATA_LEN;) {
+            uint8_t byte = static_cast<uint8_t>(i);
+            if (ring.write(&byte, 1) == 1) {
+                i++;
+            }
+        }
+    });
+
+    while (received.size() < DATA_LEN) {
+        I2CByteView view = ring.peek();
+        received.insert(received.end(), view.begin(), view.end());
+        ring.consume(view.size());
+    }
+    producer.join();
+
+    for (size_t i = 0; i < DATA_LEN; i++) {
+        REQUIRE(received[i] == static_cast<uint8_t>(i));
+    }
+}
+
+#if SOC_I2C_SUPPORT_SLAVE
+TEST_CASE("I2CSlave parameter configuration fails")
+{
+    CMockFixture fix;
+    i2c_param_config_ExpectAnyArgsAndReturn(ESP_FAIL);
+
+    CHECK_THROWS_AS(I2CSlave(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), I2CAddress(0x47), 64, 64), I2CException&);
+}
+
+TEST_CASE("I2CSlave driver installation fails")
+{
+    CMockFixture fix;
+    i2c_param_config_IgnoreAndReturn(ESP_OK);
+    i2c_driver_install_IgnoreAndReturn(ESP_FAIL);
+
+    CHECK_THROWS_AS(I2CSlave (I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), I2CAddress(0x47), 64, 64), I2CException&);
+}
+
+TEST_CASE("I2CSlave calls driver functions correctly")
+{
+    CMockFixture fix;
+    I2CSlaveFix slave_fix(CreateAnd::SUCCEED);
+
+    I2CSlave slave(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), I2CAddress(0x47), 64, 64);
 }
 
 TEST_CASE("I2CSlave write fails")
@@ -459,4 +1906,102 @@ TEST_CASE("I2CSlave read calls driver functions correctly")
         CHECK(read_buffer[i] == WRITE_BUFFER[i]);
     }
 }
+/**
+ * Slave which returns scripted chunks of data instead of reading from the driver.
+ */
+class ScriptedSlave : public I2CSlave {
+public:
+    ScriptedSlave() : I2CSlave(I2CNumber::I2C0(), SCL_GPIO(3), SDA_GPIO(4), I2CAddress(0x47), 64, 64) { }
+
+    void push(vector<uint8_t> chunk)
+    {
+        lock_guard<mutex> lock(chunks_mutex);
+        chunks.push_back(std::move(chunk));
+    }
+
+    int read_raw(uint8_t *buffer, size_t buffer_len, chrono::milliseconds timeout) override
+    {
+        {
+            lock_guard<mutex> lock(chunks_mutex);
+            if (!chunks.empty()) {
+                vector<uint8_t> &chunk = chunks.front();
+                size_t len = min(buffer_len, chunk.size());
+                copy_n(chunk.begin(), len, buffer);
+                chunk.erase(chunk.begin(), chunk.begin() + len);
+                if (chunk.empty()) {
+                    chunks.pop_front();
+                }
+                return len;
+            }
+        }
+
+        this_thread::sleep_for(min(timeout, chrono::milliseconds(1)));
+        return 0;
+    }
+
+private:
+    deque<vector<uint8_t> > chunks;
+    mutex chunks_mutex;
+};
+
+TEST_CASE("I2CSlaveStream with invalid arguments throws")
+{
+    CMockFixture fix;
+    I2CSlaveFix slave_fix(CreateAnd::IGNORE);
+    I2CSlaveStreamConfig config;
+    config.buffer_size = 0;
+
+    CHECK_THROWS_AS(I2CSlaveStream(nullptr), I2CException&);
+    CHECK_THROWS_AS(I2CSlaveStream(make_shared<ScriptedSlave>(), config), I2CException&);
+}
+
+TEST_CASE("I2CSlaveStream wakes up waiting consumer")
+{
+    CMockFixture fix;
+    I2CSlaveFix slave_fix(CreateAnd::IGNORE);
+    auto slave = make_shared<ScriptedSlave>();
+    I2CSlaveStream stream(slave);
+
+    CHECK_FALSE(stream.wait(chrono::milliseconds(5)));
+
+    slave->push({0x01, 0x02, 0x03});
+    REQUIRE(stream.wait(chrono::milliseconds(1000)));
+
+    // the chunk may be delivered in several parts
+    while (stream.available() < 3) {
+        stream.wait(chrono::milliseconds(1000));
+    }
+    I2CByteView view = stream.peek();
+    REQUIRE(view.size() == 3);
+    CHECK(view.to_vector() == vector<uint8_t>({0x01, 0x02, 0x03}));
+    stream.consume(2);
+    CHECK(stream.available() == 1);
+}
+
+TEST_CASE("I2CSlaveStream calls receive callback with received data")
+{
+    CMockFixture fix;
+    I2CSlaveFix slave_fix(CreateAnd::IGNORE);
+    auto slave = make_shared<ScriptedSlave>();
+    I2CSlaveStreamConfig config;
+    config.buffer_size = 4;
+    vector<uint8_t> received;
+    promise<void> done;
+
+    I2CSlaveStream stream(slave, config, [&](I2CSlaveStream &rx_stream) {
+        uint8_t buffer[4];
+        size_t len = rx_stream.read(buffer, sizeof(buffer));
+        received.insert(received.end(), buffer, buffer + len);
+        if (received.size() == 10) {
+            done.set_value();
+        }
+    });
+
+    // more data than fits into the ring buffer at once
+    slave->push({0, 1, 2, 3, 4, 5});
+    slave->push({6, 7, 8, 9});
+
+    REQUIRE(done.get_future().wait_for(chrono::seconds(1)) == future_status::ready);
+    CHECK(received == vector<uint8_t>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
 #endif // SOC_I2C_SUPPORT_SLAVE
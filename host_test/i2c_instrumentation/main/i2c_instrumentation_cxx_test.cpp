@@ -0,0 +1,242 @@
+/*
+ * I2C C++ unit tests of the optional command link instrumentation
+ *
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ *
+ * This example code is in the Public Domain (or CC0 licensed, at your option.)
+ *
+ * Unless required by applicable law or agreed to in writing, this
+ * software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied.
+*/
+#define CATCH_CONFIG_MAIN
+#include <stdio.h>
+#include "unity.h"
+#include "freertos/portmacro.h"
+#include "driver/i2c.h"
+#include "i2c_cxx.hpp"
+#include "i2c_trace_cxx.hpp"
+#include "system_cxx.hpp"
+#include "test_fixtures.hpp"
+
+#include "catch.hpp"
+
+extern "C" {
+#include "Mocki2c.h"
+#include "Mockesp_timer.h"
+}
+
+// TODO: IDF-2693, function definition just to satisfy linker, mock esp_common instead
+const char *esp_err_to_name(esp_err_t code) {
+    return "host_test error";
+}
+
+using namespace std;
+using namespace idf;
+
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+TEST_CASE("I2CStatistics of each bus are separate")
+{
+    I2CStatistics::for_bus(I2CNumber::I2C0()).reset();
+    I2CStatistics::for_bus(I2CNumber::I2C0()).record(0x47, 1, ESP_OK, 100);
+
+    CHECK(I2CStatistics::for_bus(I2CNumber::I2C0()).get(I2CAddress(0x47)).transactions == 1);
+#if CONFIG_SOC_I2C_NUM == 2
+    I2CStatistics::for_bus(I2CNumber::I2C1()).reset();
+    CHECK(I2CStatistics::for_bus(I2CNumber::I2C1()).snapshot().empty());
+#endif
+}
+
+TEST_CASE("I2CCommandLink records executed transactions in the statistics of its bus")
+{
+    CMockFixture fix;
+    I2CStatistics::for_bus(I2CNumber::I2C0()).reset();
+    uint8_t expected_write [] = {0xAB, 0xBA};
+    const size_t WRITE_SIZE = sizeof(expected_write);
+
+    {
+        I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_WRITE);
+        i2c_master_write_ExpectWithArrayAndReturn(&cmd_fix.dummy_handle,
+                expected_write,
+                WRITE_SIZE,
+                WRITE_SIZE,
+                true,
+                ESP_OK);
+        i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+        esp_timer_get_time_ExpectAndReturn(1000);
+        i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+        esp_timer_get_time_ExpectAndReturn(1250);
+
+        I2CWrite writer({0xAB, 0xBA});
+        writer.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47));
+    }
+
+    {
+        I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ);
+        i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, 2, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+        i2c_master_read_IgnoreArg_data();
+        i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+        esp_timer_get_time_ExpectAndReturn(2000);
+        i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_FAIL);
+        esp_timer_get_time_ExpectAndReturn(2100);
+
+        I2CRead reader(2);
+        CHECK_THROWS_AS(reader.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47)), I2CTransferException&);
+    }
+
+    I2CAddressStats result = I2CStatistics::for_bus(I2CNumber::I2C0()).get(I2CAddress(0x47));
+    CHECK(result.transactions == 2);
+    CHECK(result.bytes == 4);
+    CHECK(result.nacks == 1);
+    CHECK(result.timeouts == 0);
+    CHECK(result.errors == 0);
+    CHECK(result.total_latency_us == 350);
+    CHECK(result.max_latency_us == 250);
+    CHECK(I2CStatistics::for_bus(I2CNumber::I2C0()).snapshot().size() == 1);
+}
+
+TEST_CASE("I2CCommandLink without device address isn't recorded")
+{
+    CMockFixture fix;
+    I2CStatistics::for_bus(I2CNumber::I2C0()).reset();
+    i2c_cmd_handle_t dummy_handle = reinterpret_cast<i2c_cmd_handle_t>(0xbeef);
+    uint8_t buffer[256];
+
+    i2c_cmd_link_create_static_ExpectAndReturn(buffer, sizeof(buffer), &dummy_handle);
+    i2c_master_start_ExpectAndReturn(&dummy_handle, ESP_OK);
+    i2c_master_write_byte_ExpectAndReturn(&dummy_handle, 0x47 << 1 | I2C_MASTER_WRITE, true, ESP_OK);
+    i2c_master_stop_ExpectAndReturn(&dummy_handle, ESP_OK);
+    esp_timer_get_time_ExpectAndReturn(1000);
+    i2c_master_cmd_begin_ExpectAndReturn(0, &dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+    esp_timer_get_time_ExpectAndReturn(1100);
+    i2c_cmd_link_delete_static_Expect(&dummy_handle);
+
+    I2CCommandLink cmd_link(buffer, sizeof(buffer));
+    cmd_link.start();
+    cmd_link.write_byte(0x47 << 1 | I2C_MASTER_WRITE);
+    cmd_link.stop();
+    cmd_link.execute_transfer(I2CNumber::I2C0(), chrono::milliseconds(1000));
+
+    CHECK(I2CStatistics::for_bus(I2CNumber::I2C0()).snapshot().empty());
+}
+
+TEST_CASE("I2CMaster reports and resets the statistics of its bus")
+{
+    CMockFixture fix;
+    I2CMasterFix master_fix;
+    I2CStatistics::for_bus(I2CNumber::I2C0()).reset();
+    I2CStatistics::for_bus(I2CNumber::I2C0()).record(0x47, 2, ESP_OK, 100);
+    I2CStatistics::for_bus(I2CNumber::I2C0()).record(0x48, 1, ESP_ERR_TIMEOUT, 1000);
+
+    I2CMaster master(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), Frequency(400000));
+
+    CHECK(master.get_stats(I2CAddress(0x47)).transactions == 1);
+    CHECK(master.get_stats(I2CAddress(0x48)).timeouts == 1);
+    CHECK(master.get_stats().size() == 2);
+
+    master.reset_stats();
+    CHECK(master.get_stats().empty());
+}
+#endif // CONFIG_ESP_IDF_CXX_I2C_STATS
+
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+/**
+ * Log of a 2-byte read from device 0x47 on I2C0, starting 500us after the start of the recording and taking 300us.
+ */
+static const vector<uint8_t> READ_LOG = {'I', '2', 'C', 'T', I2CTrace::FORMAT_VERSION,
+        0, 0, 0, 0, 0, 0xF4, 0x01, 0, 0, 0x2C, 0x01, 0, 0, 4, 0,
+        static_cast<uint8_t>(I2CTraceOpType::START),
+        static_cast<uint8_t>(I2CTraceOpType::WRITE), 1, 0, 0, 0, 0x47 << 1 | I2C_MASTER_READ,
+        static_cast<uint8_t>(I2CTraceOpType::READ), 2, 0, 0, 0, 0xAB, 0xBA,
+        static_cast<uint8_t>(I2CTraceOpType::STOP)};
+
+/**
+ * Stops the replay at the end of a test, also if a check has failed.
+ */
+struct ReplayGuard {
+    ReplayGuard(const vector<uint8_t> &log, I2CReplayTiming timing)
+    {
+        I2CTrace::start_replay(log, timing);
+    }
+
+    ~ReplayGuard()
+    {
+        I2CTrace::stop_replay();
+    }
+};
+
+TEST_CASE("I2CTrace with invalid arguments throws")
+{
+    vector<uint8_t> truncated_log(READ_LOG.begin(), READ_LOG.end() - 1);
+    vector<uint8_t> unknown_op_log(READ_LOG);
+    unknown_op_log.back() = 4;
+
+    CHECK_THROWS_AS(I2CTrace::start_recording(nullptr), I2CException&);
+    CHECK_THROWS_AS(I2CTrace::start_replay({}), I2CException&);
+    CHECK_THROWS_AS(I2CTrace::start_replay({'I', '2', 'C', 'T', 0}), I2CException&);
+    CHECK_THROWS_AS(I2CTrace::start_replay(truncated_log), I2CException&);
+    CHECK_THROWS_AS(I2CTrace::start_replay(unknown_op_log), I2CException&);
+    CHECK(!I2CTrace::is_replaying());
+}
+
+TEST_CASE("I2CTrace records transactions of command links")
+{
+    CMockFixture fix;
+    vector<uint8_t> log;
+    uint8_t READ_DATA [] = {0xAB, 0xBA};
+
+    esp_timer_get_time_ExpectAndReturn(1000);
+    I2CTrace::start_recording([&log](const uint8_t *data, size_t len) { log.insert(log.end(), data, data + len); });
+    CHECK(I2CTrace::is_recording());
+    CHECK_THROWS_AS(I2CTrace::start_replay(READ_LOG), I2CException&);
+
+    {
+        I2CCmdLinkFix cmd_fix(0x47, I2C_MASTER_READ);
+        i2c_master_read_ExpectAndReturn(&cmd_fix.dummy_handle, nullptr, 2, i2c_ack_type_t::I2C_MASTER_LAST_NACK, ESP_OK);
+        i2c_master_read_IgnoreArg_data();
+        i2c_master_read_ReturnArrayThruPtr_data(READ_DATA, 2);
+        i2c_master_stop_ExpectAndReturn(&cmd_fix.dummy_handle, ESP_OK);
+        esp_timer_get_time_ExpectAndReturn(1500);
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+        // the statistics take their own time stamps inside the traced ones
+        esp_timer_get_time_ExpectAndReturn(1550);
+#endif
+        i2c_master_cmd_begin_ExpectAndReturn(0, &cmd_fix.dummy_handle, 1000 / portTICK_PERIOD_MS, ESP_OK);
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+        esp_timer_get_time_ExpectAndReturn(1750);
+#endif
+        esp_timer_get_time_ExpectAndReturn(1800);
+
+        I2CRead reader(2);
+        reader.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47));
+    }
+    I2CTrace::stop_recording();
+
+    CHECK(!I2CTrace::is_recording());
+    CHECK(log == READ_LOG);
+}
+
+TEST_CASE("I2CTrace replays a log without the driver")
+{
+    CMockFixture fix;
+    ReplayGuard replay(READ_LOG, I2CReplayTiming::DURATION);
+    CHECK(I2CTrace::is_replaying());
+    CHECK(I2CTrace::replay_remaining() == 1);
+
+    // a transaction not matching the log fails and doesn't consume it
+    I2CWrite writer({0x01});
+    CHECK_THROWS_AS(writer.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47)), I2CException&);
+    CHECK(I2CTrace::replay_remaining() == 1);
+
+    I2CRead reader(2);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<uint8_t> result = reader.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47));
+    CHECK(chrono::steady_clock::now() - start >= chrono::microseconds(300));
+    CHECK(result == vector<uint8_t>({0xAB, 0xBA}));
+    CHECK(I2CTrace::replay_remaining() == 0);
+
+    CHECK_THROWS_AS(reader.do_transfer(I2CNumber::I2C0(), I2CAddress(0x47)), I2CException&);
+}
+#endif // CONFIG_ESP_IDF_CXX_I2C_TRACE
@@ -0,0 +1,357 @@
+/*
+ * I2C master bus C++ unit tests
+ *
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ *
+ * This example code is in the Public Domain (or CC0 licensed, at your option.)
+ *
+ * Unless required by applicable law or agreed to in writing, this
+ * software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied.
+*/
+#define CATCH_CONFIG_MAIN
+#include <stdio.h>
+#include "unity.h"
+#include "freertos/portmacro.h"
+#include "driver/i2c_master.h"
+#include "i2c_master_bus_cxx.hpp"
+#include "test_fixtures.hpp"
+
+#include "catch.hpp"
+
+extern "C" {
+#include "Mocki2c_master.h"
+}
+
+// TODO: IDF-2693, function definition just to satisfy linker, mock esp_common instead
+const char *esp_err_to_name(esp_err_t code) {
+    return "host_test error";
+}
+
+using namespace std;
+using namespace idf;
+
+struct I2CMasterMockFixture : public CMockFixture {
+    ~I2CMasterMockFixture()
+    {
+        Mocki2c_master_Verify();
+    }
+};
+
+struct I2CMasterBusFix : public I2CMasterMockFixture {
+    I2CMasterBusFix(size_t queue_depth = 0)
+        : bus_handle(reinterpret_cast<i2c_master_bus_handle_t>(0xbeef)), bus_config()
+    {
+        bus_config.i2c_port = 0;
+        bus_config.sda_io_num = static_cast<gpio_num_t>(2);
+        bus_config.scl_io_num = static_cast<gpio_num_t>(1);
+        bus_config.clk_source = I2C_CLK_SRC_DEFAULT;
+        bus_config.glitch_ignore_cnt = 7;
+        bus_config.trans_queue_depth = queue_depth;
+        bus_config.flags.enable_internal_pullup = true;
+        i2c_new_master_bus_ExpectAndReturn(&bus_config, nullptr, ESP_OK);
+        i2c_new_master_bus_IgnoreArg_ret_bus_handle();
+        i2c_new_master_bus_ReturnThruPtr_ret_bus_handle(&bus_handle);
+        i2c_del_master_bus_ExpectAndReturn(bus_handle, ESP_OK);
+    }
+
+    i2c_master_bus_handle_t bus_handle;
+    i2c_master_bus_config_t bus_config;
+};
+
+static void *g_i2c_dev_fixture = nullptr;
+
+/**
+ * Expects a device with address 0x47 at 400kHz to be added and removed. On an asynchronous bus, the registered
+ * callbacks are stored, so the test can call them like the I2C interrupt.
+ */
+struct I2CMasterDevFix {
+    I2CMasterDevFix(i2c_master_bus_handle_t bus_handle, bool async = false)
+        : dev_handle(reinterpret_cast<i2c_master_dev_handle_t>(0xcafe)), dev_config(), callbacks(), user_data()
+    {
+        dev_config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+        dev_config.device_address = 0x47;
+        dev_config.scl_speed_hz = 400000;
+        i2c_master_bus_add_device_ExpectAndReturn(bus_handle, &dev_config, nullptr, ESP_OK);
+        i2c_master_bus_add_device_IgnoreArg_ret_handle();
+        i2c_master_bus_add_device_ReturnThruPtr_ret_handle(&dev_handle);
+        if (async) {
+            i2c_master_register_event_callbacks_AddCallback(register_cb);
+            i2c_master_register_event_callbacks_ExpectAnyArgsAndReturn(ESP_OK);
+        }
+        i2c_master_bus_rm_device_ExpectAndReturn(dev_handle, ESP_OK);
+
+        g_i2c_dev_fixture = this;
+    }
+
+    ~I2CMasterDevFix()
+    {
+        i2c_master_register_event_callbacks_AddCallback(nullptr);
+        g_i2c_dev_fixture = nullptr;
+    }
+
+    /**
+     * Signal \c event like the I2C interrupt.
+     */
+    bool interrupt(i2c_master_event_t event)
+    {
+        i2c_master_event_data_t event_data = {};
+        event_data.event = event;
+        return callbacks.on_trans_done(dev_handle, &event_data, user_data);
+    }
+
+    static esp_err_t register_cb(i2c_master_dev_handle_t i2c_dev,
+            const i2c_master_event_callbacks_t *cbs,
+            void *user_data,
+            int cmock_num_calls)
+    {
+        I2CMasterDevFix *fix = static_cast<I2CMasterDevFix*>(g_i2c_dev_fixture);
+        fix->callbacks = *cbs;
+        fix->user_data = user_data;
+        return ESP_OK;
+    }
+
+    i2c_master_dev_handle_t dev_handle;
+    i2c_device_config_t dev_config;
+    i2c_master_event_callbacks_t callbacks;
+    void *user_data;
+};
+
+/**
+ * Records the calls of an \c I2CDoneCallback.
+ */
+struct DoneRecorder {
+    static bool on_done(esp_err_t result, void *user_data)
+    {
+        DoneRecorder *recorder = static_cast<DoneRecorder*>(user_data);
+        recorder->calls++;
+        recorder->result = result;
+        return true;
+    }
+
+    int calls = 0;
+    esp_err_t result = ESP_ERR_INVALID_STATE;
+};
+
+TEST_CASE("I2CMasterBus creation failure throws")
+{
+    I2CMasterMockFixture fix;
+    i2c_new_master_bus_ExpectAnyArgsAndReturn(ESP_ERR_INVALID_ARG);
+
+    CHECK_THROWS_AS(I2CMasterBus(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2)), I2CException&);
+}
+
+TEST_CASE("I2CMasterBus creates and deletes bus driver")
+{
+    I2CMasterBusFix fix(4);
+
+    I2CMasterBus bus(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), 4);
+    CHECK(bus.is_async());
+    CHECK(bus.get_queue_depth() == 4);
+}
+
+TEST_CASE("I2CMasterBus probe reports acknowledging devices")
+{
+    I2CMasterBusFix fix;
+    i2c_master_probe_ExpectAndReturn(fix.bus_handle, 0x47, 1000, ESP_OK);
+    i2c_master_probe_ExpectAndReturn(fix.bus_handle, 0x48, 1000, ESP_ERR_NOT_FOUND);
+    i2c_master_probe_ExpectAndReturn(fix.bus_handle, 0x49, 1000, ESP_ERR_TIMEOUT);
+
+    I2CMasterBus bus(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2));
+    CHECK(bus.probe(I2CAddress(0x47)));
+    CHECK(!bus.probe(I2CAddress(0x48)));
+    CHECK_THROWS_AS(bus.probe(I2CAddress(0x49)), I2CTransferException&);
+}
+
+TEST_CASE("I2CMasterDevice with empty bus throws")
+{
+    CHECK_THROWS_AS(I2CMasterDevice(shared_ptr<I2CMasterBus>(), I2CAddress(0x47), Frequency(400000)),
+            I2CException&);
+}
+
+TEST_CASE("I2CMasterDevice synchronous transfers with invalid arguments throw")
+{
+    I2CMasterBusFix fix;
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2));
+    I2CMasterDevFix dev_fix(fix.bus_handle);
+    uint8_t data [] = {0x01};
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    CHECK_THROWS_AS(dev.sync_write(nullptr, 1), I2CException&);
+    CHECK_THROWS_AS(dev.sync_write(vector<uint8_t>()), I2CException&);
+    CHECK_THROWS_AS(dev.sync_read(0), I2CException&);
+    CHECK_THROWS_AS(dev.sync_transfer(data, 1, nullptr, 1), I2CException&);
+}
+
+TEST_CASE("I2CMasterDevice synchronous transfers call driver correctly")
+{
+    I2CMasterBusFix fix;
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2));
+    I2CMasterDevFix dev_fix(fix.bus_handle);
+    uint8_t WRITE_DATA [] = {0xAB, 0xBA};
+    uint8_t READ_DATA [] = {0xCD, 0xDC};
+
+    i2c_master_transmit_ExpectWithArrayAndReturn(dev_fix.dev_handle, WRITE_DATA, 2, 2, 1000, ESP_OK);
+    i2c_master_receive_ExpectAndReturn(dev_fix.dev_handle, nullptr, 2, 1000, ESP_OK);
+    i2c_master_receive_IgnoreArg_read_buffer();
+    i2c_master_receive_ReturnArrayThruPtr_read_buffer(READ_DATA, 2);
+    i2c_master_transmit_receive_ExpectWithArrayAndReturn(dev_fix.dev_handle, WRITE_DATA, 1, 1, nullptr, 0, 2, 1000, ESP_OK);
+    i2c_master_transmit_receive_IgnoreArg_read_buffer();
+    i2c_master_transmit_receive_ReturnArrayThruPtr_read_buffer(READ_DATA, 2);
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    dev.sync_write({0xAB, 0xBA});
+    CHECK(dev.sync_read(2) == vector<uint8_t>({0xCD, 0xDC}));
+    CHECK(dev.sync_transfer({0xAB}, 2) == vector<uint8_t>({0xCD, 0xDC}));
+}
+
+TEST_CASE("I2CMasterDevice synchronous transfer failure throws transfer exception")
+{
+    I2CMasterBusFix fix;
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2));
+    I2CMasterDevFix dev_fix(fix.bus_handle);
+    i2c_master_transmit_ExpectAnyArgsAndReturn(ESP_ERR_TIMEOUT);
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    CHECK_THROWS_AS(dev.sync_write({0xAB}), I2CTransferException&);
+}
+
+TEST_CASE("I2CMasterDevice asynchronous transfer on synchronous bus throws")
+{
+    I2CMasterBusFix fix;
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2));
+    I2CMasterDevFix dev_fix(fix.bus_handle);
+    uint8_t data [] = {0x01};
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    CHECK_THROWS_AS(dev.async_write(data, 1), I2CException&);
+    CHECK(dev.pending() == 0);
+}
+
+TEST_CASE("I2CMasterDevice asynchronous transfers complete from interrupt")
+{
+    I2CMasterBusFix fix(2);
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), 2);
+    I2CMasterDevFix dev_fix(fix.bus_handle, true);
+    uint8_t write_data [] = {0xAB};
+    uint8_t read_buffer [2] = {};
+    DoneRecorder write_done;
+    DoneRecorder read_done;
+
+    i2c_master_transmit_ExpectWithArrayAndReturn(dev_fix.dev_handle, write_data, 1, 1, 1000, ESP_OK);
+    i2c_master_receive_ExpectAndReturn(dev_fix.dev_handle, read_buffer, 2, 1000, ESP_OK);
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    REQUIRE(dev_fix.user_data == &dev);
+
+    dev.async_write(write_data, 1, DoneRecorder::on_done, &write_done);
+    dev.async_read(read_buffer, 2, DoneRecorder::on_done, &read_done);
+    CHECK(dev.pending() == 2);
+
+    // the queue depth of the bus is reached
+    CHECK_THROWS_AS(dev.async_write(write_data, 1), I2CException&);
+
+    CHECK(!dev_fix.interrupt(I2C_EVENT_ALIVE));
+    CHECK(write_done.calls == 0);
+
+    CHECK(dev_fix.interrupt(I2C_EVENT_DONE));
+    CHECK(write_done.calls == 1);
+    CHECK(write_done.result == ESP_OK);
+    CHECK(read_done.calls == 0);
+    CHECK(dev.pending() == 1);
+
+    CHECK(dev_fix.interrupt(I2C_EVENT_NACK));
+    CHECK(read_done.calls == 1);
+    CHECK(read_done.result == ESP_FAIL);
+    CHECK(dev.pending() == 0);
+}
+
+TEST_CASE("I2CMasterDevice completes asynchronous transfers in order across wrap-arounds of the ring")
+{
+    const size_t QUEUE_DEPTH = 3;
+    const size_t TRANSFERS = 7 * QUEUE_DEPTH;
+    I2CMasterBusFix fix(QUEUE_DEPTH);
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(),
+            SCL_GPIO(1),
+            SDA_GPIO(2),
+            QUEUE_DEPTH);
+    I2CMasterDevFix dev_fix(fix.bus_handle, true);
+    uint8_t data [] = {0xAB};
+    vector<DoneRecorder> done(TRANSFERS);
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+
+    // two transfers stay pending, so the positions pass the end of the ring while it's partly filled
+    for (size_t i = 0; i < TRANSFERS; i++) {
+        i2c_master_transmit_ExpectAnyArgsAndReturn(ESP_OK);
+        dev.async_write(data, 1, DoneRecorder::on_done, &done[i]);
+        if (i < 2) {
+            continue;
+        }
+
+        CHECK(dev.pending() == QUEUE_DEPTH);
+        CHECK_THROWS_AS(dev.async_write(data, 1), I2CException&);
+
+        size_t oldest = i - 2;
+        CHECK(dev_fix.interrupt(oldest % 2 ? I2C_EVENT_NACK : I2C_EVENT_DONE));
+        CHECK(done[oldest].calls == 1);
+        CHECK(done[oldest].result == (oldest % 2 ? ESP_FAIL : ESP_OK));
+        CHECK(done[oldest + 1].calls == 0);
+        CHECK(dev.pending() == 2);
+    }
+
+    CHECK(dev_fix.interrupt(I2C_EVENT_DONE));
+    CHECK(dev_fix.interrupt(I2C_EVENT_DONE));
+    CHECK(done[TRANSFERS - 1].calls == 1);
+    CHECK(dev.pending() == 0);
+}
+
+TEST_CASE("I2CMasterDevice failing to queue transfer throws and doesn't leave it pending")
+{
+    I2CMasterBusFix fix(2);
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), 2);
+    I2CMasterDevFix dev_fix(fix.bus_handle, true);
+    uint8_t data [] = {0xAB};
+    i2c_master_transmit_ExpectAnyArgsAndReturn(ESP_ERR_INVALID_STATE);
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    CHECK_THROWS_AS(dev.async_write(data, 1), I2CTransferException&);
+    CHECK(dev.pending() == 0);
+}
+
+static esp_err_t nack_on_wait_cb(i2c_master_bus_handle_t bus_handle, int timeout_ms, int cmock_num_calls)
+{
+    static_cast<I2CMasterDevFix*>(g_i2c_dev_fixture)->interrupt(I2C_EVENT_NACK);
+    return ESP_OK;
+}
+
+TEST_CASE("I2CMasterDevice synchronous transfer on asynchronous bus waits for completion")
+{
+    I2CMasterBusFix fix(2);
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), 2);
+    I2CMasterDevFix dev_fix(fix.bus_handle, true);
+    i2c_master_transmit_ExpectAnyArgsAndReturn(ESP_OK);
+    i2c_master_bus_wait_all_done_AddCallback(nack_on_wait_cb);
+    i2c_master_bus_wait_all_done_ExpectAndReturn(fix.bus_handle, -1, ESP_OK);
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    CHECK_THROWS_AS(dev.sync_write({0xAB}), I2CTransferException&);
+    CHECK(dev.pending() == 0);
+
+    i2c_master_bus_wait_all_done_AddCallback(nullptr);
+}
+
+TEST_CASE("I2CMasterDevice destructor waits for pending transfers")
+{
+    I2CMasterBusFix fix(2);
+    shared_ptr<I2CMasterBus> bus = make_shared<I2CMasterBus>(I2CNumber::I2C0(), SCL_GPIO(1), SDA_GPIO(2), 2);
+    I2CMasterDevFix dev_fix(fix.bus_handle, true);
+    uint8_t data [] = {0xAB};
+    i2c_master_transmit_ExpectAnyArgsAndReturn(ESP_OK);
+    i2c_master_bus_wait_all_done_ExpectAndReturn(fix.bus_handle, -1, ESP_OK);
+
+    I2CMasterDevice dev(bus, I2CAddress(0x47), Frequency(400000));
+    dev.async_write(data, 1);
+}
@@ -14,6 +14,8 @@
 
 #define CATCH_CONFIG_MAIN
 #include <stdio.h>
+#include <algorithm>
+#include <thread>
 #include "freertos/portmacro.h"
 #include "spi_host_cxx.hpp"
 #include "spi_host_private_cxx.hpp"
@@ -30,6 +32,51 @@ const char *esp_err_to_name(esp_err_t code) {
 using namespace std;
 using namespace idf;
 
+/**
+ * Number of calls to the global operator new while counting is enabled by an AllocationCounter.
+ */
+static size_t g_allocations = 0;
+static bool g_count_allocations = false;
+
+void *operator new(size_t size)
+{
+    if (g_count_allocations) {
+        g_allocations++;
+    }
+
+    void *memory = malloc(size);
+    if (!memory) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+/**
+ * Counts the heap allocations done through operator new during its lifetime.
+ */
+struct AllocationCounter {
+    AllocationCounter()
+    {
+        g_allocations = 0;
+        g_count_allocations = true;
+    }
+
+    ~AllocationCounter()
+    {
+        g_count_allocations = false;
+    }
+
+    size_t count()
+    {
+        return g_allocations;
+    }
+};
+
 TEST_CASE("SPITransferSize basic construction")
 {
     SPITransferSize transfer_size_0(0);
@@ -255,6 +302,40 @@ TEST_CASE("SPI transaction future")
     CHECK(0xA6 == out_data[0]);
 }
 
+TEST_CASE("SPI transaction with caller-owned buffers nullptr or empty throws")
+{
+    uint8_t buffer [] = {47};
+
+    CHECK_THROWS_AS(SPITransactionDescriptor transaction(nullptr, buffer, 1, reinterpret_cast<SPIDeviceHandle*>(4747)),
+            SPIException&);
+    CHECK_THROWS_AS(SPITransactionDescriptor transaction(buffer, nullptr, 1, reinterpret_cast<SPIDeviceHandle*>(4747)),
+            SPIException&);
+    CHECK_THROWS_AS(SPITransactionDescriptor transaction(buffer, buffer, 0, reinterpret_cast<SPIDeviceHandle*>(4747)),
+            SPIException&);
+    CHECK_THROWS_AS(SPITransactionDescriptor transaction(buffer, buffer, 1, nullptr), SPIException&);
+}
+
+TEST_CASE("SPI transaction future with caller-owned buffers")
+{
+    CMockFixture cmock_fix;
+    SPITransactionDescriptorFix trans_fix(2, true);
+    trans_fix.rx_data = {0xA6, 0xA7};
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    const uint8_t tx_buffer [] = {47, 48};
+    uint8_t rx_buffer [2] = {};
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(10));
+    auto result = dev.transfer(tx_buffer, rx_buffer, sizeof(tx_buffer));
+    result.wait();
+
+    CHECK(2 * 8 == trans_fix.orig_trans->length);
+    CHECK(tx_buffer == trans_fix.orig_trans->tx_buffer);
+    CHECK(rx_buffer == trans_fix.orig_trans->rx_buffer);
+    CHECK(0xA6 == rx_buffer[0]);
+    CHECK(0xA7 == rx_buffer[1]);
+    CHECK(result.get().empty());
+}
+
 TEST_CASE("SPI transaction with pre_callback")
 {
     CMockFixture cmock_fix;
@@ -382,6 +463,662 @@ TEST_CASE("SPI two transactions")
     CHECK(true == pre_cb_called);
 }
 
+TEST_CASE("SPIDevice with queue size 0 throws")
+{
+    CMockFixture cmock_fix;
+    CHECK_THROWS_AS(SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(0)), SPIException&);
+}
+
+TEST_CASE("Master build device with queue depth")
+{
+    SPIFix fix;
+    SPIDevFix dev_fix(CreateAnd::SUCCEED);
+
+    SPIMaster master(SPINum(SPI2_HOST),
+            MOSI(fix.bus_config.mosi_io_num),
+            MISO(fix.bus_config.miso_io_num),
+            SCLK(fix.bus_config.sclk_io_num));
+
+    master.create_dev(CS(4), Frequency::MHz(1), QueueSize(3));
+
+    CHECK(dev_fix.dev_config.queue_size == 3);
+}
+
+TEST_CASE("SPI pipelined transfers are queued while earlier ones are in flight")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(2);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(2));
+    auto first = dev.transfer({47});
+    auto second = dev.transfer({48, 49});
+
+    CHECK(queue_fix.queued.size() == 2);
+
+    // finishes the first transfer as well
+    vector<uint8_t> second_data = second.get();
+    CHECK(queue_fix.queued.empty());
+    vector<uint8_t> first_data = first.get();
+
+    CHECK(first_data == vector<uint8_t>({47}));
+    CHECK(second_data == vector<uint8_t>({48, 49}));
+}
+
+TEST_CASE("SPI transfer with full queue waits for oldest transfer")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(2, 2);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1));
+    auto first = dev.transfer({47});
+    auto second = dev.transfer({48});
+
+    CHECK(queue_fix.queued.size() == 1);
+    CHECK(first.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready);
+    CHECK(first.get() == vector<uint8_t>({47}));
+    CHECK(second.get() == vector<uint8_t>({48}));
+}
+
+static TickType_t g_second_fetch_ticks;
+
+/**
+ * The fetch of the first transaction takes 20ms, the fetch of the second one times out.
+ */
+static esp_err_t slow_fetch_then_timeout_cb(spi_device_handle_t handle,
+        spi_transaction_t** trans_desc,
+        TickType_t ticks_to_wait,
+        int cmock_num_calls)
+{
+    if (cmock_num_calls == 0) {
+        this_thread::sleep_for(chrono::milliseconds(20));
+    } else if (cmock_num_calls == 1) {
+        g_second_fetch_ticks = ticks_to_wait;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return SPIQueueFix::get_trans_result_cb(handle, trans_desc, ticks_to_wait, cmock_num_calls);
+}
+
+TEST_CASE("SPIFuture wait_for of pipelined transfer shares the timeout with earlier transfers")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(2);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    spi_device_get_trans_result_AddCallback(slow_fetch_then_timeout_cb);
+    spi_device_get_trans_result_ExpectAnyArgsAndReturn(ESP_OK);
+    g_second_fetch_ticks = portMAX_DELAY;
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(2));
+    auto first = dev.transfer({47});
+    auto second = dev.transfer({48});
+
+    // the first transfer has used up the timeout
+    CHECK(second.wait_for(std::chrono::milliseconds(20)) == std::future_status::timeout);
+    CHECK(g_second_fetch_ticks == 0);
+    CHECK(first.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready);
+
+    CHECK(second.get() == vector<uint8_t>({48}));
+}
+
+TEST_CASE("SPI transfer reuses the transaction of a consumed future")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(2, 2);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1));
+    CHECK(dev.transfer({47, 48}).get() == vector<uint8_t>({47, 48}));
+    CHECK(dev.transfer({49, 50}).get() == vector<uint8_t>({49, 50}));
+
+    REQUIRE(queue_fix.started.size() == 2);
+    CHECK(queue_fix.started[0] == queue_fix.started[1]);
+}
+
+TEST_CASE("SPI transfers on a recycled transaction don't allocate")
+{
+    CMockFixture cmock_fix;
+    const size_t TRANSFERS = 5;
+    SPIQueueFix queue_fix(TRANSFERS, TRANSFERS);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    queue_fix.started.reserve(TRANSFERS);
+    uint8_t tx_buffer [4] = {0x01, 0x02, 0x03, 0x04};
+    uint8_t rx_buffer [4] = {};
+    const vector<uint8_t> data = {47, 48, 49, 50};
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1));
+
+    // sizes the buffers of the transaction
+    CHECK(dev.transfer(data).get() == data);
+
+    AllocationCounter allocations;
+    dev.transfer(tx_buffer, rx_buffer, sizeof(tx_buffer)).get();
+    dev.read(rx_buffer, sizeof(rx_buffer)).get();
+    dev.write(tx_buffer, sizeof(tx_buffer)).get();
+    size_t caller_owned_allocations = allocations.count();
+
+    // only the result is allocated
+    vector<uint8_t> result = dev.transfer(data).get();
+    size_t vector_allocations = allocations.count() - caller_owned_allocations;
+
+    CHECK(caller_owned_allocations == 0);
+    CHECK(vector_allocations == 1);
+    CHECK(result == data);
+    REQUIRE(queue_fix.started.size() == TRANSFERS);
+    CHECK(count(queue_fix.started.begin(), queue_fix.started.end(), queue_fix.started[0]) == TRANSFERS);
+}
+
+TEST_CASE("SPI transfer doesn't reuse the transaction of a held future")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(2, 2);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1));
+    auto first = dev.transfer({47});
+    first.wait();
+    auto second = dev.transfer({48});
+
+    REQUIRE(queue_fix.started.size() == 2);
+    CHECK(queue_fix.started[0] != queue_fix.started[1]);
+    CHECK(first.get() == vector<uint8_t>({47}));
+    CHECK(second.get() == vector<uint8_t>({48}));
+}
+
+TEST_CASE("Master build device with command, address and dummy phases")
+{
+    SPIFix fix;
+    SPIDevFix dev_fix(CreateAnd::SUCCEED);
+
+    SPIMaster master(SPINum(SPI2_HOST),
+            MOSI(fix.bus_config.mosi_io_num),
+            MISO(fix.bus_config.miso_io_num),
+            SCLK(fix.bus_config.sclk_io_num));
+
+    SPIDeviceConfig config;
+    config.phase_bits.command_bits = 8;
+    config.phase_bits.address_bits = 24;
+    config.phase_bits.dummy_bits = 8;
+    master.create_dev(CS(4), Frequency::MHz(1), QueueSize(1u), config);
+
+    CHECK(dev_fix.dev_config.command_bits == 8);
+    CHECK(dev_fix.dev_config.address_bits == 24);
+    CHECK(dev_fix.dev_config.dummy_bits == 8);
+}
+
+TEST_CASE("SPIDevice with phases out of range throws")
+{
+    CMockFixture cmock_fix;
+    SPIDeviceConfig config;
+
+    SECTION("command") {
+        config.phase_bits.command_bits = 17;
+    }
+
+    SECTION("address") {
+        config.phase_bits.address_bits = 65;
+    }
+
+    CHECK_THROWS_AS(SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1u), config),
+            SPIException&);
+}
+
+TEST_CASE("SPI transfer with command and address")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.transfer(0x0B, 0x123456, {47, 48});
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_t *trans_desc = queue_fix.started[0];
+    CHECK(trans_desc->cmd == 0x0B);
+    CHECK(trans_desc->addr == 0x123456);
+    CHECK(trans_desc->flags == 0);
+    CHECK(trans_desc->length == 16);
+    CHECK(result.get() == vector<uint8_t>({47, 48}));
+}
+
+TEST_CASE("SPI transfer with command only has no data phase")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.transfer(0x06, 0, {});
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_t *trans_desc = queue_fix.started[0];
+    CHECK(trans_desc->cmd == 0x06);
+    CHECK(trans_desc->length == 0);
+    CHECK(trans_desc->tx_buffer == nullptr);
+    CHECK(trans_desc->rx_buffer == nullptr);
+    CHECK(result.get().empty());
+}
+
+TEST_CASE("SPI transfer with variable phase lengths")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIPhaseBits phase_bits;
+    phase_bits.command_bits = 8;
+    phase_bits.address_bits = 32;
+    phase_bits.dummy_bits = 6;
+    SPIFuture result = dev.transfer(phase_bits, 0xEC, 0x1000, {47});
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_ext_t *trans_desc = reinterpret_cast<spi_transaction_ext_t*>(queue_fix.started[0]);
+    CHECK(trans_desc->base.flags == (SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_VARIABLE_DUMMY));
+    CHECK(trans_desc->base.cmd == 0xEC);
+    CHECK(trans_desc->base.addr == 0x1000);
+    CHECK(trans_desc->command_bits == 8);
+    CHECK(trans_desc->address_bits == 32);
+    CHECK(trans_desc->dummy_bits == 6);
+    CHECK(result.get() == vector<uint8_t>({47}));
+}
+
+TEST_CASE("SPI transfer with variable phase lengths out of range throws")
+{
+    CMockFixture cmock_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIPhaseBits phase_bits;
+    phase_bits.command_bits = 17;
+
+    CHECK_THROWS_AS(dev.transfer(phase_bits, 0xEC, 0x1000, {47}), SPITransferException&);
+}
+
+TEST_CASE("Master build half-duplex device")
+{
+    SPIFix fix;
+    SPIDevFix dev_fix(CreateAnd::SUCCEED);
+
+    SPIMaster master(SPINum(SPI2_HOST),
+            MOSI(fix.bus_config.mosi_io_num),
+            MISO(fix.bus_config.miso_io_num),
+            SCLK(fix.bus_config.sclk_io_num));
+
+    SPIDeviceConfig config;
+    config.half_duplex = true;
+    master.create_dev(CS(4), Frequency::MHz(1), QueueSize(1u), config);
+
+    CHECK(dev_fix.dev_config.flags == SPI_DEVICE_HALFDUPLEX);
+}
+
+TEST_CASE("SPIDevice with multi-line mode on full-duplex device throws")
+{
+    CMockFixture cmock_fix;
+    SPIDeviceConfig config;
+    config.line_mode = SPILineMode::QIO;
+
+    CHECK_THROWS_AS(SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1u), config),
+            SPIException&);
+}
+
+TEST_CASE("SPI transfer uses line mode of device")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    SPIDeviceConfig config;
+    config.half_duplex = true;
+    uint32_t expected_flags = 0;
+
+    SECTION("dual") {
+        config.line_mode = SPILineMode::DUAL;
+        expected_flags = SPI_TRANS_MODE_DIO;
+    }
+
+    SECTION("dual I/O") {
+        config.line_mode = SPILineMode::DIO;
+        expected_flags = SPI_TRANS_MODE_DIO | SPI_TRANS_MULTILINE_ADDR;
+    }
+
+    SECTION("quad") {
+        config.line_mode = SPILineMode::QUAD;
+        expected_flags = SPI_TRANS_MODE_QIO;
+    }
+
+    SECTION("quad I/O") {
+        config.line_mode = SPILineMode::QIO;
+        expected_flags = SPI_TRANS_MODE_QIO | SPI_TRANS_MULTILINE_ADDR;
+    }
+
+    SECTION("QPI") {
+        config.line_mode = SPILineMode::QPI;
+        expected_flags = SPI_TRANS_MODE_QIO | SPI_TRANS_MULTILINE_ADDR | SPI_TRANS_MULTILINE_CMD;
+    }
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1u), config);
+    SPIFuture result = dev.transfer(0x32, 0x1000, {47});
+
+    REQUIRE(queue_fix.started.size() == 1);
+    CHECK(queue_fix.started[0]->flags == expected_flags);
+    CHECK(result.get() == vector<uint8_t>({47}));
+}
+
+TEST_CASE("SPI read receives without sending")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.read(0x03, 0x1000, 3);
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_t *trans_desc = queue_fix.started[0];
+    CHECK(trans_desc->cmd == 0x03);
+    CHECK(trans_desc->addr == 0x1000);
+    CHECK(trans_desc->tx_buffer == nullptr);
+    CHECK(trans_desc->rxlength == 24);
+    CHECK(result.get() == vector<uint8_t>({0, 1, 2}));
+}
+
+TEST_CASE("SPI read with line mode and phase lengths of the transfer")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    SPIDeviceConfig config;
+    config.half_duplex = true;
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1u), config);
+    SPIPhaseBits phase_bits;
+    phase_bits.command_bits = 8;
+    phase_bits.address_bits = 24;
+    phase_bits.dummy_bits = 8;
+    SPIFuture result = dev.read(SPILineMode::QUAD, phase_bits, 0x6B, 0x1000, 4);
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_ext_t *trans_desc = reinterpret_cast<spi_transaction_ext_t*>(queue_fix.started[0]);
+    CHECK(trans_desc->base.flags
+            == (SPI_TRANS_MODE_QIO | SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_VARIABLE_DUMMY));
+    CHECK(trans_desc->dummy_bits == 8);
+    CHECK(result.get() == vector<uint8_t>({0, 1, 2, 3}));
+}
+
+TEST_CASE("SPI read with invalid arguments throws")
+{
+    CMockFixture cmock_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+
+    CHECK_THROWS_AS(dev.read(0x03, 0x1000, 0), SPITransferException&);
+    CHECK_THROWS_AS(dev.read(SPILineMode::QIO, SPIPhaseBits(), 0xEB, 0x1000, 4), SPITransferException&);
+    CHECK_THROWS_AS(dev.transfer(SPILineMode::DUAL, SPIPhaseBits(), 0x3B, 0x1000, {47}), SPITransferException&);
+}
+
+TEST_CASE("SPI read without command receives only")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.read(3);
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_t *trans_desc = queue_fix.started[0];
+    CHECK(trans_desc->tx_buffer == nullptr);
+    CHECK(trans_desc->rx_buffer != nullptr);
+    CHECK(trans_desc->rxlength == 24);
+    CHECK(result.get() == vector<uint8_t>({0, 1, 2}));
+}
+
+TEST_CASE("SPI read into caller-owned buffer")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    uint8_t rx_buffer[4] = {};
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.read(rx_buffer, sizeof(rx_buffer));
+
+    REQUIRE(queue_fix.started.size() == 1);
+    CHECK(queue_fix.started[0]->tx_buffer == nullptr);
+    CHECK(queue_fix.started[0]->rx_buffer == rx_buffer);
+    CHECK(result.get().empty());
+    CHECK(vector<uint8_t>(rx_buffer, rx_buffer + 4) == vector<uint8_t>({0, 1, 2, 3}));
+}
+
+TEST_CASE("SPI write sends only")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.write({47, 48});
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_t *trans_desc = queue_fix.started[0];
+    const uint8_t *tx_data = static_cast<const uint8_t*>(trans_desc->tx_buffer);
+    CHECK(trans_desc->rx_buffer == nullptr);
+    CHECK(trans_desc->rxlength == 0);
+    CHECK(trans_desc->length == 16);
+    CHECK(vector<uint8_t>(tx_data, tx_data + 2) == vector<uint8_t>({47, 48}));
+    CHECK(result.get().empty());
+}
+
+TEST_CASE("SPI write from caller-owned buffer")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    const uint8_t tx_buffer[2] = {47, 48};
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.write(tx_buffer, sizeof(tx_buffer));
+
+    REQUIRE(queue_fix.started.size() == 1);
+    CHECK(queue_fix.started[0]->tx_buffer == tx_buffer);
+    CHECK(queue_fix.started[0]->rx_buffer == nullptr);
+    CHECK(result.get().empty());
+}
+
+TEST_CASE("SPI write with command and address")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture result = dev.write(0x02, 0x1000, {47});
+
+    REQUIRE(queue_fix.started.size() == 1);
+    spi_transaction_t *trans_desc = queue_fix.started[0];
+    CHECK(trans_desc->cmd == 0x02);
+    CHECK(trans_desc->addr == 0x1000);
+    CHECK(trans_desc->rx_buffer == nullptr);
+    CHECK(result.get().empty());
+}
+
+TEST_CASE("SPI write on recycled transaction doesn't return old data")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(2, 2);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    CHECK(dev.transfer({47}).get() == vector<uint8_t>({47}));
+    CHECK(dev.write({48}).get().empty());
+}
+
+TEST_CASE("SPI read and write with empty data or nullptr throw")
+{
+    CMockFixture cmock_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    uint8_t buffer[4] = {};
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+
+    CHECK_THROWS_AS(dev.read(0), SPITransferException&);
+    CHECK_THROWS_AS(dev.read(nullptr, 4), SPITransferException&);
+    CHECK_THROWS_AS(dev.read(buffer, 0), SPITransferException&);
+    CHECK_THROWS_AS(dev.write(vector<uint8_t>()), SPITransferException&);
+    CHECK_THROWS_AS(dev.write(nullptr, 4), SPITransferException&);
+    CHECK_THROWS_AS(dev.write(buffer, 0), SPITransferException&);
+}
+
+TEST_CASE("SPI polling transfer with empty data or nullptr throws")
+{
+    CMockFixture cmock_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    uint8_t buffer [] = {47};
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1));
+
+    CHECK_THROWS_AS(dev.polling_transfer({}), SPITransferException&);
+    CHECK_THROWS_AS(dev.polling_transfer(nullptr, buffer, 1), SPITransferException&);
+    CHECK_THROWS_AS(dev.polling_transfer(buffer, nullptr, 1), SPITransferException&);
+    CHECK_THROWS_AS(dev.polling_transfer(buffer, buffer, 0), SPITransferException&);
+}
+
+TEST_CASE("SPI polling transfer of up to 4 bytes uses transaction data")
+{
+    CMockFixture cmock_fix;
+    SPIPollingFix polling_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1));
+    vector<uint8_t> result = dev.polling_transfer({47, 48, 49, 50});
+
+    CHECK(polling_fix.flags == (SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA));
+    CHECK(polling_fix.length == 4 * 8);
+    CHECK(result == vector<uint8_t>({47, 48, 49, 50}));
+}
+
+TEST_CASE("SPI polling transfer of more than 4 bytes uses buffers")
+{
+    CMockFixture cmock_fix;
+    SPIPollingFix polling_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    const uint8_t tx_buffer [] = {47, 48, 49, 50, 51};
+    uint8_t rx_buffer [5] = {};
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1));
+    dev.polling_transfer(tx_buffer, rx_buffer, sizeof(tx_buffer));
+
+    CHECK(polling_fix.flags == 0);
+    CHECK(polling_fix.length == 5 * 8);
+    CHECK(equal(tx_buffer, tx_buffer + sizeof(tx_buffer), rx_buffer));
+}
+
+TEST_CASE("SPI polling transfer uses line mode of device")
+{
+    CMockFixture cmock_fix;
+    SPIPollingFix polling_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    SPIDeviceConfig config;
+    config.half_duplex = true;
+    config.line_mode = SPILineMode::DUAL;
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(1u), config);
+
+    CHECK(dev.polling_transfer({47, 48}) == vector<uint8_t>({47, 48}));
+    CHECK(polling_fix.flags == (SPI_TRANS_MODE_DIO | SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA));
+}
+
+TEST_CASE("SPI polling transfer finishes queued transfers first")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIPollingFix polling_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(2));
+    auto queued = dev.transfer({47});
+    vector<uint8_t> polled = dev.polling_transfer({48});
+
+    CHECK(queue_fix.queued.empty());
+    CHECK(queued.get() == vector<uint8_t>({47}));
+    CHECK(polled == vector<uint8_t>({48}));
+}
+
+TEST_CASE("SPI bus session acquires bus once for all transfers")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(3, 1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIDevice::BusSession session(dev);
+
+    CHECK(dev.transfer({47}).get() == vector<uint8_t>({47}));
+    CHECK(dev.write({48}).get().empty());
+    CHECK(dev.read(1).get() == vector<uint8_t>({0}));
+}
+
+TEST_CASE("SPI bus session with polling transfers")
+{
+    CMockFixture cmock_fix;
+    SPIPollingFix polling_fix(2);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    spi_device_acquire_bus_ExpectAnyArgsAndReturn(ESP_OK);
+    spi_device_release_bus_ExpectAnyArgs();
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIDevice::BusSession session(dev);
+
+    CHECK(dev.polling_transfer({47}) == vector<uint8_t>({47}));
+    CHECK(dev.polling_transfer({48}) == vector<uint8_t>({48}));
+}
+
+TEST_CASE("SPI bus session keeps CS active until disabled")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(2, 1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4), Frequency::MHz(1), QueueSize(2));
+    SPIDevice::BusSession session(dev, true);
+
+    SPIFuture command = dev.write({0x47});
+    session.set_cs_keep_active(false);
+    SPIFuture response = dev.read(2);
+
+    REQUIRE(queue_fix.started.size() == 2);
+    CHECK(queue_fix.started[0]->flags == SPI_TRANS_CS_KEEP_ACTIVE);
+    CHECK(queue_fix.started[1]->flags == 0);
+    command.wait();
+    CHECK(response.get() == vector<uint8_t>({0, 1}));
+}
+
+TEST_CASE("SPI bus session while another one is active throws")
+{
+    CMockFixture cmock_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    spi_device_acquire_bus_ExpectAnyArgsAndReturn(ESP_OK);
+    spi_device_release_bus_ExpectAnyArgs();
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIDevice::BusSession session(dev);
+
+    CHECK_THROWS_AS(SPIDevice::BusSession other_session(dev), SPIException&);
+}
+
+TEST_CASE("SPI bus session throws if bus can't be acquired")
+{
+    CMockFixture cmock_fix;
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    spi_device_acquire_bus_ExpectAnyArgsAndReturn(ESP_ERR_INVALID_ARG);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+
+    CHECK_THROWS_AS(SPIDevice::BusSession session(dev), SPIException&);
+}
+
 TEST_CASE("SPIFuture invalid after default construction")
 {
     SPIFuture future;
@@ -400,6 +1137,38 @@ TEST_CASE("SPIFuture valid")
     CHECK(true == future.valid());
 }
 
+TEST_CASE("SPIFuture invalid after get")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture future = dev.transfer({47});
+    future.get();
+
+    CHECK(false == future.valid());
+    CHECK_THROWS_AS(future.get(), std::future_error&);
+}
+
+TEST_CASE("SPIFuture wait on invalid future throws")
+{
+    CMockFixture cmock_fix;
+    SPIQueueFix queue_fix(1);
+    SPIDevFix dev_fix(CreateAnd::IGNORE);
+    SPIFuture empty_future;
+
+    CHECK_THROWS_AS(empty_future.wait(), std::future_error&);
+    CHECK_THROWS_AS(empty_future.wait_for(std::chrono::milliseconds(47)), std::future_error&);
+
+    SPIDevice dev(SPINum(SPI2_HOST), CS(4));
+    SPIFuture future = dev.transfer({47});
+    future.get();
+
+    CHECK_THROWS_AS(future.wait(), std::future_error&);
+    CHECK_THROWS_AS(future.wait_for(std::chrono::milliseconds(47)), std::future_error&);
+}
+
 TEST_CASE("SPIFuture wait_for timeout")
 {
     CMockFixture cmock_fix;
@@ -0,0 +1,213 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cpp_exceptions
+
+#include <algorithm>
+#include "i2c_arbiter_cxx.hpp"
+#include "i2c_private_cxx.hpp"
+
+using namespace std;
+
+namespace idf {
+
+namespace {
+
+/**
+ * State of a write to paged memory, shared between the steps executing it page by page.
+ */
+struct PagedWrite {
+    PagedWrite(shared_ptr<I2CMaster> master_arg,
+            I2CAddress i2c_addr_arg,
+            uint32_t mem_addr_arg,
+            vector<uint8_t> data_arg,
+            const I2CPageLayout &layout_arg)
+        : master(std::move(master_arg)),
+        i2c_addr(i2c_addr_arg),
+        mem_addr(mem_addr_arg),
+        data(std::move(data_arg)),
+        layout(layout_arg),
+        written(0),
+        page_buffer(layout.address_len + layout.page_size),
+        done()
+    { }
+
+    /**
+     * Write the data up to the next page boundary.
+     *
+     * @return true if all data has been written or the write failed.
+     */
+    bool write_next_page() noexcept
+    {
+        try {
+            uint32_t page_addr = mem_addr + written;
+            size_t page_len = min(layout.page_size - page_addr % layout.page_size, data.size() - written);
+
+            encode_mem_addr(page_buffer.data(), page_addr, layout.address_len);
+            copy_n(data.begin() + written, page_len, page_buffer.begin() + layout.address_len);
+
+            master->sync_write(i2c_addr, page_buffer.data(), layout.address_len + page_len);
+            written += page_len;
+
+            if (written == data.size()) {
+                done.set_value();
+                return true;
+            }
+            return false;
+        } catch (...) {
+            done.set_exception(current_exception());
+            return true;
+        }
+    }
+
+    shared_ptr<I2CMaster> master;
+    const I2CAddress i2c_addr;
+    const uint32_t mem_addr;
+    const vector<uint8_t> data;
+    const I2CPageLayout layout;
+    size_t written;
+    vector<uint8_t> page_buffer;
+    promise<void> done;
+};
+
+} // namespace
+
+I2CBusArbiter::I2CBusArbiter(shared_ptr<I2CMaster> master_arg, const I2CArbiterConfig &config)
+    : master(std::move(master_arg)), queue_sizes(config.queue_sizes), queues(), stats(), stop_requested(false)
+{
+    if (!master) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    if (find(queue_sizes.begin(), queue_sizes.end(), 0) != queue_sizes.end()) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    PthreadConfigGuard cfg_guard(config.stack_size, config.priority, config.core_id, "i2c_arbiter");
+#endif
+    arbiter_thread = thread(&I2CBusArbiter::run, this);
+}
+
+I2CBusArbiter::~I2CBusArbiter()
+{
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stop_requested = true;
+    }
+    job_available.notify_one();
+    arbiter_thread.join();
+}
+
+future<void> I2CBusArbiter::paged_write(I2CPriority priority,
+        I2CAddress i2c_addr,
+        uint32_t mem_addr,
+        vector<uint8_t> data,
+        const I2CPageLayout &layout)
+{
+    if (data.empty() || layout.page_size == 0 || layout.address_len == 0 || layout.address_len > 4) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    auto write = make_shared<PagedWrite>(master, i2c_addr, mem_addr, std::move(data), layout);
+    future<void> result = write->done.get_future();
+
+    post(priority, [write]() { return write->write_next_page(); }, layout.write_cycle_time);
+
+    return result;
+}
+
+I2CQueueStats I2CBusArbiter::get_stats(I2CPriority priority) const
+{
+    size_t index = static_cast<size_t>(priority);
+
+    lock_guard<mutex> lock(queue_mutex);
+    I2CQueueStats result = stats[index];
+    result.waiting = queues[index].size();
+    return result;
+}
+
+void I2CBusArbiter::post(I2CPriority priority, function<bool()> step, chrono::milliseconds step_delay)
+{
+    size_t index = static_cast<size_t>(priority);
+    if (index >= queues.size()) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    unique_lock<mutex> lock(queue_mutex);
+    space_available.wait(lock, [this, index]() { return queues[index].size() < queue_sizes[index]; });
+    queues[index].push_back({std::move(step), step_delay, Clock::now()});
+    lock.unlock();
+    job_available.notify_one();
+}
+
+void I2CBusArbiter::run()
+{
+    unique_lock<mutex> lock(queue_mutex);
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next_ready = Clock::time_point::max();
+        deque<Job> *queue = nullptr;
+        size_t job_index = 0;
+
+        // The oldest ready job of the highest priority class. Jobs in between two steps aren't ready until their
+        // step delay has passed, other jobs of their class may overtake them meanwhile.
+        for (auto &class_queue : queues) {
+            for (size_t i = 0; i < class_queue.size(); i++) {
+                if (class_queue[i].ready_since <= now) {
+                    queue = &class_queue;
+                    job_index = i;
+                    break;
+                }
+                next_ready = min(next_ready, class_queue[i].ready_since);
+            }
+            if (queue) {
+                break;
+            }
+        }
+
+        if (!queue) {
+            // Remaining jobs are still executed after a stop request to fulfill their futures.
+            if (stop_requested && next_ready == Clock::time_point::max()) {
+                return;
+            }
+
+            if (next_ready == Clock::time_point::max()) {
+                job_available.wait(lock);
+            } else {
+                job_available.wait_until(lock, next_ready);
+            }
+            continue;
+        }
+
+        I2CQueueStats &class_stats = stats[queue - queues.data()];
+        chrono::microseconds wait = chrono::duration_cast<chrono::microseconds>(now - (*queue)[job_index].ready_since);
+        class_stats.transactions++;
+        class_stats.total_wait += wait;
+        class_stats.max_wait = max(class_stats.max_wait, wait);
+
+        // The job stays in the queue while its step is executed, so it still occupies its slot. Other tasks only
+        // append jobs meanwhile, hence its index stays valid.
+        function<bool()> step = std::move((*queue)[job_index].step);
+        lock.unlock();
+        bool finished = step();
+        lock.lock();
+
+        if (finished) {
+            queue->erase(queue->begin() + job_index);
+            space_available.notify_all();
+        } else {
+            Job &job = (*queue)[job_index];
+            job.step = std::move(step);
+            job.ready_since = Clock::now() + job.step_delay;
+        }
+    }
+}
+
+} // idf
+
+#endif // __cpp_exceptions
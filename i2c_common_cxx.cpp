@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2020-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Definitions shared by the I2C classes of the legacy driver and of the i2c_master driver, e.g. the exceptions, the
+ * address check and the I2CBus base class. They're kept apart from i2c_cxx.cpp so that using I2CMasterBus doesn't
+ * link the legacy driver, which aborts at startup next to the i2c_master driver.
+ */
+
+#ifdef __cpp_exceptions
+
+#include <utility>
+#include "hal/i2c_types.h"
+#include "i2c_cxx.hpp"
+
+namespace idf {
+
+/**
+ * I2C bus are defined in the header files, let's check that the values are correct
+ */
+#if SOC_I2C_NUM >= 2
+static_assert(I2C_NUM_1 == 1, "I2C_NUM_1 must be equal to 1");
+#endif // SOC_I2C_NUM >= 2
+
+esp_err_t check_i2c_num(uint32_t i2c_num) noexcept
+{
+    if (i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t check_i2c_addr(uint32_t addr) noexcept
+{
+    // maximum I2C address currently supported in the C++ classes is 127
+    if (addr > 0x7f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+I2CException::I2CException(esp_err_t error) : ESPException(error) { }
+
+I2CTransferException::I2CTransferException(esp_err_t error) : I2CException(error) { }
+
+void throw_i2c_error(esp_err_t error)
+{
+    if (error == ESP_ERR_INVALID_ARG) {
+        throw I2CException(error);
+    }
+
+    if (error != ESP_OK) {
+        throw I2CTransferException(error);
+    }
+}
+
+I2CAddress::I2CAddress(uint8_t addr) : StrongValueComparable<uint8_t> (addr)
+{
+    esp_err_t error = check_i2c_addr(addr);
+    if (error != ESP_OK) {
+        throw I2CException(error);
+    }
+}
+
+I2CBus::I2CBus(I2CNumber i2c_number) : i2c_num(std::move(i2c_number)) { }
+
+I2CBus::~I2CBus() { }
+
+} // idf
+
+#endif // __cpp_exceptions
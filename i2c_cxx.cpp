@@ -6,102 +6,592 @@
 
 #ifdef __cpp_exceptions
 
+#include <algorithm>
+#include <array>
+#include <utility>
 #include "driver/i2c.h"
 #include "i2c_cxx.hpp"
+#include "i2c_private_cxx.hpp"
+#if CONFIG_ESP_IDF_CXX_I2C_STATS || CONFIG_ESP_IDF_CXX_I2C_TRACE
+#include "esp_timer.h"
+#endif
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+#include "i2c_trace_cxx.hpp"
+#endif
 
 using namespace std;
 
 namespace idf {
 
-#define I2C_CHECK_THROW(err) CHECK_THROW_SPECIFIC((err), I2CException)
+/**
+ * Return the error of \c expr from the calling function, unless it's ESP_OK.
+ */
+#define I2C_RETURN_ON_ERROR(expr)       \
+    do {                                \
+        esp_err_t result_ = (expr);     \
+        if (result_ != ESP_OK) {        \
+            return result_;             \
+        }                               \
+    } while (0)
 
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
 /**
- * I2C bus are defined in the header files, let's check that the values are correct
+ * Record the command in the trace of the link. During a replay, return before the driver is called.
  */
-#if SOC_I2C_NUM >= 2
-static_assert(I2C_NUM_1 == 1, "I2C_NUM_1 must be equal to 1");
-#endif // SOC_I2C_NUM >= 2
+#define I2C_TRACE_OP(...)                                       \
+    do {                                                        \
+        I2C_RETURN_ON_ERROR(trace_op(__VA_ARGS__));             \
+        if (trace_mode == TraceMode::REPLAY) {                  \
+            return ESP_OK;                                      \
+        }                                                       \
+    } while (0)
+#else
+#define I2C_TRACE_OP(...)
+#endif
 
-esp_err_t check_i2c_num(uint32_t i2c_num) noexcept
+I2CCommandLink::I2CCommandLink() : is_static(false), pool(nullptr), pool_index(0)
 {
-    if (i2c_num >= I2C_NUM_MAX) {
-        return ESP_ERR_INVALID_ARG;
+    handle = create_handle(nullptr, 0);
+    if (!handle) {
+        throw I2CException(ESP_ERR_NO_MEM);
     }
+}
 
-    return ESP_OK;
+I2CCommandLink::I2CCommandLink(uint8_t *buffer, size_t size) : is_static(true), pool(nullptr), pool_index(0)
+{
+    create_static(buffer, size);
 }
 
-esp_err_t check_i2c_addr(uint32_t addr) noexcept
+I2CCommandLink::I2CCommandLink(I2CCommandLinkPool &pool_arg, chrono::milliseconds timeout)
+    : is_static(true), pool(nullptr), pool_index(0)
 {
-    // maximum I2C address currently supported in the C++ classes is 127
-    if (addr > 0x7f) {
-        return ESP_ERR_INVALID_ARG;
+    pool_index = pool_arg.acquire(timeout);
+    try {
+        create_static(pool_arg.buffer(pool_index), pool_arg.buffer_size);
+    } catch (...) {
+        pool_arg.release(pool_index);
+        throw;
     }
-
-    return ESP_OK;
+    pool = &pool_arg;
 }
 
-I2CException::I2CException(esp_err_t error) : ESPException(error) { }
+I2CCommandLink::I2CCommandLink(I2CCommandLinkPool &pool_arg, chrono::milliseconds timeout, const nothrow_t&) noexcept
+    : handle(nullptr), is_static(true), pool(nullptr), pool_index(0)
+{
+    if (pool_arg.try_acquire(timeout, pool_index) != ESP_OK) {
+        return;
+    }
 
-I2CTransferException::I2CTransferException(esp_err_t error) : I2CException(error) { }
+    handle = create_handle(pool_arg.buffer(pool_index), pool_arg.buffer_size);
+    if (!handle) {
+        pool_arg.release(pool_index);
+        return;
+    }
+    pool = &pool_arg;
+}
 
-I2CAddress::I2CAddress(uint8_t addr) : StrongValueComparable<uint8_t> (addr)
+I2CCommandLink::~I2CCommandLink()
 {
-    esp_err_t error = check_i2c_addr(addr);
-    if (error != ESP_OK) {
-        throw I2CException(error);
+    if (!handle) {
+        return;
+    }
+
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+    if (trace_mode == TraceMode::REPLAY) {
+        handle = nullptr;
+    }
+#endif
+
+    if (handle && is_static) {
+        i2c_cmd_link_delete_static(handle);
+    } else if (handle) {
+        i2c_cmd_link_delete(handle);
+    }
+
+    if (pool) {
+        pool->release(pool_index);
     }
 }
 
-I2CCommandLink::I2CCommandLink()
+void I2CCommandLink::create_static(uint8_t *buffer, size_t size)
 {
-    handle = i2c_cmd_link_create();
+    handle = create_handle(buffer, size);
     if (!handle) {
         throw I2CException(ESP_ERR_NO_MEM);
     }
 }
 
-I2CCommandLink::~I2CCommandLink()
+void *I2CCommandLink::create_handle(uint8_t *buffer, size_t size) noexcept
 {
-    i2c_cmd_link_delete(handle);
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+    if (I2CTrace::is_replaying()) {
+        // no driver command link, but a valid handle for the checks of the try_ methods
+        trace_mode = TraceMode::REPLAY;
+        return this;
+    }
+
+    if (I2CTrace::is_recording()) {
+        trace_mode = TraceMode::RECORD;
+    }
+#endif
+
+    if (buffer) {
+        return i2c_cmd_link_create_static(buffer, size);
+    }
+
+    return i2c_cmd_link_create();
 }
 
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+esp_err_t I2CCommandLink::trace_op(const I2CTraceOp &op) noexcept
+{
+    if (trace_mode == TraceMode::OFF) {
+        return ESP_OK;
+    }
+
+    try {
+        trace_ops.push_back(op);
+    } catch (const bad_alloc &) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+#endif
+
 void I2CCommandLink::start()
 {
-    I2C_CHECK_THROW(i2c_master_start(handle));
+    I2C_CHECK_THROW(try_start());
 }
 
 void I2CCommandLink::write(const std::vector<uint8_t> &bytes, bool expect_ack)
 {
-    I2C_CHECK_THROW(i2c_master_write(handle, bytes.data(), bytes.size(), expect_ack));
+    write(bytes.data(), bytes.size(), expect_ack);
+}
+
+void I2CCommandLink::write(const uint8_t *bytes, size_t size, bool expect_ack)
+{
+    I2C_CHECK_THROW(try_write(bytes, size, expect_ack));
 }
 
 void I2CCommandLink::write_byte(uint8_t byte, bool expect_ack)
 {
-    I2C_CHECK_THROW(i2c_master_write_byte(handle, byte, expect_ack));
+    I2C_CHECK_THROW(try_write_byte(byte, expect_ack));
 }
 
 void I2CCommandLink::read(std::vector<uint8_t> &bytes)
 {
-    I2C_CHECK_THROW(i2c_master_read(handle, bytes.data(), bytes.size(), I2C_MASTER_LAST_NACK));
+    read(bytes.data(), bytes.size());
+}
+
+void I2CCommandLink::read(uint8_t *bytes, size_t size)
+{
+    I2C_CHECK_THROW(try_read(bytes, size));
+}
+
+void I2CCommandLink::write_address(I2CAddress i2c_addr, bool read)
+{
+    I2C_CHECK_THROW(try_write_address(i2c_addr, read));
 }
 
 void I2CCommandLink::stop()
 {
-    I2C_CHECK_THROW(i2c_master_stop(handle));
+    I2C_CHECK_THROW(try_stop());
+}
+
+esp_err_t I2CCommandLink::try_start() noexcept
+{
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    I2C_TRACE_OP({I2CTraceOpType::START, 0, nullptr, nullptr, 0});
+
+    return i2c_master_start(handle);
+}
+
+esp_err_t I2CCommandLink::try_write(const uint8_t *bytes, size_t size, bool expect_ack) noexcept
+{
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    I2C_TRACE_OP({I2CTraceOpType::WRITE, 0, bytes, nullptr, size});
+
+    esp_err_t err = i2c_master_write(handle, bytes, size, expect_ack);
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    if (err == ESP_OK) {
+        stats_bytes += size;
+    }
+#endif
+    return err;
+}
+
+esp_err_t I2CCommandLink::try_write_byte(uint8_t byte, bool expect_ack) noexcept
+{
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    I2C_TRACE_OP({I2CTraceOpType::WRITE, byte, nullptr, nullptr, 1});
+
+    esp_err_t err = i2c_master_write_byte(handle, byte, expect_ack);
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    if (err == ESP_OK) {
+        stats_bytes++;
+    }
+#endif
+    return err;
+}
+
+esp_err_t I2CCommandLink::try_write_address(I2CAddress i2c_addr, bool read) noexcept
+{
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t address_byte = i2c_addr.get_value() << 1 | (read ? I2C_MASTER_READ : I2C_MASTER_WRITE);
+    I2C_TRACE_OP({I2CTraceOpType::WRITE, address_byte, nullptr, nullptr, 1});
+
+    esp_err_t err = i2c_master_write_byte(handle, address_byte, true);
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    if (err == ESP_OK && stats_address < 0) {
+        stats_address = i2c_addr.get_value();
+    }
+#endif
+    return err;
+}
+
+esp_err_t I2CCommandLink::try_read(uint8_t *bytes, size_t size) noexcept
+{
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    I2C_TRACE_OP({I2CTraceOpType::READ, 0, nullptr, bytes, size});
+
+    esp_err_t err = i2c_master_read(handle, bytes, size, I2C_MASTER_LAST_NACK);
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    if (err == ESP_OK) {
+        stats_bytes += size;
+    }
+#endif
+    return err;
+}
+
+esp_err_t I2CCommandLink::try_stop() noexcept
+{
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    I2C_TRACE_OP({I2CTraceOpType::STOP, 0, nullptr, nullptr, 0});
+
+    return i2c_master_stop(handle);
 }
 
 void I2CCommandLink::execute_transfer(I2CNumber i2c_num, chrono::milliseconds driver_timeout)
 {
-    esp_err_t err = i2c_master_cmd_begin(i2c_num.get_value<i2c_port_t>(), handle, driver_timeout.count() / portTICK_PERIOD_MS);
+    esp_err_t err = try_execute_transfer(i2c_num, driver_timeout);
     if (err != ESP_OK) {
         throw I2CTransferException(err);
     }
 }
 
-I2CBus::I2CBus(I2CNumber i2c_number) : i2c_num(std::move(i2c_number)) { }
+esp_err_t I2CCommandLink::try_execute_transfer(I2CNumber i2c_num, chrono::milliseconds driver_timeout) noexcept
+{
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+    if (trace_mode == TraceMode::REPLAY) {
+        return I2CTrace::replay(i2c_num, trace_ops);
+    }
+    int64_t trace_start = trace_mode == TraceMode::RECORD ? esp_timer_get_time() : 0;
+#endif
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    int64_t start = esp_timer_get_time();
+#endif
+    esp_err_t err = i2c_master_cmd_begin(i2c_num.get_value<i2c_port_t>(), handle, driver_timeout.count() / portTICK_PERIOD_MS);
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    uint32_t latency_us = static_cast<uint32_t>(esp_timer_get_time() - start);
+    if (stats_address >= 0) {
+        I2CStatistics::for_bus(i2c_num).record(stats_address, stats_bytes, err, latency_us);
+    }
+#endif
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+    if (trace_mode == TraceMode::RECORD) {
+        I2CTrace::record(i2c_num, trace_ops, err, trace_start, esp_timer_get_time() - trace_start);
+    }
+#endif
+    return err;
+}
+
+I2CStatistics::I2CStatistics(size_t max_devices_arg)
+    : max_devices(max_devices_arg), used(0), entries()
+{
+    if (max_devices == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    entries.reset(new I2CAddressStats[max_devices]());
+}
+
+void I2CStatistics::record(uint8_t address, size_t bytes, esp_err_t result, uint32_t latency_us) noexcept
+{
+    lock_guard<mutex> lock(stats_mutex);
+
+    I2CAddressStats *entry = find_if(entries.get(), entries.get() + used, [address](const I2CAddressStats &stats) {
+        return stats.address == address;
+    });
+
+    if (entry == entries.get() + used) {
+        if (used == max_devices) {
+            return;
+        }
+        used++;
+        *entry = I2CAddressStats();
+        entry->address = address;
+    }
+
+    entry->transactions++;
+    entry->bytes += bytes;
+    if (result == ESP_FAIL) {
+        entry->nacks++;
+    } else if (result == ESP_ERR_TIMEOUT) {
+        entry->timeouts++;
+    } else if (result != ESP_OK) {
+        entry->errors++;
+    }
+
+    entry->total_latency_us += latency_us;
+    entry->max_latency_us = max(entry->max_latency_us, latency_us);
+
+    size_t bucket = 0;
+    while (bucket < I2CAddressStats::LATENCY_BUCKETS - 1 && latency_us >= (128u << bucket)) {
+        bucket++;
+    }
+    entry->latency_histogram[bucket]++;
+}
+
+I2CAddressStats I2CStatistics::get(I2CAddress address) const
+{
+    lock_guard<mutex> lock(stats_mutex);
+
+    for (size_t i = 0; i < used; i++) {
+        if (entries[i].address == address.get_value()) {
+            return entries[i];
+        }
+    }
+
+    I2CAddressStats result = I2CAddressStats();
+    result.address = address.get_value();
+    return result;
+}
+
+vector<I2CAddressStats> I2CStatistics::snapshot() const
+{
+    lock_guard<mutex> lock(stats_mutex);
+    return vector<I2CAddressStats>(entries.get(), entries.get() + used);
+}
+
+void I2CStatistics::reset() noexcept
+{
+    lock_guard<mutex> lock(stats_mutex);
+    used = 0;
+}
+
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+/**
+ * Create the statistics of all buses. I2CStatistics can't be copied or moved, so the elements are initialized
+ * directly from the pack expansion, one for each index.
+ */
+template<size_t... BUS>
+static array<I2CStatistics, sizeof...(BUS)> make_bus_stats(index_sequence<BUS...>)
+{
+    return {{ (static_cast<void>(BUS), I2CStatistics(CONFIG_ESP_IDF_CXX_I2C_STATS_MAX_DEVICES))... }};
+}
+
+I2CStatistics &I2CStatistics::for_bus(I2CNumber i2c_num)
+{
+    static array<I2CStatistics, I2C_NUM_MAX> bus_stats = make_bus_stats(make_index_sequence<I2C_NUM_MAX>());
+
+    return bus_stats[i2c_num.get_value()];
+}
+#endif // CONFIG_ESP_IDF_CXX_I2C_STATS
+
+I2CTransferWorker::I2CTransferWorker(const I2CWorkerConfig &config)
+    : queue_size(config.queue_size), jobs(), stop_requested(false)
+{
+    if (queue_size == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    PthreadConfigGuard cfg_guard(config.stack_size, config.priority, config.core_id, "i2c_worker");
+#endif
+    worker_thread = thread(&I2CTransferWorker::run, this);
+}
+
+I2CTransferWorker::~I2CTransferWorker()
+{
+    {
+        lock_guard<mutex> lock(jobs_mutex);
+        stop_requested = true;
+    }
+    job_available.notify_one();
+    worker_thread.join();
+}
+
+void I2CTransferWorker::post(function<void()> job)
+{
+    unique_lock<mutex> lock(jobs_mutex);
+    space_available.wait(lock, [this]() { return jobs.size() < queue_size; });
+    jobs.push_back(std::move(job));
+    lock.unlock();
+    job_available.notify_one();
+}
+
+thread::id I2CTransferWorker::get_id() const noexcept
+{
+    return worker_thread.get_id();
+}
+
+void I2CTransferWorker::run()
+{
+    while (true) {
+        unique_lock<mutex> lock(jobs_mutex);
+        job_available.wait(lock, [this]() { return stop_requested || !jobs.empty(); });
+
+        // Remaining jobs are still executed after a stop request to fulfill their futures.
+        if (jobs.empty()) {
+            return;
+        }
+
+        function<void()> job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+        space_available.notify_one();
 
-I2CBus::~I2CBus() { }
+        job();
+    }
+}
+
+I2CCommandLinkPool::I2CCommandLinkPool()
+    : buffer_size(I2C_LINK_RECOMMENDED_SIZE(CONFIG_ESP_IDF_CXX_I2C_CMD_LINK_POOL_TRANSACTIONS)),
+    buffers(new uint8_t[CAPACITY * buffer_size]),
+    in_use()
+{
+}
+
+size_t I2CCommandLinkPool::available()
+{
+    lock_guard<mutex> lock(pool_mutex);
+    return CAPACITY - in_use.count();
+}
+
+size_t I2CCommandLinkPool::acquire(chrono::milliseconds timeout)
+{
+    size_t index;
+    I2C_CHECK_THROW(try_acquire(timeout, index));
+    return index;
+}
+
+esp_err_t I2CCommandLinkPool::try_acquire(chrono::milliseconds timeout, size_t &index) noexcept
+{
+    unique_lock<mutex> lock(pool_mutex);
+    if (!buffer_released.wait_for(lock, timeout, [this]() { return !in_use.all(); })) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    index = 0;
+    while (in_use.test(index)) {
+        index++;
+    }
+    in_use.set(index);
+    return ESP_OK;
+}
+
+void I2CCommandLinkPool::release(size_t index) noexcept
+{
+    {
+        lock_guard<mutex> lock(pool_mutex);
+        in_use.reset(index);
+    }
+    buffer_released.notify_one();
+}
+
+uint8_t *I2CCommandLinkPool::buffer(size_t index) const noexcept
+{
+    return buffers.get() + index * buffer_size;
+}
+
+I2CBatch::I2CBatch()
+    : entries(),
+    // the largest entry is a write followed by a read with repeated start, i.e. two transactions
+    cmd_link_buffer_size(I2C_LINK_RECOMMENDED_SIZE(2)),
+    cmd_link_buffer(new uint8_t[cmd_link_buffer_size])
+{
+}
+
+size_t I2CBatch::add_write(I2CAddress i2c_addr, const uint8_t *data, size_t data_len)
+{
+    if (data == nullptr || data_len == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    entries.push_back({i2c_addr, data, data_len, nullptr, 0, ESP_ERR_INVALID_STATE});
+    return entries.size() - 1;
+}
+
+size_t I2CBatch::add_read(I2CAddress i2c_addr, uint8_t *buffer, size_t buffer_len)
+{
+    if (buffer == nullptr || buffer_len == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    entries.push_back({i2c_addr, nullptr, 0, buffer, buffer_len, ESP_ERR_INVALID_STATE});
+    return entries.size() - 1;
+}
+
+size_t I2CBatch::add_transfer(I2CAddress i2c_addr,
+        const uint8_t *write_data,
+        size_t write_len,
+        uint8_t *read_buffer,
+        size_t read_len)
+{
+    if (write_data == nullptr || write_len == 0 || read_buffer == nullptr || read_len == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    entries.push_back({i2c_addr, write_data, write_len, read_buffer, read_len, ESP_ERR_INVALID_STATE});
+    return entries.size() - 1;
+}
+
+size_t I2CBatch::size() const noexcept
+{
+    return entries.size();
+}
+
+esp_err_t I2CBatch::get_error(size_t index) const
+{
+    if (index >= entries.size()) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    return entries[index].error;
+}
+
+void I2CBatch::clear() noexcept
+{
+    entries.clear();
+}
+
+// same as the default driver timeout of the transfer classes
+const chrono::milliseconds I2CMaster::SYNC_TIMEOUT(1000);
+
+const chrono::milliseconds I2CMaster::SCAN_PROBE_TIMEOUT(10);
 
 I2CMaster::I2CMaster(I2CNumber i2c_number,
                      SCL_GPIO scl_gpio,
@@ -109,7 +599,7 @@ I2CMaster::I2CMaster(I2CNumber i2c_number,
                      Frequency clock_speed,
                      bool scl_pullup,
                      bool sda_pullup)
-    : I2CBus(std::move(i2c_number))
+    : I2CBus(std::move(i2c_number)), worker(), cmd_link_pool(), presence(), presence_known(false)
 {
     i2c_config_t conf = {};
     conf.mode = I2C_MODE_MASTER;
@@ -122,36 +612,255 @@ I2CMaster::I2CMaster(I2CNumber i2c_number,
     I2C_CHECK_THROW(i2c_driver_install(i2c_num.get_value<i2c_port_t>(), conf.mode, 0, 0, 0));
 }
 
+I2CMaster::I2CMaster(I2CNumber i2c_number,
+                     SCL_GPIO scl_gpio,
+                     SDA_GPIO sda_gpio,
+                     Frequency clock_speed,
+                     const I2CWorkerConfig &worker_config,
+                     bool scl_pullup,
+                     bool sda_pullup)
+    : I2CMaster(std::move(i2c_number), scl_gpio, sda_gpio, clock_speed, scl_pullup, sda_pullup)
+{
+    worker.reset(new I2CTransferWorker(worker_config));
+}
+
 I2CMaster::~I2CMaster()
 {
+    // The worker may still execute transfers, it has to finish before the driver is deleted.
+    worker.reset();
     i2c_driver_delete(i2c_num.get_value<i2c_port_t>());
 }
 
 void I2CMaster::sync_write(I2CAddress i2c_addr, const vector<uint8_t> &data)
 {
-    I2CWrite writer(data);
+    sync_write(i2c_addr, data.data(), data.size());
+}
 
-    writer.do_transfer(i2c_num, i2c_addr);
+void I2CMaster::sync_write(I2CAddress i2c_addr, const uint8_t *data, size_t data_len)
+{
+    try_write(i2c_addr, data, data_len).value();
 }
 
 std::vector<uint8_t> I2CMaster::sync_read(I2CAddress i2c_addr, size_t n_bytes)
 {
-    I2CRead reader(n_bytes);
+    vector<uint8_t> result(n_bytes);
+
+    sync_read(i2c_addr, result.data(), result.size());
 
-    return reader.do_transfer(i2c_num, i2c_addr);
+    return result;
+}
+
+void I2CMaster::sync_read(I2CAddress i2c_addr, uint8_t *buffer, size_t buffer_len)
+{
+    try_read(i2c_addr, buffer, buffer_len).value();
 }
 
 vector<uint8_t> I2CMaster::sync_transfer(I2CAddress i2c_addr,
         const std::vector<uint8_t> &write_data,
         size_t read_n_bytes)
 {
-    I2CComposed composed_transfer;
-    composed_transfer.add_write(write_data);
-    composed_transfer.add_read(read_n_bytes);
+    vector<uint8_t> result(read_n_bytes);
+
+    sync_transfer(i2c_addr, write_data.data(), write_data.size(), result.data(), result.size());
+
+    return result;
+}
+
+void I2CMaster::sync_transfer(I2CAddress i2c_addr,
+        const uint8_t *write_data,
+        size_t write_len,
+        uint8_t *read_buffer,
+        size_t read_len)
+{
+    try_transfer(i2c_addr, write_data, write_len, read_buffer, read_len).value();
+}
+
+I2CResult<> I2CMaster::try_write(I2CAddress i2c_addr, const uint8_t *data, size_t data_len) noexcept
+{
+    if (data == nullptr || data_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!is_present(i2c_addr)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    I2CCommandLink cmd_link(cmd_link_pool, SYNC_TIMEOUT, nothrow);
+    I2C_RETURN_ON_ERROR(cmd_link.try_start());
+    I2C_RETURN_ON_ERROR(cmd_link.try_write_address(i2c_addr, false));
+    I2C_RETURN_ON_ERROR(cmd_link.try_write(data, data_len));
+    I2C_RETURN_ON_ERROR(cmd_link.try_stop());
+    return cmd_link.try_execute_transfer(i2c_num, SYNC_TIMEOUT);
+}
+
+I2CResult<> I2CMaster::try_read(I2CAddress i2c_addr, uint8_t *buffer, size_t buffer_len) noexcept
+{
+    if (buffer == nullptr || buffer_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    return composed_transfer.do_transfer(i2c_num, i2c_addr)[0];
+    if (!is_present(i2c_addr)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    I2CCommandLink cmd_link(cmd_link_pool, SYNC_TIMEOUT, nothrow);
+    I2C_RETURN_ON_ERROR(cmd_link.try_start());
+    I2C_RETURN_ON_ERROR(cmd_link.try_write_address(i2c_addr, true));
+    I2C_RETURN_ON_ERROR(cmd_link.try_read(buffer, buffer_len));
+    I2C_RETURN_ON_ERROR(cmd_link.try_stop());
+    return cmd_link.try_execute_transfer(i2c_num, SYNC_TIMEOUT);
 }
 
+I2CResult<> I2CMaster::try_transfer(I2CAddress i2c_addr,
+        const uint8_t *write_data,
+        size_t write_len,
+        uint8_t *read_buffer,
+        size_t read_len) noexcept
+{
+    if (write_data == nullptr || write_len == 0 || read_buffer == nullptr || read_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!is_present(i2c_addr)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    I2CCommandLink cmd_link(cmd_link_pool, SYNC_TIMEOUT, nothrow);
+    I2C_RETURN_ON_ERROR(cmd_link.try_start());
+    I2C_RETURN_ON_ERROR(cmd_link.try_write_address(i2c_addr, false));
+    I2C_RETURN_ON_ERROR(cmd_link.try_write(write_data, write_len));
+    I2C_RETURN_ON_ERROR(cmd_link.try_start());
+    I2C_RETURN_ON_ERROR(cmd_link.try_write_address(i2c_addr, true));
+    I2C_RETURN_ON_ERROR(cmd_link.try_read(read_buffer, read_len));
+    I2C_RETURN_ON_ERROR(cmd_link.try_stop());
+    return cmd_link.try_execute_transfer(i2c_num, SYNC_TIMEOUT);
+}
+
+I2CResult<> I2CMaster::try_probe(I2CAddress i2c_addr, chrono::milliseconds timeout) noexcept
+{
+    I2CCommandLink cmd_link(cmd_link_pool, SYNC_TIMEOUT, nothrow);
+    I2C_RETURN_ON_ERROR(cmd_link.try_start());
+    I2C_RETURN_ON_ERROR(cmd_link.try_write_address(i2c_addr, false));
+    I2C_RETURN_ON_ERROR(cmd_link.try_stop());
+    return cmd_link.try_execute_transfer(i2c_num, timeout);
+}
+
+size_t I2CMaster::sync_batch(I2CBatch &batch)
+{
+    size_t failed = 0;
+
+    for (I2CBatch::Entry &entry : batch.entries) {
+        if (!is_present(entry.i2c_addr)) {
+            entry.error = ESP_ERR_NOT_FOUND;
+            failed++;
+            continue;
+        }
+
+        try {
+            I2CCommandLink cmd_link(batch.cmd_link_buffer.get(), batch.cmd_link_buffer_size);
+            cmd_link.start();
+            if (entry.write_len > 0) {
+                cmd_link.write_address(entry.i2c_addr, false);
+                cmd_link.write(entry.write_data, entry.write_len);
+                if (entry.read_len > 0) {
+                    cmd_link.start();
+                }
+            }
+            if (entry.read_len > 0) {
+                cmd_link.write_address(entry.i2c_addr, true);
+                cmd_link.read(entry.read_buffer, entry.read_len);
+            }
+            cmd_link.stop();
+
+            // The error is recorded in the entry instead of thrown, so the batch continues after a NACK.
+            entry.error = cmd_link.try_execute_transfer(i2c_num, SYNC_TIMEOUT);
+        } catch (const I2CException &e) {
+            entry.error = e.error;
+        }
+
+        if (entry.error != ESP_OK) {
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+bitset<128> I2CMaster::scan(chrono::milliseconds probe_timeout)
+{
+    // lowest and highest address which are not reserved
+    const uint8_t FIRST_ADDR = 0x08;
+    const uint8_t LAST_ADDR = 0x77;
+
+    uint8_t cmd_link_buffer[I2C_LINK_RECOMMENDED_SIZE(1)];
+    bitset<128> found;
+
+    for (uint8_t addr = FIRST_ADDR; addr <= LAST_ADDR; addr++) {
+        I2CCommandLink cmd_link(cmd_link_buffer, sizeof(cmd_link_buffer));
+        I2C_CHECK_THROW(cmd_link.try_start());
+        I2C_CHECK_THROW(cmd_link.try_write_address(I2CAddress(addr), false));
+        I2C_CHECK_THROW(cmd_link.try_stop());
+
+        if (cmd_link.try_execute_transfer(i2c_num, probe_timeout) == ESP_OK) {
+            found.set(addr);
+        }
+    }
+
+    lock_guard<mutex> lock(presence_mutex);
+    presence = found;
+    presence_known = true;
+    return found;
+}
+
+vector<bitset<128> > I2CMaster::scan(const vector<shared_ptr<I2CMaster> > &masters, chrono::milliseconds probe_timeout)
+{
+    for (const shared_ptr<I2CMaster> &master : masters) {
+        if (!master) {
+            throw I2CException(ESP_ERR_INVALID_ARG);
+        }
+    }
+
+    vector<future<bitset<128> > > scans;
+    for (const shared_ptr<I2CMaster> &master : masters) {
+        scans.push_back(async(launch::async, [master, probe_timeout]() { return master->scan(probe_timeout); }));
+    }
+
+    vector<bitset<128> > results;
+    for (future<bitset<128> > &bus_scan : scans) {
+        results.push_back(bus_scan.get());
+    }
+    return results;
+}
+
+bool I2CMaster::is_present(I2CAddress i2c_addr) const
+{
+    lock_guard<mutex> lock(presence_mutex);
+    return !presence_known || presence.test(i2c_addr.get_value());
+}
+
+void I2CMaster::forget_presence() noexcept
+{
+    lock_guard<mutex> lock(presence_mutex);
+    presence_known = false;
+}
+
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+I2CAddressStats I2CMaster::get_stats(I2CAddress i2c_addr) const
+{
+    return I2CStatistics::for_bus(i2c_num).get(i2c_addr);
+}
+
+vector<I2CAddressStats> I2CMaster::get_stats() const
+{
+    return I2CStatistics::for_bus(i2c_num).snapshot();
+}
+
+void I2CMaster::reset_stats() noexcept
+{
+    I2CStatistics::for_bus(i2c_num).reset();
+}
+#endif // CONFIG_ESP_IDF_CXX_I2C_STATS
+
 #if CONFIG_SOC_I2C_SUPPORT_SLAVE
 I2CSlave::I2CSlave(I2CNumber i2c_number,
         SCL_GPIO scl_gpio,
@@ -202,7 +911,7 @@ I2CWrite::I2CWrite(const vector<uint8_t> &bytes, chrono::milliseconds driver_tim
 void I2CWrite::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
 {
     handle.start();
-    handle.write_byte(i2c_addr.get_value() << 1 | I2C_MASTER_WRITE);
+    handle.write_address(i2c_addr, false);
     handle.write(bytes);
 }
 
@@ -219,7 +928,7 @@ I2CRead::I2CRead(size_t size, chrono::milliseconds driver_timeout)
 void I2CRead::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
 {
     handle.start();
-    handle.write_byte(i2c_addr.get_value() << 1 | I2C_MASTER_READ);
+    handle.write_address(i2c_addr, true);
     handle.read(bytes);
 }
 
@@ -228,61 +937,169 @@ vector<uint8_t> I2CRead::process_result()
     return bytes;
 }
 
-I2CComposed::I2CComposed(chrono::milliseconds driver_timeout)
-    : I2CTransfer<vector<vector<uint8_t> > >(driver_timeout), transfer_list() { }
+I2CInlineWrite::I2CInlineWrite(const vector<uint8_t> &bytes, chrono::milliseconds driver_timeout)
+    : I2CInlineTransfer<I2CInlineWrite, void>(driver_timeout), bytes(bytes)
+{
+    if (bytes.empty()) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+}
 
-void I2CComposed::CompTransferNodeRead::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+I2CInlineRead::I2CInlineRead(size_t size, chrono::milliseconds driver_timeout)
+    : I2CInlineTransfer<I2CInlineRead, vector<uint8_t> >(driver_timeout), bytes(size)
 {
-    handle.write_byte(i2c_addr.get_value() << 1 | I2C_MASTER_READ);
-    handle.read(bytes);
+    if (size == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
 }
 
-void I2CComposed::CompTransferNodeRead::process_result(std::vector<std::vector<uint8_t> > &read_results)
+I2CComposedResult::I2CComposedResult(vector<uint8_t> data, shared_ptr<const vector<size_t> > read_ends)
+    : bytes(std::move(data)), ends(std::move(read_ends)) { }
+
+size_t I2CComposedResult::size() const noexcept
 {
-    read_results.push_back(bytes);
+    return ends ? ends->size() : 0;
 }
 
-void I2CComposed::CompTransferNodeWrite::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+I2CByteView I2CComposedResult::operator[](size_t index) const
 {
-    handle.write_byte(i2c_addr.get_value() << 1 | I2C_MASTER_WRITE);
-    handle.write(bytes);
+    if (index >= size()) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    size_t begin = index == 0 ? 0 : (*ends)[index - 1];
+    return I2CByteView(bytes.data() + begin, (*ends)[index] - begin);
 }
 
-void I2CComposed::add_read(size_t size)
+const vector<uint8_t> &I2CComposedResult::data() const noexcept
+{
+    return bytes;
+}
+
+I2CComposedResult::operator vector<vector<uint8_t> >() const
+{
+    vector<vector<uint8_t> > results;
+    results.reserve(size());
+    for (size_t i = 0; i < size(); i++) {
+        results.push_back((*this)[i].to_vector());
+    }
+    return results;
+}
+
+I2CComposedSteps::I2CComposedSteps() : steps(), write_data(), read_data(), read_ends() { }
+
+void I2CComposedSteps::add_read(size_t size)
 {
     if (!size) {
         throw I2CException(ESP_ERR_INVALID_ARG);
     }
 
-    transfer_list.push_back(make_shared<CompTransferNodeRead>(size));
+    // the end offsets are shared with the results of earlier executions, which must not change
+    if (!read_ends) {
+        read_ends = make_shared<vector<size_t> >();
+    } else if (read_ends.use_count() > 1) {
+        read_ends = make_shared<vector<size_t> >(*read_ends);
+    }
+
+    size_t offset = read_size();
+    steps.push_back({true, offset, size});
+    read_ends->push_back(offset + size);
 }
 
-void I2CComposed::add_write(std::vector<uint8_t> bytes)
+void I2CComposedSteps::add_write(const std::vector<uint8_t> &bytes)
 {
     if (bytes.empty()) {
         throw I2CException(ESP_ERR_INVALID_ARG);
     }
 
-    transfer_list.push_back(make_shared<CompTransferNodeWrite>(bytes));
+    steps.push_back({false, write_data.size(), bytes.size()});
+    write_data.insert(write_data.end(), bytes.begin(), bytes.end());
 }
 
-void I2CComposed::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+void I2CComposedSteps::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
 {
-    for (auto it = transfer_list.begin(); it != transfer_list.end(); it++) {
+    // the buffer may have been moved into the result of the last execution
+    read_data.resize(read_size());
+
+    for (const Step &step : steps) {
         handle.start();
-        (*it)->queue_cmd(handle, i2c_addr);
+        handle.write_address(i2c_addr, step.is_read);
+        if (step.is_read) {
+            handle.read(read_data.data() + step.offset, step.length);
+        } else {
+            handle.write(write_data.data() + step.offset, step.length);
+        }
     }
 }
 
-std::vector<std::vector<uint8_t> > I2CComposed::process_result()
+vector<vector<uint8_t> > I2CComposedSteps::copy_reads() const
 {
-    std::vector<std::vector<uint8_t> > results;
-    for (auto it = transfer_list.begin(); it != transfer_list.end(); it++) {
-        (*it)->process_result(results);
+    vector<vector<uint8_t> > results;
+    results.reserve(read_ends ? read_ends->size() : 0);
+    for (const Step &step : steps) {
+        if (step.is_read) {
+            results.emplace_back(read_data.begin() + step.offset, read_data.begin() + step.offset + step.length);
+        }
     }
     return results;
 }
 
+I2CComposedResult I2CComposedSteps::take_reads()
+{
+    return I2CComposedResult(std::move(read_data), read_ends);
+}
+
+size_t I2CComposedSteps::read_size() const noexcept
+{
+    return read_ends && !read_ends->empty() ? read_ends->back() : 0;
+}
+
+I2CComposed::I2CComposed(chrono::milliseconds driver_timeout)
+    : I2CTransfer<vector<vector<uint8_t> > >(driver_timeout), steps() { }
+
+void I2CComposed::add_read(size_t size)
+{
+    steps.add_read(size);
+}
+
+void I2CComposed::add_write(const std::vector<uint8_t> &bytes)
+{
+    steps.add_write(bytes);
+}
+
+void I2CComposed::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+{
+    steps.queue_cmd(handle, i2c_addr);
+}
+
+vector<vector<uint8_t> > I2CComposed::process_result()
+{
+    return steps.copy_reads();
+}
+
+I2CInlineComposed::I2CInlineComposed(chrono::milliseconds driver_timeout)
+    : I2CInlineTransfer<I2CInlineComposed, I2CComposedResult>(driver_timeout), steps() { }
+
+void I2CInlineComposed::add_read(size_t size)
+{
+    steps.add_read(size);
+}
+
+void I2CInlineComposed::add_write(const std::vector<uint8_t> &bytes)
+{
+    steps.add_write(bytes);
+}
+
+void I2CInlineComposed::queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+{
+    steps.queue_cmd(handle, i2c_addr);
+}
+
+I2CComposedResult I2CInlineComposed::process_result()
+{
+    return steps.take_reads();
+}
+
 } // idf
 
 #endif // __cpp_exceptions
@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cpp_exceptions
+
+#include <algorithm>
+#include "i2c_eeprom_cxx.hpp"
+#include "i2c_private_cxx.hpp"
+
+using namespace std;
+
+namespace idf {
+
+float I2CEEPROMWriteStats::get_bytes_per_second() const noexcept
+{
+    if (duration.count() == 0) {
+        return 0;
+    }
+
+    return static_cast<float>(bytes) * 1000000.0f / static_cast<float>(duration.count());
+}
+
+I2CEEPROM::I2CEEPROM(shared_ptr<I2CMaster> master_arg, I2CAddress i2c_addr_arg, const I2CPageLayout &layout_arg)
+    : i2c_addr(i2c_addr_arg), layout(layout_arg), master(std::move(master_arg)), page_buffer()
+{
+    if (!master || layout.page_size == 0 || layout.address_len == 0 || layout.address_len > 4) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    page_buffer.resize(layout.address_len + layout.page_size);
+}
+
+I2CEEPROMWriteStats I2CEEPROM::write(uint32_t mem_addr, const uint8_t *data, size_t data_len)
+{
+    if (data == nullptr || data_len == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    I2CEEPROMWriteStats stats = {};
+    Clock::time_point start = Clock::now();
+
+    size_t written = 0;
+    size_t page_len = prepare_page(mem_addr, data, data_len);
+    while (true) {
+        // the device doesn't acknowledge until it has stored the previous page
+        stats.ack_polls += poll_until_acked(layout.address_len + page_len);
+        stats.pages++;
+        written += page_len;
+
+        if (written == data_len) {
+            break;
+        }
+
+        // prepare the next page while the device stores this one
+        page_len = prepare_page(mem_addr + written, data + written, data_len - written);
+    }
+
+    stats.ack_polls += wait_ready();
+    stats.bytes = data_len;
+    stats.duration = chrono::duration_cast<chrono::microseconds>(Clock::now() - start);
+    return stats;
+}
+
+I2CEEPROMWriteStats I2CEEPROM::write(uint32_t mem_addr, const vector<uint8_t> &data)
+{
+    return write(mem_addr, data.data(), data.size());
+}
+
+void I2CEEPROM::read(uint32_t mem_addr, uint8_t *buffer, size_t buffer_len)
+{
+    if (buffer == nullptr || buffer_len == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    uint8_t addr_bytes[4];
+    encode_mem_addr(addr_bytes, mem_addr, layout.address_len);
+    master->sync_transfer(i2c_addr, addr_bytes, layout.address_len, buffer, buffer_len);
+}
+
+vector<uint8_t> I2CEEPROM::read(uint32_t mem_addr, size_t n_bytes)
+{
+    vector<uint8_t> result(n_bytes);
+
+    read(mem_addr, result.data(), result.size());
+
+    return result;
+}
+
+size_t I2CEEPROM::wait_ready()
+{
+    return poll_until_acked(0);
+}
+
+size_t I2CEEPROM::prepare_page(uint32_t mem_addr, const uint8_t *data, size_t data_len) noexcept
+{
+    size_t page_len = min(layout.page_size - mem_addr % layout.page_size, data_len);
+
+    encode_mem_addr(page_buffer.data(), mem_addr, layout.address_len);
+    copy_n(data, page_len, page_buffer.begin() + layout.address_len);
+
+    return page_len;
+}
+
+size_t I2CEEPROM::poll_until_acked(size_t len)
+{
+    Clock::time_point deadline = Clock::now() + layout.write_cycle_time;
+    size_t nacks = 0;
+
+    while (true) {
+        esp_err_t err = len > 0
+                ? master->try_write(i2c_addr, page_buffer.data(), len).error()
+                : master->try_probe(i2c_addr).error();
+        if (err == ESP_OK) {
+            return nacks;
+        }
+
+        // A busy device doesn't acknowledge its address, any other error is a real failure. The driver can't tell
+        // a NACK of a data byte apart, so a device rejecting the data ends in the timeout below.
+        if (err != ESP_FAIL) {
+            throw I2CTransferException(err);
+        }
+        if (Clock::now() >= deadline) {
+            throw I2CTransferException(ESP_ERR_TIMEOUT);
+        }
+
+        nacks++;
+    }
+}
+
+} // idf
+
+#endif // __cpp_exceptions
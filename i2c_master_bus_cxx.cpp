@@ -0,0 +1,353 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cpp_exceptions
+
+#include <cstdint>
+#include "esp_attr.h"
+#include "driver/i2c_master.h"
+#include "i2c_master_bus_cxx.hpp"
+#include "i2c_private_cxx.hpp"
+
+using namespace std;
+
+namespace idf {
+
+namespace {
+
+/**
+ * Glitches on the lines shorter than this number of clock cycles of the peripheral are ignored.
+ */
+const uint8_t GLITCH_IGNORE_COUNT = 7;
+
+/**
+ * Start a write, a read or a write-read transfer, depending on which lengths aren't 0.
+ */
+esp_err_t start_transfer(i2c_master_dev_handle_t handle,
+        const uint8_t *write_data,
+        size_t write_len,
+        uint8_t *read_buffer,
+        size_t read_len,
+        chrono::milliseconds timeout)
+{
+    int timeout_ms = static_cast<int>(timeout.count());
+
+    if (write_len > 0 && read_len > 0) {
+        return i2c_master_transmit_receive(handle, write_data, write_len, read_buffer, read_len, timeout_ms);
+    } else if (write_len > 0) {
+        return i2c_master_transmit(handle, write_data, write_len, timeout_ms);
+    } else {
+        return i2c_master_receive(handle, read_buffer, read_len, timeout_ms);
+    }
+}
+
+void check_buffer(const uint8_t *buffer, size_t len)
+{
+    if (!buffer || len == 0) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+}
+
+} // namespace
+
+/**
+ * Forwards the events of the driver to the device they belong to.
+ */
+struct I2CMasterDeviceISR {
+    static IRAM_ATTR bool on_trans_done(i2c_master_dev_handle_t dev_handle,
+            const i2c_master_event_data_t *event_data,
+            void *arg)
+    {
+        esp_err_t result;
+
+        switch (event_data->event) {
+        case I2C_EVENT_ALIVE:
+            // still in progress
+            return false;
+        case I2C_EVENT_DONE:
+            result = ESP_OK;
+            break;
+        default:
+            // report a missing acknowledge like the legacy driver
+            result = ESP_FAIL;
+            break;
+        }
+
+        return static_cast<I2CMasterDevice*>(arg)->complete(result);
+    }
+};
+
+const chrono::milliseconds I2CMasterBus::SYNC_TIMEOUT(1000);
+
+I2CMasterBus::I2CMasterBus(I2CNumber i2c_number,
+        SCL_GPIO scl_gpio,
+        SDA_GPIO sda_gpio,
+        size_t queue_depth_arg,
+        bool pullup)
+    : I2CBus(std::move(i2c_number)), handle(nullptr), queue_depth(queue_depth_arg)
+{
+    // the completion positions of the devices wrap modulo twice the queue depth
+    if (queue_depth > SIZE_MAX / 2) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    i2c_master_bus_config_t config = {};
+    config.i2c_port = i2c_num.get_value<i2c_port_num_t>();
+    config.sda_io_num = static_cast<gpio_num_t>(sda_gpio.get_value());
+    config.scl_io_num = static_cast<gpio_num_t>(scl_gpio.get_value());
+    config.clk_source = I2C_CLK_SRC_DEFAULT;
+    config.glitch_ignore_cnt = GLITCH_IGNORE_COUNT;
+    config.trans_queue_depth = queue_depth;
+    config.flags.enable_internal_pullup = pullup;
+    I2C_CHECK_THROW(i2c_new_master_bus(&config, &handle));
+}
+
+I2CMasterBus::~I2CMasterBus()
+{
+    i2c_del_master_bus(handle);
+}
+
+bool I2CMasterBus::is_async() const noexcept
+{
+    return queue_depth > 0;
+}
+
+size_t I2CMasterBus::get_queue_depth() const noexcept
+{
+    return queue_depth;
+}
+
+bool I2CMasterBus::probe(I2CAddress i2c_addr, chrono::milliseconds timeout)
+{
+    esp_err_t err = i2c_master_probe(handle, i2c_addr.get_value(), static_cast<int>(timeout.count()));
+    if (err == ESP_ERR_NOT_FOUND) {
+        return false;
+    }
+
+    throw_i2c_error(err);
+    return true;
+}
+
+void I2CMasterBus::reset()
+{
+    throw_i2c_error(i2c_master_bus_reset(handle));
+}
+
+void I2CMasterBus::wait_all_done(chrono::milliseconds timeout)
+{
+    throw_i2c_error(i2c_master_bus_wait_all_done(handle, static_cast<int>(timeout.count())));
+}
+
+I2CMasterDevice::I2CMasterDevice(shared_ptr<I2CMasterBus> bus_arg, I2CAddress i2c_addr_arg, Frequency scl_speed)
+    : i2c_addr(i2c_addr_arg), bus(std::move(bus_arg)), handle(nullptr), completions(), ring(nullptr),
+    queue_depth(bus ? bus->queue_depth : 0), queued(0), completed(0), queue_mutex()
+{
+    if (!bus) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    if (bus->is_async()) {
+        completions.reset(new Completion[queue_depth]);
+        ring = completions.get();
+    }
+
+    i2c_device_config_t config = {};
+    config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+    config.device_address = i2c_addr.get_value();
+    config.scl_speed_hz = scl_speed.get_value();
+    I2C_CHECK_THROW(i2c_master_bus_add_device(bus->handle, &config, &handle));
+
+    if (bus->is_async()) {
+        i2c_master_event_callbacks_t callbacks = {};
+        callbacks.on_trans_done = &I2CMasterDeviceISR::on_trans_done;
+        esp_err_t err = i2c_master_register_event_callbacks(handle, &callbacks, this);
+        if (err != ESP_OK) {
+            i2c_master_bus_rm_device(handle);
+            throw I2CException(err);
+        }
+    }
+}
+
+I2CMasterDevice::~I2CMasterDevice()
+{
+    // the driver must not access the buffers or call back into this object after it is gone
+    if (pending() > 0) {
+        i2c_master_bus_wait_all_done(bus->handle, -1);
+    }
+
+    i2c_master_bus_rm_device(handle);
+}
+
+void I2CMasterDevice::sync_write(const uint8_t *data, size_t data_len)
+{
+    check_buffer(data, data_len);
+    execute(data, data_len, nullptr, 0);
+}
+
+void I2CMasterDevice::sync_write(const vector<uint8_t> &data)
+{
+    sync_write(data.data(), data.size());
+}
+
+void I2CMasterDevice::sync_read(uint8_t *buffer, size_t buffer_len)
+{
+    check_buffer(buffer, buffer_len);
+    execute(nullptr, 0, buffer, buffer_len);
+}
+
+vector<uint8_t> I2CMasterDevice::sync_read(size_t n_bytes)
+{
+    vector<uint8_t> result(n_bytes);
+
+    sync_read(result.data(), result.size());
+
+    return result;
+}
+
+void I2CMasterDevice::sync_transfer(const uint8_t *write_data, size_t write_len, uint8_t *read_buffer, size_t read_len)
+{
+    check_buffer(write_data, write_len);
+    check_buffer(read_buffer, read_len);
+    execute(write_data, write_len, read_buffer, read_len);
+}
+
+vector<uint8_t> I2CMasterDevice::sync_transfer(const vector<uint8_t> &write_data, size_t read_n_bytes)
+{
+    vector<uint8_t> result(read_n_bytes);
+
+    sync_transfer(write_data.data(), write_data.size(), result.data(), result.size());
+
+    return result;
+}
+
+void I2CMasterDevice::async_write(const uint8_t *data, size_t data_len, I2CDoneCallback on_done, void *user_data)
+{
+    check_buffer(data, data_len);
+
+    lock_guard<mutex> lock(queue_mutex);
+    queue(data, data_len, nullptr, 0, on_done, user_data);
+}
+
+void I2CMasterDevice::async_read(uint8_t *buffer, size_t buffer_len, I2CDoneCallback on_done, void *user_data)
+{
+    check_buffer(buffer, buffer_len);
+
+    lock_guard<mutex> lock(queue_mutex);
+    queue(nullptr, 0, buffer, buffer_len, on_done, user_data);
+}
+
+void I2CMasterDevice::async_transfer(const uint8_t *write_data,
+        size_t write_len,
+        uint8_t *read_buffer,
+        size_t read_len,
+        I2CDoneCallback on_done,
+        void *user_data)
+{
+    check_buffer(write_data, write_len);
+    check_buffer(read_buffer, read_len);
+
+    lock_guard<mutex> lock(queue_mutex);
+    queue(write_data, write_len, read_buffer, read_len, on_done, user_data);
+}
+
+size_t I2CMasterDevice::pending() const noexcept
+{
+    // load completed first, so the queue position can't be behind it
+    size_t done = completed.load(memory_order_acquire);
+    return used(done, queued.load(memory_order_acquire));
+}
+
+void I2CMasterDevice::wait_all_done(chrono::milliseconds timeout)
+{
+    bus->wait_all_done(timeout);
+}
+
+size_t I2CMasterDevice::queue(const uint8_t *write_data,
+        size_t write_len,
+        uint8_t *read_buffer,
+        size_t read_len,
+        I2CDoneCallback on_done,
+        void *user_data)
+{
+    if (!bus->is_async()) {
+        throw I2CException(ESP_ERR_INVALID_STATE);
+    }
+
+    size_t index = queued.load(memory_order_relaxed);
+    if (used(completed.load(memory_order_acquire), index) == queue_depth) {
+        throw I2CException(ESP_ERR_NO_MEM);
+    }
+
+    // The completion has to be published before the driver is called, the interrupt may fire right away.
+    ring[slot(index)] = {on_done, user_data, ESP_OK};
+    queued.store(next(index), memory_order_release);
+
+    esp_err_t err = start_transfer(handle,
+            write_data,
+            write_len,
+            read_buffer,
+            read_len,
+            I2CMasterBus::SYNC_TIMEOUT);
+    if (err != ESP_OK) {
+        queued.store(index, memory_order_release);
+        throw_i2c_error(err);
+    }
+
+    return index;
+}
+
+void I2CMasterDevice::execute(const uint8_t *write_data, size_t write_len, uint8_t *read_buffer, size_t read_len)
+{
+    if (!bus->is_async()) {
+        throw_i2c_error(start_transfer(handle,
+                write_data,
+                write_len,
+                read_buffer,
+                read_len,
+                I2CMasterBus::SYNC_TIMEOUT));
+        return;
+    }
+
+    // The lock keeps other transfers from reusing the completion before its result has been read.
+    lock_guard<mutex> lock(queue_mutex);
+    size_t index = queue(write_data, write_len, read_buffer, read_len, nullptr, nullptr);
+
+    // The buffers may be on the caller's stack, so the driver's own timeout has to end the transfer.
+    throw_i2c_error(i2c_master_bus_wait_all_done(bus->handle, -1));
+    throw_i2c_error(ring[slot(index)].result);
+}
+
+IRAM_ATTR bool I2CMasterDevice::complete(esp_err_t result) noexcept
+{
+    size_t index = completed.load(memory_order_relaxed);
+    Completion &completion = ring[slot(index)];
+    I2CDoneCallback on_done = completion.on_done;
+    void *user_data = completion.user_data;
+
+    completion.result = result;
+    completed.store(next(index), memory_order_release);
+
+    return on_done ? on_done(result, user_data) : false;
+}
+
+IRAM_ATTR size_t I2CMasterDevice::next(size_t pos) const noexcept
+{
+    return pos + 1 == 2 * queue_depth ? 0 : pos + 1;
+}
+
+size_t I2CMasterDevice::used(size_t done_pos, size_t queued_pos) const noexcept
+{
+    return queued_pos >= done_pos ? queued_pos - done_pos : 2 * queue_depth - done_pos + queued_pos;
+}
+
+IRAM_ATTR size_t I2CMasterDevice::slot(size_t pos) const noexcept
+{
+    return pos >= queue_depth ? pos - queue_depth : pos;
+}
+
+} // idf
+
+#endif // __cpp_exceptions
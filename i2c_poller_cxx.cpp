@@ -0,0 +1,171 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cpp_exceptions
+
+#include <algorithm>
+#include "i2c_poller_cxx.hpp"
+#include "i2c_private_cxx.hpp"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/FreeRTOS.h"
+#endif
+
+using namespace std;
+
+namespace idf {
+
+size_t I2CPollSchedule::add_read(shared_ptr<I2CMaster> master,
+        I2CAddress i2c_addr,
+        size_t read_len,
+        chrono::milliseconds period)
+{
+    return add_read(std::move(master), i2c_addr, vector<uint8_t>(), read_len, period);
+}
+
+size_t I2CPollSchedule::add_read(shared_ptr<I2CMaster> master,
+        I2CAddress i2c_addr,
+        vector<uint8_t> write_data,
+        size_t read_len,
+        chrono::milliseconds period)
+{
+    if (!master || read_len == 0 || period <= chrono::milliseconds(0)) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    entries.push_back({std::move(master), i2c_addr, std::move(write_data), read_len, period});
+    return entries.size() - 1;
+}
+
+size_t I2CPollSchedule::size() const noexcept
+{
+    return entries.size();
+}
+
+I2CPoller::I2CPoller(const I2CPollSchedule &schedule, SampleCallback on_sample_arg, const I2CPollerConfig &config)
+    : entries(schedule.entries),
+    on_sample(std::move(on_sample_arg)),
+    buses(),
+    stop_mutex(),
+    stop_signal(),
+    stop_requested(false),
+    sample_count(0),
+    missed_count(0)
+{
+    if (entries.empty() || !on_sample) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    for (size_t id = 0; id < entries.size(); id++) {
+        const I2CPollSchedule::Entry &entry = entries[id];
+        auto bus = find_if(buses.begin(), buses.end(), [&entry](const unique_ptr<Bus> &candidate) {
+            return candidate->master == entry.master;
+        });
+        if (bus == buses.end()) {
+            buses.emplace_back(new Bus());
+            bus = buses.end() - 1;
+            (*bus)->master = entry.master;
+        }
+
+        (*bus)->ids.push_back(id);
+        (*bus)->offsets.push_back((*bus)->buffer.size());
+        (*bus)->buffer.resize((*bus)->buffer.size() + entry.read_len);
+    }
+
+    try {
+        for (size_t i = 0; i < buses.size(); i++) {
+#if !CONFIG_IDF_TARGET_LINUX
+            int core_id = config.pin_to_cores ? static_cast<int>(i % portNUM_PROCESSORS) : -1;
+            PthreadConfigGuard cfg_guard(config.stack_size, config.priority, core_id, "i2c_poller");
+#endif
+            Bus &bus = *buses[i];
+            bus.thread = thread(&I2CPoller::run, this, ref(bus));
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+}
+
+I2CPoller::~I2CPoller()
+{
+    stop();
+}
+
+size_t I2CPoller::get_bus_count() const noexcept
+{
+    return buses.size();
+}
+
+size_t I2CPoller::get_sample_count() const noexcept
+{
+    return sample_count;
+}
+
+size_t I2CPoller::get_missed_count() const noexcept
+{
+    return missed_count;
+}
+
+void I2CPoller::stop() noexcept
+{
+    {
+        lock_guard<mutex> lock(stop_mutex);
+        stop_requested = true;
+    }
+    stop_signal.notify_all();
+
+    for (unique_ptr<Bus> &bus : buses) {
+        if (bus->thread.joinable()) {
+            bus->thread.join();
+        }
+    }
+}
+
+void I2CPoller::run(Bus &bus)
+{
+    vector<Clock::time_point> due(bus.ids.size(), Clock::now());
+
+    unique_lock<mutex> lock(stop_mutex);
+    while (true) {
+        size_t next = min_element(due.begin(), due.end()) - due.begin();
+        if (stop_signal.wait_until(lock, due[next], [this]() { return stop_requested; })) {
+            return;
+        }
+        lock.unlock();
+
+        const I2CPollSchedule::Entry &entry = entries[bus.ids[next]];
+        uint8_t *buffer = bus.buffer.data() + bus.offsets[next];
+
+        Clock::time_point start = Clock::now();
+        I2CResult<> result = entry.write_data.empty()
+                ? bus.master->try_read(entry.i2c_addr, buffer, entry.read_len)
+                : bus.master->try_transfer(entry.i2c_addr,
+                        entry.write_data.data(),
+                        entry.write_data.size(),
+                        buffer,
+                        entry.read_len);
+
+        sample_count++;
+        on_sample(I2CSample {bus.ids[next],
+                start,
+                result.error(),
+                I2CByteView(buffer, result.ok() ? entry.read_len : 0)});
+
+        due[next] += entry.period;
+        Clock::time_point now = Clock::now();
+        if (now - due[next] >= entry.period) {
+            size_t behind = (now - due[next]) / entry.period;
+            missed_count += behind;
+            due[next] += entry.period * behind;
+        }
+
+        lock.lock();
+    }
+}
+
+} // idf
+
+#endif // __cpp_exceptions
@@ -0,0 +1,238 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cpp_exceptions
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "i2c_slave_stream_cxx.hpp"
+#include "i2c_private_cxx.hpp"
+
+using namespace std;
+
+namespace idf {
+
+I2CRingBuffer::I2CRingBuffer(size_t capacity)
+    : buffer(), buffer_size(capacity), written(0), consumed(0)
+{
+    // the positions count up to twice the capacity
+    if (capacity == 0 || capacity > SIZE_MAX / 2) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    buffer.reset(new uint8_t[capacity]);
+}
+
+size_t I2CRingBuffer::capacity() const noexcept
+{
+    return buffer_size;
+}
+
+size_t I2CRingBuffer::size() const noexcept
+{
+    // load consumed first, so the write position can't be behind it
+    size_t read_pos = consumed.load(memory_order_acquire);
+    return used(read_pos, written.load(memory_order_acquire));
+}
+
+uint8_t *I2CRingBuffer::prepare(size_t &free_len) noexcept
+{
+    size_t write_pos = written.load(memory_order_relaxed);
+    size_t write_offset = offset(write_pos);
+
+    free_len = min(buffer_size - used(consumed.load(memory_order_acquire), write_pos), buffer_size - write_offset);
+    return buffer.get() + write_offset;
+}
+
+void I2CRingBuffer::commit(size_t len)
+{
+    size_t free_len;
+    prepare(free_len);
+    if (len > free_len) {
+        throw I2CException(ESP_ERR_INVALID_SIZE);
+    }
+
+    written.store(advance(written.load(memory_order_relaxed), len), memory_order_release);
+}
+
+size_t I2CRingBuffer::write(const uint8_t *data, size_t len) noexcept
+{
+    size_t copied = 0;
+
+    // at most two regions: up to the end of the buffer and after the wrap-around
+    for (int region = 0; region < 2 && copied < len; region++) {
+        size_t free_len;
+        uint8_t *dest = prepare(free_len);
+        size_t chunk = min(free_len, len - copied);
+        memcpy(dest, data + copied, chunk);
+        written.store(advance(written.load(memory_order_relaxed), chunk), memory_order_release);
+        copied += chunk;
+    }
+
+    return copied;
+}
+
+I2CByteView I2CRingBuffer::peek() const noexcept
+{
+    size_t read_pos = consumed.load(memory_order_relaxed);
+    size_t read_offset = offset(read_pos);
+
+    return I2CByteView(buffer.get() + read_offset,
+            min(used(read_pos, written.load(memory_order_acquire)), buffer_size - read_offset));
+}
+
+void I2CRingBuffer::consume(size_t len)
+{
+    size_t read_pos = consumed.load(memory_order_relaxed);
+    if (len > used(read_pos, written.load(memory_order_acquire))) {
+        throw I2CException(ESP_ERR_INVALID_SIZE);
+    }
+
+    consumed.store(advance(read_pos, len), memory_order_release);
+}
+
+size_t I2CRingBuffer::read(uint8_t *data, size_t len) noexcept
+{
+    size_t copied = 0;
+
+    for (int region = 0; region < 2 && copied < len; region++) {
+        I2CByteView view = peek();
+        size_t chunk = min(view.size(), len - copied);
+        memcpy(data + copied, view.data(), chunk);
+        consumed.store(advance(consumed.load(memory_order_relaxed), chunk), memory_order_release);
+        copied += chunk;
+    }
+
+    return copied;
+}
+
+size_t I2CRingBuffer::advance(size_t pos, size_t len) const noexcept
+{
+    // pos + len may overflow for large capacities, the distance to the wrap-around can't
+    size_t to_wrap = 2 * buffer_size - pos;
+    return len >= to_wrap ? len - to_wrap : pos + len;
+}
+
+size_t I2CRingBuffer::used(size_t read_pos, size_t write_pos) const noexcept
+{
+    return write_pos >= read_pos ? write_pos - read_pos : 2 * buffer_size - read_pos + write_pos;
+}
+
+size_t I2CRingBuffer::offset(size_t pos) const noexcept
+{
+    return pos >= buffer_size ? pos - buffer_size : pos;
+}
+
+#if CONFIG_SOC_I2C_SUPPORT_SLAVE
+
+namespace {
+
+/**
+ * Time the receive task waits for the application to consume data if the ring buffer is full, or after a driver
+ * error.
+ */
+const chrono::milliseconds RETRY_DELAY(10);
+
+} // namespace
+
+const chrono::milliseconds I2CSlaveStream::RECEIVE_TIMEOUT(100);
+
+I2CSlaveStream::I2CSlaveStream(shared_ptr<I2CSlave> slave_arg,
+        const I2CSlaveStreamConfig &config,
+        ReceiveCallback on_receive_arg)
+    : slave(std::move(slave_arg)),
+    ring(config.buffer_size),
+    on_receive(std::move(on_receive_arg)),
+    notify_mutex(),
+    data_available(),
+    stop_requested(false)
+{
+    if (!slave) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    PthreadConfigGuard cfg_guard(config.stack_size, config.priority, config.core_id, "i2c_slave_rx");
+#endif
+    receive_thread = thread(&I2CSlaveStream::run, this);
+}
+
+I2CSlaveStream::~I2CSlaveStream()
+{
+    stop_requested = true;
+    receive_thread.join();
+}
+
+size_t I2CSlaveStream::available() const noexcept
+{
+    return ring.size();
+}
+
+I2CByteView I2CSlaveStream::peek() const noexcept
+{
+    return ring.peek();
+}
+
+void I2CSlaveStream::consume(size_t len)
+{
+    ring.consume(len);
+}
+
+size_t I2CSlaveStream::read(uint8_t *buffer, size_t len) noexcept
+{
+    return ring.read(buffer, len);
+}
+
+bool I2CSlaveStream::wait(chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(notify_mutex);
+    return data_available.wait_for(lock, timeout, [this]() { return ring.size() > 0; });
+}
+
+void I2CSlaveStream::run()
+{
+    while (!stop_requested) {
+        size_t free_len;
+        uint8_t *region = ring.prepare(free_len);
+        if (free_len == 0) {
+            this_thread::sleep_for(RETRY_DELAY);
+            continue;
+        }
+
+        // block until the master starts writing, then take everything the driver has received so far
+        int received = slave->read_raw(region, 1, RECEIVE_TIMEOUT);
+        if (received < 0) {
+            this_thread::sleep_for(RETRY_DELAY);
+        }
+        if (received <= 0) {
+            continue;
+        }
+        ring.commit(received);
+
+        region = ring.prepare(free_len);
+        while (free_len > 0 && (received = slave->read_raw(region, free_len, chrono::milliseconds(0))) > 0) {
+            ring.commit(received);
+            region = ring.prepare(free_len);
+        }
+
+        {
+            // Taking the lock orders the notification after the predicate check of a thread entering wait().
+            lock_guard<mutex> lock(notify_mutex);
+        }
+        data_available.notify_all();
+
+        if (on_receive) {
+            on_receive(*this);
+        }
+    }
+}
+
+#endif // CONFIG_SOC_I2C_SUPPORT_SLAVE
+
+} // idf
+
+#endif // __cpp_exceptions
@@ -0,0 +1,381 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cpp_exceptions
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "esp_timer.h"
+#include "i2c_trace_cxx.hpp"
+#include "i2c_private_cxx.hpp"
+
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+
+using namespace std;
+
+namespace idf {
+
+namespace {
+
+const uint8_t LOG_MAGIC[] = {'I', '2', 'C', 'T'};
+
+/**
+ * A command of a transaction in the replayed log.
+ */
+struct ReplayOp {
+    I2CTraceOpType type;
+    size_t len;
+
+    /**
+     * The written or read bytes inside the log.
+     */
+    const uint8_t *data;
+};
+
+/**
+ * A transaction in the replayed log.
+ */
+struct ReplayTransaction {
+    uint8_t port;
+    esp_err_t result;
+    uint32_t delay_us;
+    uint32_t duration_us;
+    vector<ReplayOp> ops;
+};
+
+struct TraceState {
+    mutex state_mutex;
+
+    atomic<bool> recording;
+    atomic<bool> replaying;
+
+    I2CTrace::Sink sink;
+
+    /**
+     * Start of the last recorded transaction, or of the recording.
+     */
+    int64_t last_start_us;
+
+    vector<uint8_t> log;
+    vector<ReplayTransaction> transactions;
+    size_t next_transaction;
+    I2CReplayTiming timing;
+    chrono::steady_clock::time_point replay_start;
+
+    /**
+     * Start of the last replayed transaction relative to \c replay_start.
+     */
+    chrono::microseconds replay_offset;
+};
+
+TraceState &trace_state()
+{
+    static TraceState state;
+    return state;
+}
+
+void append_u8(vector<uint8_t> &out, uint8_t value)
+{
+    out.push_back(value);
+}
+
+void append_u16(vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+void append_u32(vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((value >> (8 * i)) & 0xff);
+    }
+}
+
+/**
+ * Reads the numbers of the log, throws I2CException with ESP_ERR_INVALID_ARG at the end of the log.
+ */
+class LogReader {
+public:
+    explicit LogReader(const vector<uint8_t> &log) : log(log), pos(0) { }
+
+    bool at_end() const
+    {
+        return pos == log.size();
+    }
+
+    const uint8_t *take(size_t len)
+    {
+        if (len > log.size() - pos) {
+            throw I2CException(ESP_ERR_INVALID_ARG);
+        }
+
+        const uint8_t *data = log.data() + pos;
+        pos += len;
+        return data;
+    }
+
+    uint8_t u8()
+    {
+        return *take(1);
+    }
+
+    uint16_t u16()
+    {
+        const uint8_t *data = take(2);
+        return data[0] | data[1] << 8;
+    }
+
+    uint32_t u32()
+    {
+        const uint8_t *data = take(4);
+        return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8
+                | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+    }
+
+private:
+    const vector<uint8_t> &log;
+    size_t pos;
+};
+
+vector<ReplayTransaction> parse_log(const vector<uint8_t> &log)
+{
+    LogReader reader(log);
+
+    if (memcmp(reader.take(sizeof(LOG_MAGIC)), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0
+            || reader.u8() != I2CTrace::FORMAT_VERSION) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    vector<ReplayTransaction> transactions;
+    while (!reader.at_end()) {
+        ReplayTransaction transaction;
+        transaction.port = reader.u8();
+        transaction.result = static_cast<esp_err_t>(reader.u32());
+        transaction.delay_us = reader.u32();
+        transaction.duration_us = reader.u32();
+
+        size_t op_count = reader.u16();
+        for (size_t i = 0; i < op_count; i++) {
+            ReplayOp op = {static_cast<I2CTraceOpType>(reader.u8()), 0, nullptr};
+            switch (op.type) {
+            case I2CTraceOpType::WRITE:
+            case I2CTraceOpType::READ:
+                op.len = reader.u32();
+                op.data = reader.take(op.len);
+                break;
+            case I2CTraceOpType::START:
+            case I2CTraceOpType::STOP:
+                break;
+            default:
+                throw I2CException(ESP_ERR_INVALID_ARG);
+            }
+            transaction.ops.push_back(op);
+        }
+
+        transactions.push_back(std::move(transaction));
+    }
+
+    return transactions;
+}
+
+bool matches(const ReplayTransaction &transaction, I2CNumber i2c_num, const vector<I2CTraceOp> &ops)
+{
+    if (transaction.port != i2c_num.get_value() || transaction.ops.size() != ops.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        const ReplayOp &recorded = transaction.ops[i];
+        if (recorded.type != ops[i].type || recorded.len != ops[i].len) {
+            return false;
+        }
+
+        if (ops[i].type == I2CTraceOpType::WRITE) {
+            const uint8_t *written = ops[i].write_data ? ops[i].write_data : &ops[i].byte;
+            if (memcmp(recorded.data, written, recorded.len) != 0) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+void I2CTrace::start_recording(Sink sink)
+{
+    if (!sink) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    TraceState &state = trace_state();
+    lock_guard<mutex> lock(state.state_mutex);
+    if (state.recording || state.replaying) {
+        throw I2CException(ESP_ERR_INVALID_STATE);
+    }
+
+    state.sink = std::move(sink);
+    state.last_start_us = esp_timer_get_time();
+
+    vector<uint8_t> header(LOG_MAGIC, LOG_MAGIC + sizeof(LOG_MAGIC));
+    append_u8(header, FORMAT_VERSION);
+    state.sink(header.data(), header.size());
+
+    state.recording = true;
+}
+
+void I2CTrace::stop_recording() noexcept
+{
+    TraceState &state = trace_state();
+    lock_guard<mutex> lock(state.state_mutex);
+    state.recording = false;
+}
+
+bool I2CTrace::is_recording() noexcept
+{
+    return trace_state().recording;
+}
+
+void I2CTrace::start_replay(vector<uint8_t> log, I2CReplayTiming timing)
+{
+    vector<ReplayTransaction> transactions = parse_log(log);
+
+    TraceState &state = trace_state();
+    lock_guard<mutex> lock(state.state_mutex);
+    if (state.recording || state.replaying) {
+        throw I2CException(ESP_ERR_INVALID_STATE);
+    }
+
+    // moving the log keeps its data and the pointers into it valid
+    state.log = std::move(log);
+    state.transactions = std::move(transactions);
+    state.next_transaction = 0;
+    state.timing = timing;
+    state.replay_start = chrono::steady_clock::now();
+    state.replay_offset = chrono::microseconds(0);
+    state.replaying = true;
+}
+
+void I2CTrace::stop_replay() noexcept
+{
+    TraceState &state = trace_state();
+    lock_guard<mutex> lock(state.state_mutex);
+    state.replaying = false;
+    state.transactions.clear();
+    state.log.clear();
+}
+
+bool I2CTrace::is_replaying() noexcept
+{
+    return trace_state().replaying;
+}
+
+size_t I2CTrace::replay_remaining() noexcept
+{
+    TraceState &state = trace_state();
+    lock_guard<mutex> lock(state.state_mutex);
+    return state.transactions.size() - state.next_transaction;
+}
+
+void I2CTrace::record(I2CNumber i2c_num,
+        const vector<I2CTraceOp> &ops,
+        esp_err_t result,
+        int64_t start_us,
+        int64_t duration_us) noexcept
+{
+    TraceState &state = trace_state();
+
+    try {
+        vector<uint8_t> entry;
+        append_u8(entry, i2c_num.get_value<uint8_t>());
+        append_u32(entry, static_cast<uint32_t>(result));
+
+        lock_guard<mutex> lock(state.state_mutex);
+        if (!state.sink) {
+            return;
+        }
+
+        // Transactions of concurrent command links may be recorded after a later started one.
+        append_u32(entry, static_cast<uint32_t>(max<int64_t>(start_us - state.last_start_us, 0)));
+        append_u32(entry, static_cast<uint32_t>(duration_us));
+        state.last_start_us = max(state.last_start_us, start_us);
+
+        append_u16(entry, static_cast<uint16_t>(ops.size()));
+        for (const I2CTraceOp &op : ops) {
+            append_u8(entry, static_cast<uint8_t>(op.type));
+            if (op.type == I2CTraceOpType::WRITE) {
+                const uint8_t *written = op.write_data ? op.write_data : &op.byte;
+                append_u32(entry, op.len);
+                entry.insert(entry.end(), written, written + op.len);
+            } else if (op.type == I2CTraceOpType::READ) {
+                append_u32(entry, op.len);
+                entry.insert(entry.end(), op.read_data, op.read_data + op.len);
+            }
+        }
+
+        state.sink(entry.data(), entry.size());
+    } catch (const bad_alloc &) {
+        // a transaction missing in the log is preferred over failing the transaction itself
+    }
+}
+
+esp_err_t I2CTrace::replay(I2CNumber i2c_num, const vector<I2CTraceOp> &ops) noexcept
+{
+    TraceState &state = trace_state();
+    chrono::steady_clock::time_point finish;
+    esp_err_t result;
+
+    {
+        lock_guard<mutex> lock(state.state_mutex);
+        if (!state.replaying || state.next_transaction == state.transactions.size()) {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        const ReplayTransaction &transaction = state.transactions[state.next_transaction];
+        if (!matches(transaction, i2c_num, ops)) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        state.next_transaction++;
+
+        for (size_t i = 0; i < ops.size(); i++) {
+            if (ops[i].type == I2CTraceOpType::READ) {
+                memcpy(ops[i].read_data, transaction.ops[i].data, ops[i].len);
+            }
+        }
+        result = transaction.result;
+
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        chrono::microseconds duration(transaction.duration_us);
+        state.replay_offset += chrono::microseconds(transaction.delay_us);
+        switch (state.timing) {
+        case I2CReplayTiming::ORIGINAL:
+            finish = max(now, state.replay_start + state.replay_offset) + duration;
+            break;
+        case I2CReplayTiming::DURATION:
+            finish = now + duration;
+            break;
+        default:
+            finish = now;
+            break;
+        }
+    }
+
+    // the lock isn't held, so transactions on other buses can be replayed meanwhile
+    this_thread::sleep_until(finish);
+
+    return result;
+}
+
+} // idf
+
+#endif // CONFIG_ESP_IDF_CXX_I2C_TRACE
+
+#endif // __cpp_exceptions
@@ -0,0 +1,259 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef __cpp_exceptions
+#error I2C class can only be used when __cpp_exceptions is enabled. Enable CONFIG_COMPILER_CXX_EXCEPTIONS in Kconfig
+#endif
+
+#include <array>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "i2c_cxx.hpp"
+
+namespace idf {
+
+/**
+ * @brief Priority classes of the transfers scheduled by an \c I2CBusArbiter.
+ */
+enum class I2CPriority : size_t {
+    HIGH = 0,
+    NORMAL = 1,
+    LOW = 2,
+};
+
+/**
+ * @brief Configuration of an \c I2CBusArbiter and its task.
+ */
+struct I2CArbiterConfig {
+    /**
+     * Maximum number of waiting transfers per priority class, indexed by \c I2CPriority.
+     * If the queue of a class is full, submitting a transfer of that class blocks.
+     */
+    std::array<size_t, 3> queue_sizes = {{4, 8, 8}};
+
+    /**
+     * Stack size of the arbiter task in bytes.
+     */
+    size_t stack_size = 4096;
+
+    /**
+     * FreeRTOS priority of the arbiter task.
+     */
+    size_t priority = 5;
+
+    /**
+     * The core the arbiter task is pinned to, a negative value means no affinity.
+     */
+    int core_id = -1;
+};
+
+/**
+ * @brief Queue wait time statistics of one priority class.
+ */
+struct I2CQueueStats {
+    /**
+     * Number of executed bus transactions. Each page of a paged write counts as a transaction.
+     */
+    size_t transactions;
+
+    /**
+     * Number of transfers currently waiting.
+     */
+    size_t waiting;
+
+    /**
+     * Sum of the time the transactions waited between becoming ready and their execution.
+     */
+    std::chrono::microseconds total_wait;
+
+    /**
+     * Longest time a transaction waited between becoming ready and its execution.
+     */
+    std::chrono::microseconds max_wait;
+};
+
+/**
+ * @brief Executes the transfers to the devices of one I2C bus in order of their priority class.
+ *
+ * Transfers are queued in bounded FIFO queues, one for each \c I2CPriority, and executed one after another by the
+ * task of the arbiter. After each bus transaction, the arbiter continues with the oldest waiting transfer of the
+ * highest non-empty priority class. Long writes to paged memory submitted via \c paged_write() are split at the
+ * page boundaries, so transfers of higher classes can be executed between two pages. While a device stores a page,
+ * the bus is free for other transfers.
+ *
+ * @note All transfers on the bus have to be submitted to the arbiter, transfers issued directly on the
+ *      \c I2CMaster are still serialized only by the driver.
+ */
+class I2CBusArbiter {
+public:
+    /**
+     * @brief Create and start the arbiter task.
+     *
+     * @param master The master of the bus.
+     * @param config Queue sizes and task configuration.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c master is empty or a queue size is 0
+     * @throws std::exception for failures in libstdc++, e.g. if the task can't be created
+     */
+    explicit I2CBusArbiter(std::shared_ptr<I2CMaster> master, const I2CArbiterConfig &config = I2CArbiterConfig());
+
+    /**
+     * @brief Execute all transfers still waiting, then stop and join the arbiter task.
+     */
+    ~I2CBusArbiter();
+
+    I2CBusArbiter(const I2CBusArbiter&) = delete;
+    I2CBusArbiter &operator=(const I2CBusArbiter&) = delete;
+
+    /**
+     * @brief Queue a transfer in the class \c priority, block while the queue of the class is full.
+     *
+     * Requirements for TransferT: It should implement or imitate the interface of I2CTransfer.
+     *
+     * @param priority The priority class of the transfer.
+     * @param i2c_addr The address of the I2C slave device targeted by the transfer.
+     * @param xfer The transfer to execute.
+     *
+     * @return A future with \c TransferT::TransferReturnT, exceptions of the transfer are passed through it.
+     */
+    template<typename TransferT>
+    std::future<typename TransferT::TransferReturnT> transfer(I2CPriority priority,
+            I2CAddress i2c_addr,
+            std::shared_ptr<TransferT> xfer);
+
+    /**
+     * @brief Queue a write to paged memory, which is split into one bus transaction per page.
+     *
+     * Each transaction writes the memory address with \c layout.address_len bytes, followed by the data up to the
+     * next page boundary. The next page is written after \c layout.write_cycle_time has passed.
+     *
+     * @param priority The priority class of the write.
+     * @param i2c_addr The address of the I2C slave device.
+     * @param mem_addr The memory address of the first byte of \c data.
+     * @param data The data to write.
+     * @param layout The memory layout of the device.
+     *
+     * @return A future which is ready after the last page has been written, exceptions are passed through it.
+     *      If a page fails, the remaining pages are not written.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c data is empty, the page size is 0 or the address length
+     *      isn't between 1 and 4
+     */
+    std::future<void> paged_write(I2CPriority priority,
+            I2CAddress i2c_addr,
+            uint32_t mem_addr,
+            std::vector<uint8_t> data,
+            const I2CPageLayout &layout);
+
+    /**
+     * @return The queue wait time statistics of the class \c priority.
+     */
+    I2CQueueStats get_stats(I2CPriority priority) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * A queued transfer.
+     */
+    struct Job {
+        /**
+         * Executes the next bus transaction of the transfer, returns true if the transfer is finished.
+         * It must not throw, exceptions have to be passed to the caller via a future.
+         */
+        std::function<bool()> step;
+
+        /**
+         * Time to wait after a step before the next step may be executed.
+         */
+        std::chrono::milliseconds step_delay;
+
+        /**
+         * The time from which on the next step may be executed.
+         */
+        Clock::time_point ready_since;
+    };
+
+    /**
+     * @brief Append a job to the queue of \c priority, block while the queue is full.
+     */
+    void post(I2CPriority priority, std::function<bool()> step, std::chrono::milliseconds step_delay);
+
+    /**
+     * The loop running inside the arbiter task.
+     */
+    void run();
+
+    std::shared_ptr<I2CMaster> master;
+
+    const std::array<size_t, 3> queue_sizes;
+
+    /**
+     * The waiting jobs, indexed by \c I2CPriority.
+     */
+    std::array<std::deque<Job>, 3> queues;
+
+    /**
+     * The statistics, indexed by \c I2CPriority.
+     */
+    std::array<I2CQueueStats, 3> stats;
+
+    /**
+     * Protects \c queues, \c stats and \c stop_requested.
+     */
+    mutable std::mutex queue_mutex;
+
+    /**
+     * Signals new jobs and stop requests to the arbiter task.
+     */
+    std::condition_variable job_available;
+
+    /**
+     * Signals the removal of a job to the threads waiting in \c post().
+     */
+    std::condition_variable space_available;
+
+    bool stop_requested;
+
+    /**
+     * The arbiter task itself.
+     */
+    std::thread arbiter_thread;
+};
+
+template<typename TransferT>
+std::future<typename TransferT::TransferReturnT> I2CBusArbiter::transfer(I2CPriority priority,
+        I2CAddress i2c_addr,
+        std::shared_ptr<TransferT> xfer)
+{
+    if (!xfer) throw I2CException(ESP_ERR_INVALID_ARG);
+
+    typedef typename TransferT::TransferReturnT ReturnT;
+
+    I2CNumber i2c_num = master->i2c_num;
+    auto task = std::make_shared<std::packaged_task<ReturnT()> >([xfer, i2c_num, i2c_addr]() {
+        return xfer->do_transfer(i2c_num, i2c_addr);
+    });
+    std::future<ReturnT> result = task->get_future();
+
+    post(priority, [task]() {
+        (*task)();
+        return true;
+    }, std::chrono::milliseconds(0));
+
+    return result;
+}
+
+} // idf
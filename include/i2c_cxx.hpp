@@ -14,8 +14,17 @@
 #include <memory>
 #include <chrono>
 #include <vector>
-#include <list>
+#include <deque>
 #include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <bitset>
+#include <array>
+#include <tuple>
+#include <utility>
+#include <new>
 
 #include "sdkconfig.h"
 #include "esp_exception.hpp"
@@ -40,6 +49,16 @@ struct I2CTransferException : public I2CException {
     I2CTransferException(esp_err_t error);
 };
 
+/**
+ * @brief Throw the exception corresponding to the error of a failed I2C operation, do nothing for ESP_OK.
+ *
+ * @param error The error of the operation.
+ *
+ * @throws I2CException with ESP_ERR_INVALID_ARG if the operation failed due to invalid arguments
+ * @throws I2CTransferException with \c error for any other error
+ */
+void throw_i2c_error(esp_err_t error);
+
 /**
  * @brief Represents a valid SDA signal pin number.
  */
@@ -98,6 +117,45 @@ public:
     explicit I2CAddress(uint8_t addr);
 };
 
+class I2CCommandLinkPool;
+
+/**
+ * @brief Type of a command recorded in an \c I2CCommandLink.
+ */
+enum class I2CTraceOpType : uint8_t {
+    START = 0,
+    WRITE = 1,
+    READ = 2,
+    STOP = 3,
+};
+
+/**
+ * @brief A command recorded in an \c I2CCommandLink, as seen by \c I2CTrace.
+ */
+struct I2CTraceOp {
+    I2CTraceOpType type;
+
+    /**
+     * The byte of a single-byte write, used if \c write_data is nullptr.
+     */
+    uint8_t byte;
+
+    /**
+     * The data of a write.
+     */
+    const uint8_t *write_data;
+
+    /**
+     * The buffer of a read.
+     */
+    uint8_t *read_data;
+
+    /**
+     * The number of bytes written or read.
+     */
+    size_t len;
+};
+
 /**
  * @brief Low-level I2C transaction descriptor
  *
@@ -116,6 +174,41 @@ public:
      */
     I2CCommandLink();
 
+    /**
+     * @brief Create the transaction descriptor inside a caller-provided buffer, no heap allocation is done.
+     *
+     * @param buffer The buffer for the transaction descriptor. Must stay allocated until the destructor of this
+     *          class has been called.
+     * @param size The size of \c buffer in bytes. The driver's \c I2C_LINK_RECOMMENDED_SIZE() yields the
+     *          necessary size for a certain number of transactions.
+     *
+     * @throws I2CException with ESP_ERR_NO_MEM if the buffer is too small for the transaction descriptor.
+     */
+    I2CCommandLink(uint8_t *buffer, size_t size);
+
+    /**
+     * @brief Create the transaction descriptor inside a buffer taken from \c pool.
+     *
+     * The buffer is given back to the pool when this object is destroyed.
+     *
+     * @param pool The pool providing the buffer.
+     * @param timeout The maximum time to wait if all buffers of the pool are in use.
+     *
+     * @throws I2CException with ESP_ERR_NO_MEM if no buffer became available within \c timeout.
+     */
+    I2CCommandLink(I2CCommandLinkPool &pool, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Like the constructor above, but doesn't throw.
+     *
+     * If no buffer became available within \c timeout, the command link is invalid and all \c try_ methods
+     * return ESP_ERR_NO_MEM.
+     *
+     * @param pool The pool providing the buffer.
+     * @param timeout The maximum time to wait if all buffers of the pool are in use.
+     */
+    I2CCommandLink(I2CCommandLinkPool &pool, std::chrono::milliseconds timeout, const std::nothrow_t&) noexcept;
+
     /**
      * @brief Delete the transaction descriptor, de-allocate all resources.
      */
@@ -139,6 +232,17 @@ public:
      */
     void write(const std::vector<uint8_t> &bytes, bool expect_ack = true);
 
+    /**
+     * @brief Record a write of \c size bytes starting at \c bytes on the I2C bus.
+     *
+     * @param[in] bytes The data to be written. Must stay allocated until execute_transfer has finished or
+     *          destructor of this class has been called.
+     * @param[in] size The number of bytes to write.
+     * @param[in] expect_ack If acknowledgement shall be requested after each written byte, pass true,
+     *          otherwise false.
+     */
+    void write(const uint8_t *bytes, size_t size, bool expect_ack = true);
+
     /**
      * @brief Record a one-byte-write on the I2C bus.
      *
@@ -148,6 +252,14 @@ public:
      */
     void write_byte(uint8_t byte, bool expect_ack = true);
 
+    /**
+     * @brief Record the address byte of a device on the I2C bus, including the read/write bit.
+     *
+     * @param[in] i2c_addr The address of the device.
+     * @param[in] read Pass true to request a read from the device, false to request a write.
+     */
+    void write_address(I2CAddress i2c_addr, bool read);
+
     /**
      * @brief Record a read of the size of vector \c bytes on the I2C bus.
      *
@@ -158,6 +270,15 @@ public:
      */
     void read(std::vector<uint8_t> &bytes);
 
+    /**
+     * @brief Record a read of \c size bytes into the buffer \c bytes on the I2C bus.
+     *
+     * @param[in] bytes Buffer of at least \c size bytes for the data to be read. Must stay allocated until
+     *          execute_transfer has finished or destructor of this class has been called.
+     * @param[in] size The number of bytes to read.
+     */
+    void read(uint8_t *bytes, size_t size);
+
     /**
      * @brief Record a stop command on the I2C bus.
      */
@@ -174,11 +295,322 @@ public:
      */
     void execute_transfer(I2CNumber i2c_num, std::chrono::milliseconds driver_timeout);
 
+    /**
+     * @brief Like \c execute_transfer(), but return the driver error instead of throwing it.
+     *
+     * @param i2c_num I2C bus number on the chip.
+     * @param driver_timeout Timeout for this transaction.
+     *
+     * @return ESP_OK on success, otherwise the error of \c i2c_master_cmd_begin().
+     */
+    esp_err_t try_execute_transfer(I2CNumber i2c_num, std::chrono::milliseconds driver_timeout) noexcept;
+
+    /**
+     * @brief Like \c start(), but return the driver error instead of throwing it.
+     */
+    esp_err_t try_start() noexcept;
+
+    /**
+     * @brief Like \c write(), but return the driver error instead of throwing it.
+     */
+    esp_err_t try_write(const uint8_t *bytes, size_t size, bool expect_ack = true) noexcept;
+
+    /**
+     * @brief Like \c write_byte(), but return the driver error instead of throwing it.
+     */
+    esp_err_t try_write_byte(uint8_t byte, bool expect_ack = true) noexcept;
+
+    /**
+     * @brief Like \c write_address(), but return the driver error instead of throwing it.
+     */
+    esp_err_t try_write_address(I2CAddress i2c_addr, bool read) noexcept;
+
+    /**
+     * @brief Like \c read(), but return the driver error instead of throwing it.
+     */
+    esp_err_t try_read(uint8_t *bytes, size_t size) noexcept;
+
+    /**
+     * @brief Like \c stop(), but return the driver error instead of throwing it.
+     */
+    esp_err_t try_stop() noexcept;
+
 private:
+    /**
+     * @brief Create the transaction descriptor inside \c buffer, shared by the static constructors.
+     */
+    void create_static(uint8_t *buffer, size_t size);
+
+    /**
+     * @brief Create the driver's transaction descriptor, inside \c buffer if it isn't nullptr.
+     *
+     * @return The driver handle or nullptr if it couldn't be created.
+     */
+    void *create_handle(uint8_t *buffer, size_t size) noexcept;
+
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+    /**
+     * @brief Append \c op to \c trace_ops if the link is traced.
+     *
+     * @return ESP_ERR_NO_MEM if the command couldn't be stored, otherwise ESP_OK.
+     */
+    esp_err_t trace_op(const I2CTraceOp &op) noexcept;
+#endif
+
     /**
      * @brief Internal driver data.
      */
     void *handle;
+
+    /**
+     * @brief True if the transaction descriptor lives in a caller- or pool-provided buffer.
+     */
+    bool is_static;
+
+    /**
+     * @brief The pool the buffer has been taken from, if any.
+     */
+    I2CCommandLinkPool *pool;
+
+    /**
+     * @brief Index of the buffer inside \c pool.
+     */
+    size_t pool_index;
+
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    /**
+     * @brief The first address recorded by \c write_address(), the statistics are attributed to it.
+     */
+    int stats_address = -1;
+
+    /**
+     * @brief Number of data bytes recorded.
+     */
+    size_t stats_bytes = 0;
+#endif
+
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+    enum class TraceMode {
+        OFF,
+        RECORD,
+        REPLAY,
+    };
+
+    /**
+     * @brief The mode of \c I2CTrace when the link was created. During a replay, no driver handle exists.
+     */
+    TraceMode trace_mode = TraceMode::OFF;
+
+    /**
+     * @brief The recorded commands, only if \c trace_mode isn't OFF.
+     */
+    std::vector<I2CTraceOp> trace_ops;
+#endif
+};
+
+/**
+ * @brief Fixed-size pool of buffers for statically allocated command links.
+ *
+ * The buffers are allocated once during construction. Afterwards, creating an \c I2CCommandLink from the pool
+ * doesn't do any heap allocation. The capacity is set at compile time with
+ * CONFIG_ESP_IDF_CXX_I2C_CMD_LINK_POOL_SIZE, the number of transactions fitting into each command link with
+ * CONFIG_ESP_IDF_CXX_I2C_CMD_LINK_POOL_TRANSACTIONS.
+ */
+class I2CCommandLinkPool {
+    friend class I2CCommandLink;
+public:
+    /**
+     * The number of command link buffers in the pool.
+     */
+    static constexpr size_t CAPACITY = CONFIG_ESP_IDF_CXX_I2C_CMD_LINK_POOL_SIZE;
+
+    /**
+     * @brief Allocate all buffers of the pool.
+     *
+     * @throws std::bad_alloc if the buffers can't be allocated.
+     */
+    I2CCommandLinkPool();
+
+    I2CCommandLinkPool(const I2CCommandLinkPool&) = delete;
+    I2CCommandLinkPool &operator=(const I2CCommandLinkPool&) = delete;
+
+    /**
+     * @return The number of buffers which are currently not in use.
+     */
+    size_t available();
+
+private:
+    /**
+     * @brief Take a free buffer out of the pool, block up to \c timeout if all buffers are in use.
+     *
+     * @return The index of the buffer.
+     * @throws I2CException with ESP_ERR_NO_MEM if no buffer became available within \c timeout.
+     */
+    size_t acquire(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Like \c acquire(), but return ESP_ERR_NO_MEM instead of throwing it.
+     *
+     * @param timeout The maximum time to wait if all buffers are in use.
+     * @param[out] index The index of the buffer, only valid if ESP_OK is returned.
+     */
+    esp_err_t try_acquire(std::chrono::milliseconds timeout, size_t &index) noexcept;
+
+    /**
+     * @brief Give the buffer with \c index back to the pool.
+     */
+    void release(size_t index) noexcept;
+
+    /**
+     * @return The buffer with \c index.
+     */
+    uint8_t *buffer(size_t index) const noexcept;
+
+    /**
+     * Size of each buffer in bytes.
+     */
+    const size_t buffer_size;
+
+    /**
+     * The memory of all buffers.
+     */
+    std::unique_ptr<uint8_t[]> buffers;
+
+    /**
+     * A set bit marks a buffer which is in use.
+     */
+    std::bitset<CAPACITY> in_use;
+
+    /**
+     * Protects \c in_use.
+     */
+    std::mutex pool_mutex;
+
+    /**
+     * Signalled when a buffer is given back to the pool.
+     */
+    std::condition_variable buffer_released;
+};
+
+/**
+ * @brief Transfer statistics of a single I2C device.
+ */
+struct I2CAddressStats {
+    /**
+     * Number of histogram buckets. Bucket \c i counts latencies below (128 << i) microseconds which don't fit into
+     * a lower bucket, the last bucket counts all remaining latencies.
+     */
+    static constexpr size_t LATENCY_BUCKETS = 8;
+
+    /**
+     * The device address.
+     */
+    uint8_t address;
+
+    /**
+     * Number of executed command links, including failed ones.
+     */
+    uint32_t transactions;
+
+    /**
+     * Number of data bytes written and read, excluding address bytes.
+     */
+    uint64_t bytes;
+
+    /**
+     * Number of transactions failed with ESP_FAIL, which the driver returns if the device didn't acknowledge.
+     */
+    uint32_t nacks;
+
+    /**
+     * Number of transactions failed with ESP_ERR_TIMEOUT.
+     */
+    uint32_t timeouts;
+
+    /**
+     * Number of transactions failed with other errors.
+     */
+    uint32_t errors;
+
+    /**
+     * Sum of the latencies of all transactions in microseconds.
+     */
+    uint64_t total_latency_us;
+
+    /**
+     * The highest latency of a transaction in microseconds.
+     */
+    uint32_t max_latency_us;
+
+    /**
+     * Latency histogram, see \c LATENCY_BUCKETS.
+     */
+    std::array<uint32_t, LATENCY_BUCKETS> latency_histogram;
+};
+
+/**
+ * @brief Per-address transfer statistics of one I2C bus.
+ *
+ * Holds the statistics of up to a fixed number of device addresses, the memory is allocated once during
+ * construction. If CONFIG_ESP_IDF_CXX_I2C_STATS is enabled, the command links record their transactions in the
+ * statistics of their bus, available via \c I2CMaster::get_stats(). The methods are thread-safe.
+ */
+class I2CStatistics {
+public:
+    /**
+     * @param max_devices Maximum number of device addresses recorded.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c max_devices is 0
+     * @throws std::bad_alloc if the statistics can't be allocated.
+     */
+    explicit I2CStatistics(size_t max_devices);
+
+    I2CStatistics(const I2CStatistics&) = delete;
+    I2CStatistics &operator=(const I2CStatistics&) = delete;
+
+    /**
+     * @brief Record a transaction. If the address is new and all entries are in use, it is not recorded.
+     *
+     * @param address The device address.
+     * @param bytes The number of data bytes of the transaction.
+     * @param result The result of the transaction.
+     * @param latency_us The duration of the transaction in microseconds.
+     */
+    void record(uint8_t address, size_t bytes, esp_err_t result, uint32_t latency_us) noexcept;
+
+    /**
+     * @return The statistics of the device \c address, all counters are 0 if nothing has been recorded.
+     */
+    I2CAddressStats get(I2CAddress address) const;
+
+    /**
+     * @return Copies of the statistics of all recorded devices.
+     */
+    std::vector<I2CAddressStats> snapshot() const;
+
+    /**
+     * @brief Remove all recorded statistics.
+     */
+    void reset() noexcept;
+
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    /**
+     * @return The statistics of the bus \c i2c_num, which the command links record to.
+     */
+    static I2CStatistics &for_bus(I2CNumber i2c_num);
+#endif
+
+private:
+    const size_t max_devices;
+
+    /**
+     * Number of entries in use.
+     */
+    size_t used;
+
+    std::unique_ptr<I2CAddressStats[]> entries;
+
+    mutable std::mutex stats_mutex;
 };
 
 /**
@@ -216,7 +648,27 @@ public:
      */
     TReturn do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr);
 
+    /**
+     * Like \c do_transfer() above, but the command link is taken from \c pool instead of being allocated on the
+     * heap. The commands of the transfer have to fit into a pooled command link.
+     *
+     * @param pool The pool providing the command link.
+     * @param pool_timeout The maximum time to wait if all command links of the pool are in use.
+     *
+     * @throws I2CException for any particular I2C error, with ESP_ERR_NO_MEM if no command link became available
+     *      within \c pool_timeout or the transfer doesn't fit into it
+     */
+    TReturn do_transfer(I2CCommandLinkPool &pool,
+            std::chrono::milliseconds pool_timeout,
+            I2CNumber i2c_num,
+            I2CAddress i2c_addr);
+
 protected:
+    /**
+     * Record and execute the transfer on \c cmd_link, then process the result.
+     */
+    TReturn do_transfer(I2CCommandLink &cmd_link, I2CNumber i2c_num, I2CAddress i2c_addr);
+
     /**
      * Implementation of the I2C command is implemented by subclasses.
      * The I2C command handle is initialized already at this stage.
@@ -245,18 +697,323 @@ protected:
 };
 
 /**
- * @brief Super class for any I2C master or slave
+ * Superclass for transfer objects whose commands are dispatched without virtual calls.
+ *
+ * It provides the same interface as \c I2CTransfer, but the subclass passes itself as \c DerivedT (CRTP) and
+ * \c queue_cmd() and \c process_result() are resolved at compile time. Hence, the compiler can inline them into
+ * \c do_transfer(). The subclass implements both methods with the same signatures as in \c I2CTransfer, without
+ * \c virtual. If they are not public, the subclass has to declare this class as friend.
+ *
+ * Transfers derived from this class can't be used polymorphically. In return, they have no vtable and can be
+ * passed by value or by reference to \c I2CMaster::transfer(), which avoids the allocation of a \c std::shared_ptr.
  */
-class I2CBus {
+template<typename DerivedT, typename TReturn>
+class I2CInlineTransfer {
 public:
-    /*
-     * @brief Initialize I2C master bus.
-     *
-     * Initialize and install the bus driver in master mode.
-     *
-     * @param i2c_number The I2C port number.
+    /**
+     * Helper typedef to facilitate type resolution during calls to I2CMaster::transfer().
      */
-    explicit I2CBus(I2CNumber i2c_number);
+    typedef TReturn TransferReturnT;
+
+    /**
+     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     */
+    I2CInlineTransfer(std::chrono::milliseconds driver_timeout_arg = std::chrono::milliseconds(1000))
+        : driver_timeout(driver_timeout_arg) { }
+
+    /**
+     * Do all general parts of the I2C transfer, see \c I2CTransfer::do_transfer().
+     *
+     * @throws I2CException for any particular I2C error
+     */
+    TReturn do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr);
+
+    /**
+     * Like \c do_transfer() above, but the command link is taken from \c pool, see \c I2CTransfer::do_transfer().
+     *
+     * @throws I2CException for any particular I2C error, with ESP_ERR_NO_MEM if no command link became available
+     *      within \c pool_timeout or the transfer doesn't fit into it
+     */
+    TReturn do_transfer(I2CCommandLinkPool &pool,
+            std::chrono::milliseconds pool_timeout,
+            I2CNumber i2c_num,
+            I2CAddress i2c_addr);
+
+protected:
+    /**
+     * Not virtual, transfers must not be deleted through this class.
+     */
+    ~I2CInlineTransfer() { }
+
+    /**
+     * Record and execute the transfer on \c cmd_link, then process the result.
+     */
+    TReturn do_transfer(I2CCommandLink &cmd_link, I2CNumber i2c_num, I2CAddress i2c_addr);
+
+    /**
+     * For some calls to the underlying driver (e.g. \c i2c_master_cmd_begin() ), this general timeout will be passed.
+     */
+    std::chrono::milliseconds driver_timeout;
+};
+
+/**
+ * @brief Configuration of the worker task which executes the asynchronous transfers of an I2CMaster.
+ */
+struct I2CWorkerConfig {
+    /**
+     * Maximum number of transfers waiting for execution. If the queue is full, \c I2CMaster::transfer() blocks
+     * until the worker has taken the oldest transfer out of the queue.
+     */
+    size_t queue_size = 8;
+
+    /**
+     * Stack size of the worker task in bytes.
+     */
+    size_t stack_size = 4096;
+
+    /**
+     * FreeRTOS priority of the worker task.
+     */
+    size_t priority = 5;
+
+    /**
+     * The core the worker task is pinned to, a negative value means no affinity.
+     */
+    int core_id = -1;
+};
+
+/**
+ * @brief Long-lived task executing queued I2C transfers one after another.
+ *
+ * The worker is created once and takes jobs out of a bounded FIFO queue. This avoids creating a new task for each
+ * asynchronous transfer. Usually, it is not used directly but by \c I2CMaster if created with an
+ * \c I2CWorkerConfig.
+ */
+class I2CTransferWorker {
+public:
+    /**
+     * @brief Create and start the worker task.
+     *
+     * @param config Stack size, priority, core affinity and queue size of the worker.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the queue size is 0
+     * @throws std::exception for failures in libstdc++, e.g. if the task can't be created
+     */
+    explicit I2CTransferWorker(const I2CWorkerConfig &config);
+
+    /**
+     * @brief Execute all jobs still waiting in the queue, then stop and join the worker task.
+     */
+    ~I2CTransferWorker();
+
+    I2CTransferWorker(const I2CTransferWorker&) = delete;
+    I2CTransferWorker &operator=(const I2CTransferWorker&) = delete;
+
+    /**
+     * @brief Append a job to the queue, block while the queue is full.
+     *
+     * @param job The job to be executed in the worker task. It must not throw, results and exceptions have to be
+     *      passed to the caller by other means (e.g. \c std::packaged_task).
+     */
+    void post(std::function<void()> job);
+
+    /**
+     * @return The id of the thread executing the jobs.
+     */
+    std::thread::id get_id() const noexcept;
+
+private:
+    /**
+     * The loop running inside the worker task.
+     */
+    void run();
+
+    /**
+     * Maximum number of waiting jobs.
+     */
+    const size_t queue_size;
+
+    /**
+     * The waiting jobs.
+     */
+    std::deque<std::function<void()> > jobs;
+
+    /**
+     * Protects \c jobs and \c stop_requested.
+     */
+    std::mutex jobs_mutex;
+
+    /**
+     * Signalled when a job has been added or the worker has to stop.
+     */
+    std::condition_variable job_available;
+
+    /**
+     * Signalled when a job has been taken out of the queue.
+     */
+    std::condition_variable space_available;
+
+    /**
+     * Set in the destructor to ask the worker task to finish.
+     */
+    bool stop_requested;
+
+    /**
+     * The worker task itself.
+     */
+    std::thread worker_thread;
+};
+
+/**
+ * @brief Result of a non-throwing I2C operation: either a value of type \c T or an error.
+ *
+ * This is a lightweight replacement of \c std::expected, the error is an \c esp_err_t. Use \c value() to get the
+ * value or rather an exception if the operation failed.
+ */
+template<typename T = void>
+class I2CResult {
+public:
+    /**
+     * @brief Successful result with \c value.
+     */
+    I2CResult(T value) : err(ESP_OK), result(std::move(value)) { }
+
+    /**
+     * @brief Failed result with \c error, which must not be ESP_OK.
+     */
+    static I2CResult failure(esp_err_t error)
+    {
+        return I2CResult(error, T());
+    }
+
+    /**
+     * @return true if the operation succeeded.
+     */
+    bool ok() const noexcept
+    {
+        return err == ESP_OK;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ok();
+    }
+
+    /**
+     * @return ESP_OK on success, otherwise the error of the operation.
+     */
+    esp_err_t error() const noexcept
+    {
+        return err;
+    }
+
+    /**
+     * @return The value of a successful result.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the operation failed due to invalid arguments
+     * @throws I2CTransferException with the error of any other failed operation
+     */
+    T &value()
+    {
+        throw_i2c_error(err);
+        return result;
+    }
+
+    /**
+     * @return The value of a successful result.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the operation failed due to invalid arguments
+     * @throws I2CTransferException with the error of any other failed operation
+     */
+    const T &value() const
+    {
+        throw_i2c_error(err);
+        return result;
+    }
+
+    /**
+     * @return The value of a successful result, otherwise \c default_value.
+     */
+    T value_or(T default_value) const
+    {
+        return ok() ? result : default_value;
+    }
+
+private:
+    I2CResult(esp_err_t error, T value) : err(error), result(std::move(value)) { }
+
+    esp_err_t err;
+    T result;
+};
+
+/**
+ * @brief Result of a non-throwing I2C operation which has no value but may fail.
+ */
+template<>
+class I2CResult<void> {
+public:
+    /**
+     * @brief Result with \c error, ESP_OK for success.
+     */
+    I2CResult(esp_err_t error = ESP_OK) noexcept : err(error) { }
+
+    /**
+     * @brief Failed result with \c error, which must not be ESP_OK.
+     */
+    static I2CResult failure(esp_err_t error) noexcept
+    {
+        return I2CResult(error);
+    }
+
+    /**
+     * @return true if the operation succeeded.
+     */
+    bool ok() const noexcept
+    {
+        return err == ESP_OK;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ok();
+    }
+
+    /**
+     * @return ESP_OK on success, otherwise the error of the operation.
+     */
+    esp_err_t error() const noexcept
+    {
+        return err;
+    }
+
+    /**
+     * @brief Do nothing on success, otherwise throw.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the operation failed due to invalid arguments
+     * @throws I2CTransferException with the error of any other failed operation
+     */
+    void value() const
+    {
+        throw_i2c_error(err);
+    }
+
+private:
+    esp_err_t err;
+};
+
+/**
+ * @brief Super class for any I2C master or slave
+ */
+class I2CBus {
+public:
+    /*
+     * @brief Initialize I2C master bus.
+     *
+     * Initialize and install the bus driver in master mode.
+     *
+     * @param i2c_number The I2C port number.
+     */
+    explicit I2CBus(I2CNumber i2c_number);
 
     /**
      * @brief uninstall the bus driver.
@@ -269,6 +1026,124 @@ public:
     const I2CNumber i2c_num;
 };
 
+/**
+ * @brief A list of independent transfers to devices on the same bus, executed back-to-back by
+ * \c I2CMaster::sync_batch().
+ *
+ * Each entry is a write, a read or a write-read transfer with caller-owned buffers, which have to stay allocated
+ * and unchanged while the batch is executed. The entries are added once and the batch can be executed repeatedly,
+ * e.g. to poll a set of sensors. Each entry is recorded in turn into the same command link buffer owned by the
+ * batch and executed as a separate transfer, hence executing the batch doesn't allocate heap memory.
+ *
+ * A failing entry, e.g. a device not acknowledging its address, doesn't stop the batch. Its error is recorded and
+ * execution continues with the next entry.
+ */
+class I2CBatch {
+    friend class I2CMaster;
+public:
+    /**
+     * @brief Create an empty batch and allocate its command link buffer.
+     *
+     * @throws std::bad_alloc if the command link buffer can't be allocated.
+     */
+    I2CBatch();
+
+    I2CBatch(const I2CBatch&) = delete;
+    I2CBatch &operator=(const I2CBatch&) = delete;
+
+    /**
+     * @brief Append a write of \c data_len bytes from \c data to the device \c i2c_addr.
+     *
+     * @return The index of the entry.
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c data is nullptr or \c data_len is 0.
+     */
+    size_t add_write(I2CAddress i2c_addr, const uint8_t *data, size_t data_len);
+
+    /**
+     * @brief Append a read of \c buffer_len bytes into \c buffer from the device \c i2c_addr.
+     *
+     * @return The index of the entry.
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c buffer is nullptr or \c buffer_len is 0.
+     */
+    size_t add_read(I2CAddress i2c_addr, uint8_t *buffer, size_t buffer_len);
+
+    /**
+     * @brief Append a write-read transfer with repeated start to the device \c i2c_addr.
+     *
+     * @return The index of the entry.
+     * @throws I2CException with ESP_ERR_INVALID_ARG if one of the buffers is nullptr or has length 0.
+     */
+    size_t add_transfer(I2CAddress i2c_addr,
+            const uint8_t *write_data,
+            size_t write_len,
+            uint8_t *read_buffer,
+            size_t read_len);
+
+    /**
+     * @return The number of entries.
+     */
+    size_t size() const noexcept;
+
+    /**
+     * @return The result of the entry with \c index from the last execution of the batch: ESP_OK on success,
+     *      the driver error on failure or ESP_ERR_INVALID_STATE if the batch hasn't been executed since the entry
+     *      has been added.
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c index is out of range.
+     */
+    esp_err_t get_error(size_t index) const;
+
+    /**
+     * @brief Remove all entries.
+     */
+    void clear() noexcept;
+
+private:
+    struct Entry {
+        I2CAddress i2c_addr;
+        const uint8_t *write_data;
+        size_t write_len;
+        uint8_t *read_buffer;
+        size_t read_len;
+        esp_err_t error;
+    };
+
+    /**
+     * The entries in order of execution.
+     */
+    std::vector<Entry> entries;
+
+    /**
+     * Size of \c cmd_link_buffer in bytes.
+     */
+    const size_t cmd_link_buffer_size;
+
+    /**
+     * Buffer for the command link of the entry which is currently executed.
+     */
+    std::unique_ptr<uint8_t[]> cmd_link_buffer;
+};
+
+/**
+ * @brief Memory layout of a device with paged writes, e.g. an EEPROM.
+ */
+struct I2CPageLayout {
+    /**
+     * The size of a page in bytes. A single write must not cross a page boundary.
+     */
+    size_t page_size;
+
+    /**
+     * The number of bytes of the memory address, which is sent big-endian before the data.
+     */
+    size_t address_len;
+
+    /**
+     * Maximum time the device needs to store a page (the write cycle time of the datasheet), no other page is
+     * written to the device during that time.
+     */
+    std::chrono::milliseconds write_cycle_time;
+};
+
 /**
  * @brief Simple I2C Master object
  *
@@ -302,7 +1177,32 @@ public:
               bool sda_pullup = true);
 
     /**
-     * Delete the driver.
+     * Initialize and install the driver of an I2C master peripheral which executes all asynchronous transfers in
+     * a single long-lived worker task instead of a new task per transfer.
+     *
+     * Apart from the worker, this behaves exactly like the constructor above.
+     *
+     * @param i2c_number The number of the I2C device.
+     * @param scl_gpio GPIO number of the SCL line.
+     * @param sda_gpio GPIO number of the SDA line.
+     * @param clock_speed The master clock speed.
+     * @param worker_config Queue size, stack size, priority and core affinity of the worker task.
+     * @param scl_pullup Enable SCL pullup.
+     * @param sda_pullup Enable SDA pullup.
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     * @throws std::exception for failures in libstdc++
+     */
+    explicit I2CMaster(I2CNumber i2c_number,
+              SCL_GPIO scl_gpio,
+              SDA_GPIO sda_gpio,
+              Frequency clock_speed,
+              const I2CWorkerConfig &worker_config,
+              bool scl_pullup = true,
+              bool sda_pullup = true);
+
+    /**
+     * Stop the worker task, if any, and delete the driver.
      */
     virtual ~I2CMaster();
 
@@ -313,6 +1213,9 @@ public:
      * The return value can be accessed with \c future::get(). \c future::get() also synchronizes with the thread
      * doing the work in the background, i.e. it waits until the return value has been issued.
      *
+     * If this master has been created with an \c I2CWorkerConfig, the transfer is appended to the queue of the
+     * worker task, blocking while the queue is full. Otherwise, a new task is created for the transfer.
+     *
      * The actual implementation is delegated to the TransferT object. It will be given the I2C number to work
      * with.
      *
@@ -330,6 +1233,7 @@ public:
      *         operation.
      *         If TransferT is a combined transfer with repeated reads (I2CComposed), then the return type is
      *         future<vector<vector<uint8_t> > >, a vector of results corresponding to the queued read operations.
+     *         For \c I2CInlineComposed, it's future<I2CComposedResult> with a view on each read.
      *
      * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
      * @throws std::exception for failures in libstdc++
@@ -338,18 +1242,62 @@ public:
     std::future<typename TransferT::TransferReturnT> transfer(I2CAddress i2c_addr, std::shared_ptr<TransferT> xfer);
 
     /**
-     * Do a synchronous write.
+     * Like \c transfer() above, but the transfer is moved into the job, no \c std::shared_ptr is necessary.
      *
-     * All data in data will be written to the I2C device with i2c_addr at once.
-     * This method will block until the I2C write is complete.
+     * Transfers derived from \c I2CInlineTransfer, like \c I2CInlineWrite and \c I2CInlineRead, and
+     * \c I2CStaticComposed are executed without any virtual call.
      *
-     * @param i2c_addr The address of the I2C device to which the data shall be sent.
-     * @param data The data to send (size to be sent is determined by data.size()).
+     * @param i2c_addr The address of the I2C slave device targeted by the transfer.
+     * @param xfer The transfer to execute, usually passed as rvalue: \c transfer(addr, I2CInlineRead(2)).
      *
      * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
      * @throws std::exception for failures in libstdc++
      */
-    void sync_write(I2CAddress i2c_addr, const std::vector<uint8_t> &data);
+    template<typename TransferT>
+    std::future<typename TransferT::TransferReturnT> transfer(I2CAddress i2c_addr, TransferT xfer);
+
+    /**
+     * Like \c transfer() above, but the transfer is taken by reference, e.g. \c transfer(addr, std::ref(xfer)).
+     *
+     * @note The caller has to keep the transfer alive and must not use it until the returned future is ready.
+     *
+     * @param i2c_addr The address of the I2C slave device targeted by the transfer.
+     * @param xfer The transfer to execute.
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     * @throws std::exception for failures in libstdc++
+     */
+    template<typename TransferT>
+    std::future<typename TransferT::TransferReturnT> transfer(I2CAddress i2c_addr,
+            std::reference_wrapper<TransferT> xfer);
+
+    /**
+     * Do a synchronous write.
+     *
+     * All data in data will be written to the I2C device with i2c_addr at once.
+     * This method will block until the I2C write is complete.
+     *
+     * @param i2c_addr The address of the I2C device to which the data shall be sent.
+     * @param data The data to send (size to be sent is determined by data.size()).
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     * @throws std::exception for failures in libstdc++
+     */
+    void sync_write(I2CAddress i2c_addr, const std::vector<uint8_t> &data);
+
+    /**
+     * Do a synchronous write from a caller-owned buffer.
+     *
+     * Like \c sync_write() above, but the data is written directly from \c data without any heap allocation.
+     * This method will block until the I2C write is complete.
+     *
+     * @param i2c_addr The address of the I2C device to which the data shall be sent.
+     * @param data The data to send.
+     * @param data_len The number of bytes to send.
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     */
+    void sync_write(I2CAddress i2c_addr, const uint8_t *data, size_t data_len);
 
     /**
      * Do a synchronous read.
@@ -368,6 +1316,20 @@ public:
      */
     std::vector<uint8_t> sync_read(I2CAddress i2c_addr, size_t n_bytes);
 
+    /**
+     * Do a synchronous read into a caller-owned buffer.
+     *
+     * Like \c sync_read() above, but the data is read directly into \c buffer without any heap allocation.
+     * This method will block until the I2C read is complete.
+     *
+     * @param i2c_addr The address of the I2C device from which to read.
+     * @param buffer The buffer receiving the read bytes.
+     * @param buffer_len The number of bytes to read, \c buffer has to be at least this large.
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     */
+    void sync_read(I2CAddress i2c_addr, uint8_t *buffer, size_t buffer_len);
+
     /**
      * Do a simple synchronous write-read transfer.
      *
@@ -388,6 +1350,233 @@ public:
     std::vector<uint8_t> sync_transfer(I2CAddress i2c_addr,
             const std::vector<uint8_t> &write_data,
             size_t read_n_bytes);
+
+    /**
+     * Do a simple synchronous write-read transfer with caller-owned buffers.
+     *
+     * Like \c sync_transfer() above, but the data is written directly from \c write_data and read directly into
+     * \c read_buffer without any heap allocation.
+     * This method will block until the I2C transfer is complete.
+     *
+     * @param i2c_addr The address of the I2C device from which to read.
+     * @param write_data The data to write to the bus before reading.
+     * @param write_len The number of bytes to write.
+     * @param read_buffer The buffer receiving the read bytes.
+     * @param read_len The number of bytes to read, \c read_buffer has to be at least this large.
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     */
+    void sync_transfer(I2CAddress i2c_addr,
+            const uint8_t *write_data,
+            size_t write_len,
+            uint8_t *read_buffer,
+            size_t read_len);
+
+    /**
+     * Execute a transfer object synchronously, using a command link from the pool of this master.
+     *
+     * In contrast to \c transfer(), no task is involved and the transfer is taken by reference.
+     * This method will block until the I2C transfer is complete.
+     *
+     * Requirements for TransferT: It has to provide \c do_transfer() taking an \c I2CCommandLinkPool like
+     * \c I2CTransfer and \c I2CStaticComposed. The commands of the transfer have to fit into a pooled command link.
+     *
+     * @param i2c_addr The address of the I2C slave device targeted by the transfer.
+     * @param xfer The transfer to execute.
+     *
+     * @return The result of the transfer, \c TransferT::TransferReturnT.
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     */
+    template<typename TransferT>
+    typename TransferT::TransferReturnT sync_transfer(I2CAddress i2c_addr, TransferT &xfer);
+
+    /**
+     * Do a synchronous write from a caller-owned buffer without throwing.
+     *
+     * Like \c sync_write(), but errors are returned instead of thrown. This avoids the cost of exceptions for
+     * expected failures, e.g. when probing for devices or retrying on a noisy bus.
+     *
+     * @param i2c_addr The address of the I2C device to which the data shall be sent.
+     * @param data The data to send.
+     * @param data_len The number of bytes to send.
+     *
+     * @return The result, its error is ESP_ERR_INVALID_ARG if \c data is nullptr or \c data_len is 0,
+     *      ESP_ERR_NO_MEM if no command link became available and the driver error if the transfer failed.
+     */
+    I2CResult<> try_write(I2CAddress i2c_addr, const uint8_t *data, size_t data_len) noexcept;
+
+    /**
+     * Do a synchronous read into a caller-owned buffer without throwing.
+     *
+     * Like \c sync_read(), but errors are returned instead of thrown, see \c try_write().
+     *
+     * @param i2c_addr The address of the I2C device from which to read.
+     * @param buffer The buffer receiving the read bytes.
+     * @param buffer_len The number of bytes to read, \c buffer has to be at least this large.
+     *
+     * @return The result, with the errors as described for \c try_write().
+     */
+    I2CResult<> try_read(I2CAddress i2c_addr, uint8_t *buffer, size_t buffer_len) noexcept;
+
+    /**
+     * Do a synchronous read of \c N bytes without throwing.
+     *
+     * @param i2c_addr The address of the I2C device from which to read.
+     *
+     * @return The read bytes or the error as described for \c try_write().
+     */
+    template<size_t N>
+    I2CResult<std::array<uint8_t, N> > try_read(I2CAddress i2c_addr) noexcept;
+
+    /**
+     * Do a synchronous write-read transfer with caller-owned buffers without throwing.
+     *
+     * Like \c sync_transfer(), but errors are returned instead of thrown, see \c try_write().
+     *
+     * @param i2c_addr The address of the I2C device from which to read.
+     * @param write_data The data to write to the bus before reading.
+     * @param write_len The number of bytes to write.
+     * @param read_buffer The buffer receiving the read bytes.
+     * @param read_len The number of bytes to read, \c read_buffer has to be at least this large.
+     *
+     * @return The result, with the errors as described for \c try_write().
+     */
+    I2CResult<> try_transfer(I2CAddress i2c_addr,
+            const uint8_t *write_data,
+            size_t write_len,
+            uint8_t *read_buffer,
+            size_t read_len) noexcept;
+
+    /**
+     * Check whether a device acknowledges its address, by an empty write without throwing.
+     *
+     * In contrast to the other transfers, the presence table of \c scan() is ignored, so it can be used to wait for a
+     * device to become ready, e.g. for the ACK polling of an EEPROM during its write cycle.
+     *
+     * @param i2c_addr The address to probe.
+     * @param timeout The driver timeout of the probe.
+     *
+     * @return The result, its error is ESP_FAIL if no device acknowledged, ESP_ERR_NO_MEM if no command link became
+     *      available and the driver error for any other failure.
+     */
+    I2CResult<> try_probe(I2CAddress i2c_addr, std::chrono::milliseconds timeout = SCAN_PROBE_TIMEOUT) noexcept;
+
+#if CONFIG_ESP_IDF_CXX_I2C_STATS
+    /**
+     * @return The transfer statistics of the device \c i2c_addr on this bus.
+     */
+    I2CAddressStats get_stats(I2CAddress i2c_addr) const;
+
+    /**
+     * @return The transfer statistics of all devices on this bus which have been addressed.
+     */
+    std::vector<I2CAddressStats> get_stats() const;
+
+    /**
+     * Remove all transfer statistics of this bus.
+     */
+    void reset_stats() noexcept;
+#endif
+
+    /**
+     * Execute all entries of \c batch back-to-back in the calling task.
+     *
+     * Failing entries don't stop the batch, the error of each entry is available via \c I2CBatch::get_error()
+     * afterwards. No heap memory is allocated.
+     * This method will block until all entries have been executed.
+     *
+     * @param batch The transfers to execute.
+     *
+     * @return The number of failed entries.
+     */
+    size_t sync_batch(I2CBatch &batch);
+
+    /**
+     * Probe all non-reserved addresses (0x08 to 0x77) for devices.
+     *
+     * Each address is probed by an empty write, a device is present if it acknowledges its address. All probes
+     * use the same command link buffer on the stack and don't throw on NACK.
+     *
+     * The result is stored in the presence table of this master. Afterwards, synchronous transfers and batch
+     * entries to absent addresses fail immediately with ESP_ERR_NOT_FOUND without accessing the bus, until
+     * \c forget_presence() is called or the next scan finds the device.
+     *
+     * @param probe_timeout The driver timeout of each probe.
+     *
+     * @return The addresses which acknowledged, bit \c i represents address \c i.
+     *
+     * @throws I2CException if the command link can't be recorded
+     */
+    std::bitset<128> scan(std::chrono::milliseconds probe_timeout = SCAN_PROBE_TIMEOUT);
+
+    /**
+     * Scan the buses of several masters concurrently, one task per bus, see \c scan() above.
+     *
+     * @param masters The masters of the buses to scan.
+     * @param probe_timeout The driver timeout of each probe.
+     *
+     * @return The presence bitmaps in the order of \c masters.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if one of the masters is empty
+     * @throws std::exception for failures in libstdc++, e.g. if a task can't be created
+     */
+    static std::vector<std::bitset<128> > scan(const std::vector<std::shared_ptr<I2CMaster> > &masters,
+            std::chrono::milliseconds probe_timeout = SCAN_PROBE_TIMEOUT);
+
+    /**
+     * @return false if the last scan didn't find a device at \c i2c_addr, true otherwise or if no scan has been
+     *      done.
+     */
+    bool is_present(I2CAddress i2c_addr) const;
+
+    /**
+     * Clear the presence table, transfers to all addresses access the bus again.
+     */
+    void forget_presence() noexcept;
+
+    /**
+     * Timeout for the driver and for waiting on the command link pool used by the synchronous transfers.
+     */
+    static const std::chrono::milliseconds SYNC_TIMEOUT;
+
+    /**
+     * Default timeout of a single probe of \c scan().
+     */
+    static const std::chrono::milliseconds SCAN_PROBE_TIMEOUT;
+
+private:
+    /**
+     * Run \c job in the worker task if there is one, otherwise in a new task.
+     */
+    template<typename ReturnT, typename JobT>
+    std::future<ReturnT> run_async(JobT job);
+
+    /**
+     * Executes the asynchronous transfers if this master has been created with an \c I2CWorkerConfig,
+     * otherwise empty.
+     */
+    std::unique_ptr<I2CTransferWorker> worker;
+
+    /**
+     * Statically allocated command links used by the synchronous transfers.
+     */
+    I2CCommandLinkPool cmd_link_pool;
+
+    /**
+     * The addresses found by the last scan.
+     */
+    std::bitset<128> presence;
+
+    /**
+     * True if \c presence holds the result of a scan.
+     */
+    bool presence_known;
+
+    /**
+     * Protects \c presence and \c presence_known.
+     */
+    mutable std::mutex presence_mutex;
 };
 
 #if CONFIG_SOC_I2C_SUPPORT_SLAVE
@@ -423,93 +1612,352 @@ public:
         bool scl_pullup = true,
         bool sda_pullup = true);
 
-    /**
-     * Delete the driver.
-     */
-    virtual ~I2CSlave();
+    /**
+     * Delete the driver.
+     */
+    virtual ~I2CSlave();
+
+    /**
+     * Schedule a raw data write once master is ready.
+     *
+     * The data is saved in a buffer, waiting for the master to pick it up.
+     */
+    virtual int write_raw(const uint8_t* data, size_t data_len, std::chrono::milliseconds timeout);
+
+    /**
+     * Read raw data from the bus.
+     *
+     * The data is read directly from the buffer. Hence, it has to be written already by master.
+     */
+    virtual int read_raw(uint8_t* buffer, size_t buffer_len, std::chrono::milliseconds timeout);
+};
+#endif // CONFIG_SOC_I2C_SUPPORT_SLAVE
+
+/**
+ * Implementation for simple I2C writes, which can be executed by \c I2CMaster::transfer().
+ * It stores the bytes to be written as a vector.
+ */
+class I2CWrite : public I2CTransfer<void> {
+public:
+    /**
+     * @param bytes The bytes which should be written.
+     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     */
+    I2CWrite(const std::vector<uint8_t> &bytes, std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
+
+protected:
+    /**
+     * Write the address and set the read bit to 0 to issue the address and request a write.
+     * Then write the bytes.
+     *
+     * @param handle The initialized I2C command handle.
+     * @param i2c_addr The I2C address of the slave.
+     */
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr) override;
+
+    /**
+     * Nothing to do for a write.
+     */
+    void process_result() override;
+
+private:
+    /**
+     * The bytes to write.
+     */
+    std::vector<uint8_t> bytes;
+};
+
+/**
+ * Implementation for simple I2C reads, which can be executed by \c I2CMaster::transfer().
+ * It stores the bytes to be read as a vector to be returned later via a future.
+ */
+class I2CRead : public I2CTransfer<std::vector<uint8_t> > {
+public:
+    /**
+     * @param The number of bytes to read.
+     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     */
+    I2CRead(size_t size, std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
+
+protected:
+    /**
+     * Write the address and set the read bit to 1 to issue the address and request a read.
+     * Then read into bytes.
+     *
+     * @param handle The initialized I2C command handle.
+     * @param i2c_addr The I2C address of the slave.
+     */
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr) override;
+
+    /**
+     * Return the bytes read.
+     */
+    std::vector<uint8_t> process_result() override;
+
+private:
+    /**
+     * The bytes to read.
+     */
+    std::vector<uint8_t> bytes;
+};
+
+/**
+ * Like \c I2CWrite, but derived from \c I2CInlineTransfer instead of \c I2CTransfer: the commands are dispatched
+ * without virtual calls and the transfer can be passed by value or by reference to \c I2CMaster::transfer().
+ */
+class I2CInlineWrite : public I2CInlineTransfer<I2CInlineWrite, void> {
+    friend class I2CInlineTransfer<I2CInlineWrite, void>;
+
+public:
+    /**
+     * @param bytes The bytes which should be written.
+     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     */
+    I2CInlineWrite(const std::vector<uint8_t> &bytes,
+            std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
+
+protected:
+    /**
+     * Write the address and set the read bit to 0 to issue the address and request a write.
+     * Then write the bytes.
+     *
+     * @param handle The initialized I2C command handle.
+     * @param i2c_addr The I2C address of the slave.
+     */
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+    {
+        handle.start();
+        handle.write_address(i2c_addr, false);
+        handle.write(bytes);
+    }
+
+    /**
+     * Nothing to do for a write.
+     */
+    void process_result() { }
+
+private:
+    /**
+     * The bytes to write.
+     */
+    std::vector<uint8_t> bytes;
+};
+
+/**
+ * Like \c I2CRead, but derived from \c I2CInlineTransfer instead of \c I2CTransfer: the commands are dispatched
+ * without virtual calls and the transfer can be passed by value or by reference to \c I2CMaster::transfer().
+ */
+class I2CInlineRead : public I2CInlineTransfer<I2CInlineRead, std::vector<uint8_t> > {
+    friend class I2CInlineTransfer<I2CInlineRead, std::vector<uint8_t> >;
+
+public:
+    /**
+     * @param The number of bytes to read.
+     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     */
+    I2CInlineRead(size_t size, std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
+
+protected:
+    /**
+     * Write the address and set the read bit to 1 to issue the address and request a read.
+     * Then read into bytes.
+     *
+     * @param handle The initialized I2C command handle.
+     * @param i2c_addr The I2C address of the slave.
+     */
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+    {
+        handle.start();
+        handle.write_address(i2c_addr, true);
+        handle.read(bytes);
+    }
+
+    /**
+     * Return the bytes read.
+     */
+    std::vector<uint8_t> process_result()
+    {
+        return bytes;
+    }
+
+private:
+    /**
+     * The bytes to read.
+     */
+    std::vector<uint8_t> bytes;
+};
+
+/**
+ * Read-only view of a contiguous range of bytes owned by another object, e.g. the data of one read of an
+ * \c I2CComposed transfer. The view is only valid as long as the owner exists.
+ */
+class I2CByteView {
+public:
+    I2CByteView(const uint8_t *data, size_t size) noexcept : bytes(data), length(size) { }
+
+    const uint8_t *data() const noexcept
+    {
+        return bytes;
+    }
+
+    size_t size() const noexcept
+    {
+        return length;
+    }
+
+    const uint8_t *begin() const noexcept
+    {
+        return bytes;
+    }
+
+    const uint8_t *end() const noexcept
+    {
+        return bytes + length;
+    }
+
+    uint8_t operator[](size_t index) const noexcept
+    {
+        return bytes[index];
+    }
 
     /**
-     * Schedule a raw data write once master is ready.
-     *
-     * The data is saved in a buffer, waiting for the master to pick it up.
+     * @return A copy of the bytes.
      */
-    virtual int write_raw(const uint8_t* data, size_t data_len, std::chrono::milliseconds timeout);
+    std::vector<uint8_t> to_vector() const
+    {
+        return std::vector<uint8_t>(begin(), end());
+    }
 
-    /**
-     * Read raw data from the bus.
-     *
-     * The data is read directly from the buffer. Hence, it has to be written already by master.
-     */
-    virtual int read_raw(uint8_t* buffer, size_t buffer_len, std::chrono::milliseconds timeout);
+private:
+    const uint8_t *bytes;
+    size_t length;
 };
-#endif // CONFIG_SOC_I2C_SUPPORT_SLAVE
 
 /**
- * Implementation for simple I2C writes, which can be executed by \c I2CMaster::transfer().
- * It stores the bytes to be written as a vector.
+ * The result of an \c I2CInlineComposed transfer.
+ *
+ * The data of all reads is stored in one contiguous buffer, in the order of how the reads were added using
+ * \c I2CInlineComposed::add_read(). The data of a single read is accessed by index via \c I2CByteView.
  */
-class I2CWrite : public I2CTransfer<void> {
+class I2CComposedResult {
 public:
     /**
-     * @param bytes The bytes which should be written.
-     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     * @param data The data of all reads.
+     * @param read_ends The end offset of each read in \c data, shared with the transfer which produced the result.
      */
-    I2CWrite(const std::vector<uint8_t> &bytes, std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
+    I2CComposedResult(std::vector<uint8_t> data, std::shared_ptr<const std::vector<size_t> > read_ends);
 
-protected:
     /**
-     * Write the address and set the read bit to 0 to issue the address and request a write.
-     * Then write the bytes.
+     * @return The number of reads.
+     */
+    size_t size() const noexcept;
+
+    /**
+     * @return The data of the read with index \c index. The view is valid as long as this object exists.
      *
-     * @param handle The initialized I2C command handle.
-     * @param i2c_addr The I2C address of the slave.
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c index is out of range
      */
-    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr) override;
+    I2CByteView operator[](size_t index) const;
 
     /**
-     * Set the value of the promise to unblock any callers waiting on it.
+     * @return The data of all reads.
      */
-    void process_result() override;
+    const std::vector<uint8_t> &data() const noexcept;
 
-private:
     /**
-     * The bytes to write.
+     * Copy the data of each read into a separate vector, the result type of \c I2CComposed.
      */
+    operator std::vector<std::vector<uint8_t> >() const;
+
+private:
     std::vector<uint8_t> bytes;
+
+    std::shared_ptr<const std::vector<size_t> > ends;
 };
 
 /**
- * Implementation for simple I2C reads, which can be executed by \c I2CMaster::transfer().
- * It stores the bytes to be read as a vector to be returned later via a future.
+ * The chained writes and reads of \c I2CComposed and \c I2CInlineComposed.
+ *
+ * The bytes of all writes and the buffer for all reads are each kept in one contiguous buffer. Hence, adding a step
+ * doesn't allocate memory for the step itself and an execution allocates a constant number of buffers, independent
+ * of the number of steps.
  */
-class I2CRead : public I2CTransfer<std::vector<uint8_t> > {
+class I2CComposedSteps {
 public:
+    I2CComposedSteps();
+
     /**
-     * @param The number of bytes to read.
-     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     * Add a read to the chain.
+     *
+     * @param size The size of the read in bytes.
      */
-    I2CRead(size_t size, std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
+    void add_read(size_t size);
 
-protected:
     /**
-     * Write the address and set the read bit to 1 to issue the address and request a read.
-     * Then read into bytes.
+     * Add a write to the chain.
+     *
+     * @param bytes The bytes to write; size will be bytes.size()
+     */
+    void add_write(const std::vector<uint8_t> &bytes);
+
+    /**
+     * Write all chained transfers, each one after a (repeated) start condition.
      *
      * @param handle The initialized I2C command handle.
      * @param i2c_addr The I2C address of the slave.
      */
-    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr) override;
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr);
 
     /**
-     * Set the return value of the promise to unblock any callers waiting on it.
+     * Copy the data of each read into a separate vector. The read buffer is kept for the next execution.
      */
-    std::vector<uint8_t> process_result() override;
+    std::vector<std::vector<uint8_t> > copy_reads() const;
+
+    /**
+     * Move the read buffer into a result, so it is reallocated by the next execution. The end offsets of the reads
+     * are shared with the result and are only copied if a read is added while the result exists.
+     */
+    I2CComposedResult take_reads();
 
 private:
     /**
-     * The bytes to read.
+     * A single write or read of the chain.
      */
-    std::vector<uint8_t> bytes;
+    struct Step {
+        bool is_read;
+
+        /**
+         * Offset of the data of this step in \c write_data or \c read_data.
+         */
+        size_t offset;
+
+        size_t length;
+    };
+
+    /**
+     * @return The size of all reads together.
+     */
+    size_t read_size() const noexcept;
+
+    /**
+     * The chained transfers.
+     */
+    std::vector<Step> steps;
+
+    /**
+     * The bytes of all writes.
+     */
+    std::vector<uint8_t> write_data;
+
+    /**
+     * The buffer of all reads, allocated by \c queue_cmd().
+     */
+    std::vector<uint8_t> read_data;
+
+    /**
+     * The end offset of each read in \c read_data, empty until the first read is added.
+     */
+    std::shared_ptr<std::vector<size_t> > read_ends;
 };
 
 /**
@@ -517,8 +1965,11 @@ private:
  * In particular, this can be used to chain multiple single write and read transfers into a single transfer with
  * repeated starts as it is commonly done for I2C devices.
  * The result is a vector of vectors representing the reads in the order of how they were added using add_read().
+ *
+ * The steps are stored contiguously, see \c I2CComposedSteps. Building the result allocates one vector per read,
+ * \c I2CInlineComposed returns views on a single buffer instead.
  */
-class I2CComposed : public  I2CTransfer<std::vector<std::vector<uint8_t> > > {
+class I2CComposed : public I2CTransfer<std::vector<std::vector<uint8_t> > > {
 public:
     I2CComposed(std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
 
@@ -534,7 +1985,7 @@ public:
      *
      * @param bytes The bytes to write; size will be bytes.size()
      */
-    void add_write(std::vector<uint8_t> bytes);
+    void add_write(const std::vector<uint8_t> &bytes);
 
 protected:
     /**
@@ -551,35 +2002,225 @@ protected:
     std::vector<std::vector<uint8_t> > process_result() override;
 
 private:
-    class CompTransferNode {
-    public:
-        virtual ~CompTransferNode() { }
-        virtual void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr) = 0;
-        virtual void process_result(std::vector<std::vector<uint8_t> > &read_results) { }
-    };
+    I2CComposedSteps steps;
+};
 
-    class CompTransferNodeRead : public CompTransferNode {
-    public:
-        CompTransferNodeRead(size_t size) : bytes(size) { }
-        void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr) override;
+/**
+ * Like \c I2CComposed, but derived from \c I2CInlineTransfer and with an \c I2CComposedResult as result.
+ *
+ * The read buffer is moved into the result, which provides a view on each read. Hence, an execution allocates a
+ * constant number of buffers, independent of the number of steps, while \c I2CComposed allocates a vector per read.
+ */
+class I2CInlineComposed : public I2CInlineTransfer<I2CInlineComposed, I2CComposedResult> {
+    friend class I2CInlineTransfer<I2CInlineComposed, I2CComposedResult>;
 
-        void process_result(std::vector<std::vector<uint8_t> > &read_results) override;
-    private:
-        std::vector<uint8_t> bytes;
-    };
+public:
+    I2CInlineComposed(std::chrono::milliseconds driver_timeout = std::chrono::milliseconds(1000));
 
-    class CompTransferNodeWrite : public CompTransferNode {
-    public:
-        CompTransferNodeWrite(std::vector<uint8_t> bytes) : bytes(bytes) { }
-        void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr) override;
-    private:
-        std::vector<uint8_t> bytes;
-    };
+    /**
+     * Add a read to the chain.
+     *
+     * @param size The size of the read in bytes.
+     */
+    void add_read(size_t size);
 
     /**
-     * The chained transfers.
+     * Add a write to the chain.
+     *
+     * @param bytes The bytes to write; size will be bytes.size()
+     */
+    void add_write(const std::vector<uint8_t> &bytes);
+
+protected:
+    /**
+     * Write all chained transfers, including a repeated start issue after each but the last transfer.
+     *
+     * @param handle The initialized I2C command handle.
+     * @param i2c_addr The I2C address of the slave.
+     */
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr);
+
+    /**
+     * Moves the read buffer into the result.
+     */
+    I2CComposedResult process_result();
+
+private:
+    I2CComposedSteps steps;
+};
+
+/**
+ * Write step of an \c I2CStaticComposed transfer, writing exactly \c N bytes.
+ * Write steps don't contribute to the result of the transfer.
+ */
+template<size_t N>
+class I2CWriteStep {
+public:
+    static_assert(N > 0, "I2C write step must write at least one byte");
+
+    /**
+     * The results of this step, nothing for a write.
      */
-    std::list<std::shared_ptr<CompTransferNode> > transfer_list;
+    typedef std::tuple<> ResultT;
+
+    /**
+     * @param bytes The bytes to write.
+     */
+    I2CWriteStep(const std::array<uint8_t, N> &bytes) : bytes(bytes) { }
+
+    /**
+     * Issue a (repeated) start condition, the address with the write bit and the bytes.
+     */
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+    {
+        handle.start();
+        handle.write_address(i2c_addr, false);
+        handle.write(bytes.data(), bytes.size());
+    }
+
+    ResultT result() const
+    {
+        return ResultT();
+    }
+
+private:
+    std::array<uint8_t, N> bytes;
+};
+
+/**
+ * Read step of an \c I2CStaticComposed transfer, reading exactly \c N bytes.
+ * Each read step contributes an \c std::array<uint8_t, N> to the result of the transfer.
+ */
+template<size_t N>
+class I2CReadStep {
+public:
+    static_assert(N > 0, "I2C read step must read at least one byte");
+
+    /**
+     * The results of this step, the bytes read.
+     */
+    typedef std::tuple<std::array<uint8_t, N> > ResultT;
+
+    I2CReadStep() : bytes() { }
+
+    /**
+     * Issue a (repeated) start condition, the address with the read bit and the read.
+     */
+    void queue_cmd(I2CCommandLink &handle, I2CAddress i2c_addr)
+    {
+        handle.start();
+        handle.write_address(i2c_addr, true);
+        handle.read(bytes.data(), bytes.size());
+    }
+
+    ResultT result() const
+    {
+        return ResultT(bytes);
+    }
+
+private:
+    std::array<uint8_t, N> bytes;
+};
+
+/**
+ * Composed transfer whose steps and buffer sizes are fixed at compile time.
+ *
+ * Like \c I2CComposed, this transfer chains writes and reads with repeated start conditions. The steps are
+ * given as template arguments, e.g. \c I2CStaticComposed<I2CWriteStep<1>, I2CReadStep<6> > for the typical
+ * register read. All data is stored inside the object, no heap allocation and no virtual call is necessary.
+ *
+ * The result is an \c std::tuple with one \c std::array per read step, in the order of the read steps.
+ * It can be executed by \c I2CMaster::transfer() and \c I2CMaster::sync_transfer().
+ */
+template<typename ...StepsT>
+class I2CStaticComposed {
+public:
+    static_assert(sizeof...(StepsT) > 0, "I2CStaticComposed needs at least one step");
+
+    /**
+     * The tuple of the \c std::array results of all read steps.
+     */
+    typedef decltype(std::tuple_cat(std::declval<typename StepsT::ResultT>()...)) TransferReturnT;
+
+    /**
+     * @param steps The steps of the transfer.
+     */
+    explicit I2CStaticComposed(StepsT ...steps)
+        : I2CStaticComposed(std::chrono::milliseconds(1000), std::move(steps)...) { }
+
+    /**
+     * @param driver_timeout The timeout used for calls like i2c_master_cmd_begin() to the underlying driver.
+     * @param steps The steps of the transfer.
+     */
+    I2CStaticComposed(std::chrono::milliseconds driver_timeout, StepsT ...steps)
+        : steps(std::move(steps)...), driver_timeout(driver_timeout) { }
+
+    /**
+     * Execute the transfer on a heap-allocated command link, see \c I2CTransfer::do_transfer().
+     *
+     * @throws I2CException for any particular I2C error
+     */
+    TransferReturnT do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr)
+    {
+        I2CCommandLink cmd_link;
+
+        return do_transfer(cmd_link, i2c_num, i2c_addr);
+    }
+
+    /**
+     * Execute the transfer on a command link taken from \c pool, see \c I2CTransfer::do_transfer().
+     *
+     * @throws I2CException for any particular I2C error, with ESP_ERR_NO_MEM if no command link became available
+     *      within \c pool_timeout
+     */
+    TransferReturnT do_transfer(I2CCommandLinkPool &pool,
+            std::chrono::milliseconds pool_timeout,
+            I2CNumber i2c_num,
+            I2CAddress i2c_addr)
+    {
+        static_assert(sizeof...(StepsT) <= CONFIG_ESP_IDF_CXX_I2C_CMD_LINK_POOL_TRANSACTIONS,
+                "Too many steps for a pooled command link, increase CONFIG_ESP_IDF_CXX_I2C_CMD_LINK_POOL_TRANSACTIONS");
+
+        I2CCommandLink cmd_link(pool, pool_timeout);
+
+        return do_transfer(cmd_link, i2c_num, i2c_addr);
+    }
+
+private:
+    TransferReturnT do_transfer(I2CCommandLink &cmd_link, I2CNumber i2c_num, I2CAddress i2c_addr)
+    {
+        queue_cmd(cmd_link, i2c_addr, std::index_sequence_for<StepsT...>());
+
+        cmd_link.stop();
+
+        cmd_link.execute_transfer(i2c_num, driver_timeout);
+
+        return process_result(std::index_sequence_for<StepsT...>());
+    }
+
+    template<size_t ...I>
+    void queue_cmd(I2CCommandLink &cmd_link, I2CAddress i2c_addr, std::index_sequence<I...>)
+    {
+        // expands to one queue_cmd() call per step, in order
+        int expansion[] = { (std::get<I>(steps).queue_cmd(cmd_link, i2c_addr), 0)... };
+        (void) expansion;
+    }
+
+    template<size_t ...I>
+    TransferReturnT process_result(std::index_sequence<I...>) const
+    {
+        return std::tuple_cat(std::get<I>(steps).result()...);
+    }
+
+    /**
+     * The chained steps.
+     */
+    std::tuple<StepsT...> steps;
+
+    /**
+     * The timeout passed to \c I2CCommandLink::execute_transfer().
+     */
+    std::chrono::milliseconds driver_timeout;
 };
 
 template<typename TReturn>
@@ -591,6 +2232,23 @@ TReturn I2CTransfer<TReturn>::do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr
 {
     I2CCommandLink cmd_link;
 
+    return do_transfer(cmd_link, i2c_num, i2c_addr);
+}
+
+template<typename TReturn>
+TReturn I2CTransfer<TReturn>::do_transfer(I2CCommandLinkPool &pool,
+        std::chrono::milliseconds pool_timeout,
+        I2CNumber i2c_num,
+        I2CAddress i2c_addr)
+{
+    I2CCommandLink cmd_link(pool, pool_timeout);
+
+    return do_transfer(cmd_link, i2c_num, i2c_addr);
+}
+
+template<typename TReturn>
+TReturn I2CTransfer<TReturn>::do_transfer(I2CCommandLink &cmd_link, I2CNumber i2c_num, I2CAddress i2c_addr)
+{
     queue_cmd(cmd_link, i2c_addr);
 
     cmd_link.stop();
@@ -600,14 +2258,102 @@ TReturn I2CTransfer<TReturn>::do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr
     return process_result();
 }
 
+template<typename DerivedT, typename TReturn>
+TReturn I2CInlineTransfer<DerivedT, TReturn>::do_transfer(I2CNumber i2c_num, I2CAddress i2c_addr)
+{
+    I2CCommandLink cmd_link;
+
+    return do_transfer(cmd_link, i2c_num, i2c_addr);
+}
+
+template<typename DerivedT, typename TReturn>
+TReturn I2CInlineTransfer<DerivedT, TReturn>::do_transfer(I2CCommandLinkPool &pool,
+        std::chrono::milliseconds pool_timeout,
+        I2CNumber i2c_num,
+        I2CAddress i2c_addr)
+{
+    I2CCommandLink cmd_link(pool, pool_timeout);
+
+    return do_transfer(cmd_link, i2c_num, i2c_addr);
+}
+
+template<typename DerivedT, typename TReturn>
+TReturn I2CInlineTransfer<DerivedT, TReturn>::do_transfer(I2CCommandLink &cmd_link,
+        I2CNumber i2c_num,
+        I2CAddress i2c_addr)
+{
+    DerivedT &self = static_cast<DerivedT&>(*this);
+
+    self.queue_cmd(cmd_link, i2c_addr);
+
+    cmd_link.stop();
+
+    cmd_link.execute_transfer(i2c_num, driver_timeout);
+
+    return self.process_result();
+}
+
+template<typename TransferT>
+typename TransferT::TransferReturnT I2CMaster::sync_transfer(I2CAddress i2c_addr, TransferT &xfer)
+{
+    if (!is_present(i2c_addr)) {
+        throw I2CTransferException(ESP_ERR_NOT_FOUND);
+    }
+
+    return xfer.do_transfer(cmd_link_pool, SYNC_TIMEOUT, i2c_num, i2c_addr);
+}
+
 template<typename TransferT>
 std::future<typename TransferT::TransferReturnT> I2CMaster::transfer(I2CAddress i2c_addr, std::shared_ptr<TransferT> xfer)
 {
     if (!xfer) throw I2CException(ESP_ERR_INVALID_ARG);
 
-    return std::async(std::launch::async, [this](std::shared_ptr<TransferT> xfer, I2CAddress i2c_addr) {
+    return run_async<typename TransferT::TransferReturnT>([this, xfer, i2c_addr]() {
         return xfer->do_transfer(i2c_num, i2c_addr);
-    }, xfer, i2c_addr);
+    });
+}
+
+template<typename TransferT>
+std::future<typename TransferT::TransferReturnT> I2CMaster::transfer(I2CAddress i2c_addr, TransferT xfer)
+{
+    return run_async<typename TransferT::TransferReturnT>([this, xfer = std::move(xfer), i2c_addr]() mutable {
+        return xfer.do_transfer(i2c_num, i2c_addr);
+    });
+}
+
+template<typename TransferT>
+std::future<typename TransferT::TransferReturnT> I2CMaster::transfer(I2CAddress i2c_addr,
+        std::reference_wrapper<TransferT> xfer)
+{
+    return run_async<typename TransferT::TransferReturnT>([this, xfer, i2c_addr]() {
+        return xfer.get().do_transfer(i2c_num, i2c_addr);
+    });
+}
+
+template<typename ReturnT, typename JobT>
+std::future<ReturnT> I2CMaster::run_async(JobT job)
+{
+    if (worker) {
+        auto task = std::make_shared<std::packaged_task<ReturnT()> >(std::move(job));
+        std::future<ReturnT> result = task->get_future();
+        worker->post([task]() { (*task)(); });
+        return result;
+    }
+
+    return std::async(std::launch::async, std::move(job));
+}
+
+template<size_t N>
+I2CResult<std::array<uint8_t, N> > I2CMaster::try_read(I2CAddress i2c_addr) noexcept
+{
+    std::array<uint8_t, N> data;
+
+    I2CResult<> result = try_read(i2c_addr, data.data(), data.size());
+    if (!result) {
+        return I2CResult<std::array<uint8_t, N> >::failure(result.error());
+    }
+
+    return data;
 }
 
 } // idf
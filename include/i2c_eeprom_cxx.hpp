@@ -0,0 +1,164 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef __cpp_exceptions
+#error I2C class can only be used when __cpp_exceptions is enabled. Enable CONFIG_COMPILER_CXX_EXCEPTIONS in Kconfig
+#endif
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "i2c_cxx.hpp"
+
+namespace idf {
+
+/**
+ * @brief Statistics of a single \c I2CEEPROM::write().
+ */
+struct I2CEEPROMWriteStats {
+    /**
+     * Number of written data bytes, without the memory addresses.
+     */
+    size_t bytes;
+
+    /**
+     * Number of page writes.
+     */
+    size_t pages;
+
+    /**
+     * Number of attempts the device didn't acknowledge because it was still storing a page.
+     */
+    size_t ack_polls;
+
+    /**
+     * Time from the start of the first page write until the device has stored the last page.
+     */
+    std::chrono::microseconds duration;
+
+    /**
+     * @return The achieved write throughput, 0 if no time has been measured.
+     */
+    float get_bytes_per_second() const noexcept;
+};
+
+/**
+ * @brief An EEPROM with paged writes, e.g. of the 24Cxx series, on the bus of an \c I2CMaster.
+ *
+ * Writes of any size are split at the page boundaries of the device. Instead of sleeping the worst-case write cycle
+ * time after each page, the next page is sent right away and repeated as long as the device doesn't acknowledge
+ * its address, which it doesn't until it has stored the previous page (ACK polling). The next page is copied into
+ * the transfer buffer before polling, so its preparation overlaps with the write cycle of the device.
+ *
+ * The transfer buffer is allocated once by the constructor, writes and reads don't allocate heap memory.
+ */
+class I2CEEPROM {
+public:
+    /**
+     * @brief Create the EEPROM object, the bus isn't accessed.
+     *
+     * @param master The master of the bus the device is connected to.
+     * @param i2c_addr The address of the device.
+     * @param layout The page layout of the device. \c layout.write_cycle_time is the maximum time to poll for the
+     *      acknowledge of the device after a page write.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c master is empty, \c layout.page_size is 0 or
+     *      \c layout.address_len isn't between 1 and 4
+     */
+    I2CEEPROM(std::shared_ptr<I2CMaster> master, I2CAddress i2c_addr, const I2CPageLayout &layout);
+
+    I2CEEPROM(const I2CEEPROM&) = delete;
+    I2CEEPROM &operator=(const I2CEEPROM&) = delete;
+
+    /**
+     * @brief Write \c data_len bytes from \c data to the memory starting at \c mem_addr.
+     *
+     * Returns after the device has stored the last page.
+     *
+     * The driver reports a NACK of the address and a NACK of a data byte alike, so both are taken as a busy device.
+     * A device which rejects the data, e.g. a write-protected part, is therefore retried until
+     * \c layout.write_cycle_time has passed and reported with ESP_ERR_TIMEOUT, not as a failed transfer.
+     *
+     * @return The statistics of the write, including the achieved throughput.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c data is nullptr or \c data_len is 0
+     * @throws I2CTransferException with ESP_ERR_TIMEOUT if the device didn't acknowledge within the write cycle
+     *      time, with the driver error if a transfer fails otherwise. The pages before have been written.
+     */
+    I2CEEPROMWriteStats write(uint32_t mem_addr, const uint8_t *data, size_t data_len);
+
+    /**
+     * @brief Like \c write() above, with the data in a vector.
+     */
+    I2CEEPROMWriteStats write(uint32_t mem_addr, const std::vector<uint8_t> &data);
+
+    /**
+     * @brief Sequentially read \c buffer_len bytes starting at \c mem_addr into \c buffer.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c buffer is nullptr or \c buffer_len is 0
+     * @throws I2CTransferException with the driver error if the transfer fails
+     */
+    void read(uint32_t mem_addr, uint8_t *buffer, size_t buffer_len);
+
+    /**
+     * @brief Sequentially read \c n_bytes bytes starting at \c mem_addr.
+     *
+     * @return The read data.
+     */
+    std::vector<uint8_t> read(uint32_t mem_addr, size_t n_bytes);
+
+    /**
+     * @brief Poll the device until it acknowledges, i.e. until a previous write cycle has finished.
+     *
+     * @return The number of polls the device didn't acknowledge.
+     *
+     * @throws I2CTransferException with ESP_ERR_TIMEOUT if the device didn't acknowledge within the write cycle
+     *      time, with the driver error for any other failure
+     */
+    size_t wait_ready();
+
+    /**
+     * The address of the device.
+     */
+    const I2CAddress i2c_addr;
+
+    /**
+     * The page layout of the device.
+     */
+    const I2CPageLayout layout;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Copy the memory address and the data up to the next page boundary into \c page_buffer.
+     *
+     * @return The number of data bytes in the page.
+     */
+    size_t prepare_page(uint32_t mem_addr, const uint8_t *data, size_t data_len) noexcept;
+
+    /**
+     * @brief Send the first \c len bytes of \c page_buffer, or only probe if \c len is 0, until the device
+     *      acknowledges.
+     *
+     * Every NACK is retried until the write cycle time has passed, also one of a data byte, see \c write().
+     *
+     * @return The number of attempts the device didn't acknowledge.
+     */
+    size_t poll_until_acked(size_t len);
+
+    std::shared_ptr<I2CMaster> master;
+
+    /**
+     * The memory address followed by the data of the current page.
+     */
+    std::vector<uint8_t> page_buffer;
+};
+
+} // idf
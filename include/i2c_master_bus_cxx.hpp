@@ -0,0 +1,345 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef __cpp_exceptions
+#error I2C class can only be used when __cpp_exceptions is enabled. Enable CONFIG_COMPILER_CXX_EXCEPTIONS in Kconfig
+#endif
+
+#include "esp_idf_version.h"
+
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 2, 0)
+#error I2CMasterBus and I2CMasterDevice require the i2c_master driver of ESP-IDF v5.2 or newer
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "i2c_cxx.hpp"
+
+/**
+ * Handles of the i2c_master driver, declared here to keep the driver header out of this header.
+ */
+struct i2c_master_bus_t;
+struct i2c_master_dev_t;
+
+namespace idf {
+
+/**
+ * @brief Called from the I2C interrupt when an asynchronous transfer of an \c I2CMasterDevice has finished.
+ *
+ * @param result ESP_OK if the transfer succeeded, ESP_FAIL if the device didn't acknowledge.
+ * @param user_data The pointer passed together with the callback when the transfer was queued.
+ *
+ * @return true if a higher priority task has been woken up by the callback, e.g. by giving a semaphore.
+ *
+ * @note The callback runs in ISR context: it must be short, must not block, must not throw and may only use
+ *      ISR-safe FreeRTOS functions. If CONFIG_I2C_ISR_IRAM_SAFE is enabled, it must be placed in IRAM.
+ */
+using I2CDoneCallback = bool (*)(esp_err_t result, void *user_data);
+
+/**
+ * @brief An I2C master bus on the bus-device driver \c driver/i2c_master.h.
+ *
+ * In contrast to \c I2CMaster, which is based on the legacy command link driver, the bus is shared by several
+ * \c I2CMasterDevice objects, each of them with its own address and clock speed.
+ *
+ * If the bus is created with a transaction queue depth greater than 0, transfers of its devices are asynchronous:
+ * they are queued in the driver and the calling task continues while the hardware clocks the bytes. Completion is
+ * signalled from the I2C interrupt.
+ */
+class I2CMasterBus : public I2CBus {
+public:
+    /**
+     * @brief Create the bus driver of an I2C master peripheral.
+     *
+     * @param i2c_number The number of the I2C device.
+     * @param scl_gpio GPIO number of the SCL line.
+     * @param sda_gpio GPIO number of the SDA line.
+     * @param queue_depth Number of transfers queued in the driver, 0 for a synchronous bus.
+     * @param pullup Enable the internal pullups of both lines.
+     *
+     * @throws I2CException with the corrsponding esp_err_t return value if something goes wrong
+     */
+    explicit I2CMasterBus(I2CNumber i2c_number,
+            SCL_GPIO scl_gpio,
+            SDA_GPIO sda_gpio,
+            size_t queue_depth = 0,
+            bool pullup = true);
+
+    /**
+     * @brief Delete the bus driver. All devices must have been destroyed before.
+     */
+    virtual ~I2CMasterBus();
+
+    I2CMasterBus(const I2CMasterBus&) = delete;
+    I2CMasterBus &operator=(const I2CMasterBus&) = delete;
+
+    /**
+     * @return true if the transfers of the devices on this bus are asynchronous.
+     */
+    bool is_async() const noexcept;
+
+    /**
+     * @return The number of transfers queued in the driver, 0 for a synchronous bus.
+     */
+    size_t get_queue_depth() const noexcept;
+
+    /**
+     * @brief Check whether a device acknowledges \c i2c_addr.
+     *
+     * @return true if a device acknowledged, false if no device responded.
+     *
+     * @throws I2CTransferException with the driver error for any other error, e.g. a timeout
+     */
+    bool probe(I2CAddress i2c_addr, std::chrono::milliseconds timeout = SYNC_TIMEOUT);
+
+    /**
+     * @brief Reset the bus, e.g. after a device has been stuck holding SDA low.
+     *
+     * @throws I2CTransferException with the driver error if the reset failed
+     */
+    void reset();
+
+    /**
+     * @brief Block until all queued transfers of all devices on this bus are done.
+     *
+     * @throws I2CTransferException with ESP_ERR_TIMEOUT if the transfers aren't done after \c timeout
+     */
+    void wait_all_done(std::chrono::milliseconds timeout);
+
+    /**
+     * Default timeout of the synchronous transfers and of \c probe().
+     */
+    static const std::chrono::milliseconds SYNC_TIMEOUT;
+
+private:
+    i2c_master_bus_t *handle;
+
+    const size_t queue_depth;
+
+    friend class I2CMasterDevice;
+};
+
+/**
+ * @brief A device on an \c I2CMasterBus with a fixed address and clock speed.
+ *
+ * Synchronous transfers block until they are done and throw on failure, like the ones of \c I2CMaster. On an
+ * asynchronous bus, they queue the transfer and wait until the bus has finished all queued transfers.
+ *
+ * Asynchronous transfers are only available on an asynchronous bus. They return as soon as the transfer is
+ * queued. The buffers are caller-owned and have to stay valid until the transfer is done, which is signalled by
+ * the optional \c I2CDoneCallback from the I2C interrupt. A device can have as many transfers pending as the
+ * queue depth of its bus.
+ */
+class I2CMasterDevice {
+public:
+    /**
+     * @brief Add a device to \c bus.
+     *
+     * @param bus The bus, it is kept alive by the device.
+     * @param i2c_addr The 7-bit address of the device.
+     * @param scl_speed The clock speed used for this device.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c bus is empty, with the corresponding esp_err_t return
+     *      value of the driver if the device can't be added
+     */
+    I2CMasterDevice(std::shared_ptr<I2CMasterBus> bus, I2CAddress i2c_addr, Frequency scl_speed);
+
+    /**
+     * @brief Wait until all pending transfers are done and remove the device from its bus.
+     */
+    ~I2CMasterDevice();
+
+    I2CMasterDevice(const I2CMasterDevice&) = delete;
+    I2CMasterDevice &operator=(const I2CMasterDevice&) = delete;
+
+    /**
+     * @brief Write \c data_len bytes from \c data to the device.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c data is nullptr or \c data_len is 0
+     * @throws I2CTransferException with the driver error if the transfer fails
+     */
+    void sync_write(const uint8_t *data, size_t data_len);
+
+    /**
+     * @brief Like \c sync_write() above, with the data in a vector.
+     */
+    void sync_write(const std::vector<uint8_t> &data);
+
+    /**
+     * @brief Read \c buffer_len bytes from the device into \c buffer.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c buffer is nullptr or \c buffer_len is 0
+     * @throws I2CTransferException with the driver error if the transfer fails
+     */
+    void sync_read(uint8_t *buffer, size_t buffer_len);
+
+    /**
+     * @brief Read \c n_bytes bytes from the device.
+     *
+     * @return The read data.
+     */
+    std::vector<uint8_t> sync_read(size_t n_bytes);
+
+    /**
+     * @brief Write to the device and read from it after a repeated start condition.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if a buffer is nullptr or a length is 0
+     * @throws I2CTransferException with the driver error if the transfer fails
+     */
+    void sync_transfer(const uint8_t *write_data, size_t write_len, uint8_t *read_buffer, size_t read_len);
+
+    /**
+     * @brief Like \c sync_transfer() above, with the data in vectors.
+     *
+     * @return The read data.
+     */
+    std::vector<uint8_t> sync_transfer(const std::vector<uint8_t> &write_data, size_t read_n_bytes);
+
+    /**
+     * @brief Queue a write of \c data_len bytes from \c data to the device.
+     *
+     * @param data The data, it has to stay valid until the transfer is done.
+     * @param data_len The number of bytes to write.
+     * @param on_done Optional callback called from the I2C interrupt when the transfer is done.
+     * @param user_data Passed to \c on_done.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c data is nullptr or \c data_len is 0, with
+     *      ESP_ERR_INVALID_STATE if the bus isn't asynchronous, with ESP_ERR_NO_MEM if as many transfers of this
+     *      device are pending as the queue depth of the bus
+     * @throws I2CTransferException with the driver error if the transfer can't be queued
+     */
+    void async_write(const uint8_t *data, size_t data_len, I2CDoneCallback on_done = nullptr, void *user_data = nullptr);
+
+    /**
+     * @brief Queue a read of \c buffer_len bytes from the device into \c buffer, see \c async_write().
+     */
+    void async_read(uint8_t *buffer, size_t buffer_len, I2CDoneCallback on_done = nullptr, void *user_data = nullptr);
+
+    /**
+     * @brief Queue a write followed by a read after a repeated start condition, see \c async_write().
+     */
+    void async_transfer(const uint8_t *write_data,
+            size_t write_len,
+            uint8_t *read_buffer,
+            size_t read_len,
+            I2CDoneCallback on_done = nullptr,
+            void *user_data = nullptr);
+
+    /**
+     * @return The number of asynchronous transfers of this device which are queued but not done yet.
+     */
+    size_t pending() const noexcept;
+
+    /**
+     * @brief Block until all queued transfers on the bus of this device are done, see
+     *      \c I2CMasterBus::wait_all_done().
+     */
+    void wait_all_done(std::chrono::milliseconds timeout);
+
+    /**
+     * The address of the device.
+     */
+    const I2CAddress i2c_addr;
+
+private:
+    /**
+     * @brief The completion of a queued transfer.
+     */
+    struct Completion {
+        I2CDoneCallback on_done;
+        void *user_data;
+        esp_err_t result;
+    };
+
+    /**
+     * @brief Queue a transfer in the driver, the buffers have been checked already.
+     *
+     * @return The position of the transfer, its completion is at \c slot() of that position.
+     */
+    size_t queue(const uint8_t *write_data,
+            size_t write_len,
+            uint8_t *read_buffer,
+            size_t read_len,
+            I2CDoneCallback on_done,
+            void *user_data);
+
+    /**
+     * @brief Execute a transfer synchronously, the buffers have been checked already.
+     */
+    void execute(const uint8_t *write_data, size_t write_len, uint8_t *read_buffer, size_t read_len);
+
+    /**
+     * @brief Complete the oldest pending transfer, called from the I2C interrupt.
+     *
+     * Like \c next() and \c slot(), it only uses plain members, no out-of-line smart pointer accessors, so it stays in
+     * IRAM also if the code isn't optimized.
+     *
+     * @return The return value of the callback of the transfer.
+     */
+    bool complete(esp_err_t result) noexcept;
+
+    /**
+     * @return The position after \c pos, modulo twice the queue depth.
+     */
+    size_t next(size_t pos) const noexcept;
+
+    /**
+     * @return The number of transfers from the completion position \c done_pos up to the queue position \c queued_pos.
+     */
+    size_t used(size_t done_pos, size_t queued_pos) const noexcept;
+
+    /**
+     * @return The index of the completion of the position \c pos in \c ring.
+     */
+    size_t slot(size_t pos) const noexcept;
+
+    std::shared_ptr<I2CMasterBus> bus;
+
+    i2c_master_dev_t *handle;
+
+    /**
+     * Ring of completions with as many entries as the queue depth of the bus, empty for a synchronous bus.
+     */
+    std::unique_ptr<Completion[]> completions;
+
+    /**
+     * The completions owned by \c completions, for the interrupt.
+     */
+    Completion *ring;
+
+    /**
+     * The queue depth of \c bus, for the interrupt.
+     */
+    const size_t queue_depth;
+
+    /**
+     * Position of the next queued transfer, only written by the tasks queueing transfers.
+     *
+     * The positions wrap modulo twice the queue depth, so a full ring can be told apart from an empty one without
+     * the completion index jumping when a plain counter would overflow.
+     */
+    std::atomic<size_t> queued;
+
+    /**
+     * Position of the next completed transfer, only written by the I2C interrupt.
+     */
+    std::atomic<size_t> completed;
+
+    /**
+     * Serializes the tasks queueing transfers.
+     */
+    std::mutex queue_mutex;
+
+    friend struct I2CMasterDeviceISR;
+};
+
+} // idf
@@ -0,0 +1,252 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef __cpp_exceptions
+#error I2C class can only be used when __cpp_exceptions is enabled. Enable CONFIG_COMPILER_CXX_EXCEPTIONS in Kconfig
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "i2c_cxx.hpp"
+
+namespace idf {
+
+/**
+ * @brief The periodic reads executed by an \c I2CPoller, possibly spread across several buses.
+ */
+class I2CPollSchedule {
+public:
+    /**
+     * @brief Add a periodic read of \c read_len bytes from the device \c i2c_addr.
+     *
+     * @param master The master of the bus the device is connected to.
+     * @param i2c_addr The address of the device.
+     * @param read_len The number of bytes to read.
+     * @param period The time between the starts of two reads.
+     *
+     * @return The id of the read, it identifies the samples of the read.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c master is empty, \c read_len is 0 or \c period isn't
+     *      positive
+     */
+    size_t add_read(std::shared_ptr<I2CMaster> master,
+            I2CAddress i2c_addr,
+            size_t read_len,
+            std::chrono::milliseconds period);
+
+    /**
+     * @brief Add a periodic write-read transfer, e.g. writing a register address and reading the register.
+     *
+     * @param write_data The data written before the read, followed by a repeated start condition. If it is empty,
+     *      only the read is executed.
+     *
+     * For the other parameters, see \c add_read() above.
+     */
+    size_t add_read(std::shared_ptr<I2CMaster> master,
+            I2CAddress i2c_addr,
+            std::vector<uint8_t> write_data,
+            size_t read_len,
+            std::chrono::milliseconds period);
+
+    /**
+     * @return The number of reads in the schedule.
+     */
+    size_t size() const noexcept;
+
+private:
+    struct Entry {
+        std::shared_ptr<I2CMaster> master;
+        I2CAddress i2c_addr;
+        std::vector<uint8_t> write_data;
+        size_t read_len;
+        std::chrono::milliseconds period;
+    };
+
+    std::vector<Entry> entries;
+
+    friend class I2CPoller;
+};
+
+/**
+ * @brief A sample produced by an \c I2CPoller.
+ */
+struct I2CSample {
+    /**
+     * The id of the read returned by \c I2CPollSchedule::add_read().
+     */
+    size_t id;
+
+    /**
+     * The time the transfer started.
+     */
+    std::chrono::steady_clock::time_point timestamp;
+
+    /**
+     * ESP_OK if the read succeeded, otherwise the error of the transfer.
+     */
+    esp_err_t error;
+
+    /**
+     * The read data, empty if the read failed. It is only valid during the sample callback.
+     */
+    I2CByteView data;
+};
+
+/**
+ * @brief Configuration of the tasks of an \c I2CPoller.
+ */
+struct I2CPollerConfig {
+    /**
+     * Stack size of each bus task in bytes, it also has to fit the sample callback.
+     */
+    size_t stack_size = 4096;
+
+    /**
+     * FreeRTOS priority of the bus tasks.
+     */
+    size_t priority = 5;
+
+    /**
+     * Pin the task of the n-th bus of the schedule to core n modulo the number of cores. Otherwise, the tasks have
+     * no core affinity.
+     */
+    bool pin_to_cores = true;
+};
+
+/**
+ * @brief Executes the periodic reads of an \c I2CPollSchedule with one task per bus.
+ *
+ * The reads on different buses are independent hardware transactions, so each bus gets its own task and the
+ * buses are polled concurrently. The tasks are pinned to different cores if available. Hence, the aggregate
+ * sample rate grows with the number of buses instead of being limited by a single polling loop.
+ *
+ * Each task executes the reads of its bus one after another, starting each one at its next due time. The due
+ * times advance by the period of the read, so short delays don't accumulate. If a read is overdue by a whole
+ * period or more, e.g. because the bus is overloaded, the missed periods are skipped and counted.
+ *
+ * The transfers use the non-throwing \c I2CMaster::try_read() and \c I2CMaster::try_transfer() into buffers
+ * allocated once by the poller, so polling doesn't allocate heap memory.
+ *
+ * @note The sample callback is called from the bus tasks, i.e. concurrently for samples of different buses.
+ */
+class I2CPoller {
+public:
+    /**
+     * Receives the samples. It must not throw and should return quickly, the next read of the bus is delayed
+     * meanwhile.
+     */
+    using SampleCallback = std::function<void(const I2CSample&)>;
+
+    /**
+     * @brief Start polling, the first read of each entry is executed immediately.
+     *
+     * @param schedule The reads to execute, copied by the poller.
+     * @param on_sample Receives the samples.
+     * @param config Task configuration.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c schedule is empty or \c on_sample is empty
+     * @throws std::exception for failures in libstdc++, e.g. if a task can't be created
+     */
+    I2CPoller(const I2CPollSchedule &schedule,
+            SampleCallback on_sample,
+            const I2CPollerConfig &config = I2CPollerConfig());
+
+    /**
+     * @brief Stop polling and join the bus tasks. A read in progress is finished first.
+     */
+    ~I2CPoller();
+
+    I2CPoller(const I2CPoller&) = delete;
+    I2CPoller &operator=(const I2CPoller&) = delete;
+
+    /**
+     * @return The number of buses, which is the number of bus tasks.
+     */
+    size_t get_bus_count() const noexcept;
+
+    /**
+     * @return The number of samples delivered so far, including failed reads.
+     */
+    size_t get_sample_count() const noexcept;
+
+    /**
+     * @return The number of periods skipped so far because a read was overdue by at least a whole period.
+     */
+    size_t get_missed_count() const noexcept;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * The reads of one bus and their buffers.
+     */
+    struct Bus {
+        std::shared_ptr<I2CMaster> master;
+
+        /**
+         * The ids of the reads on this bus.
+         */
+        std::vector<size_t> ids;
+
+        /**
+         * The offsets of the buffers of the reads in \c buffer, in the order of \c ids.
+         */
+        std::vector<size_t> offsets;
+
+        /**
+         * The buffers of all reads on this bus.
+         */
+        std::vector<uint8_t> buffer;
+
+        /**
+         * The task of the bus.
+         */
+        std::thread thread;
+    };
+
+    /**
+     * The loop running inside the task of \c bus.
+     */
+    void run(Bus &bus);
+
+    /**
+     * Request the stop of the bus tasks and join them.
+     */
+    void stop() noexcept;
+
+    const std::vector<I2CPollSchedule::Entry> entries;
+
+    SampleCallback on_sample;
+
+    std::vector<std::unique_ptr<Bus> > buses;
+
+    /**
+     * Protects \c stop_requested.
+     */
+    std::mutex stop_mutex;
+
+    /**
+     * Wakes up the bus tasks on a stop request.
+     */
+    std::condition_variable stop_signal;
+
+    bool stop_requested;
+
+    std::atomic<size_t> sample_count;
+
+    std::atomic<size_t> missed_count;
+};
+
+} // idf
@@ -0,0 +1,296 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef __cpp_exceptions
+#error I2C class can only be used when __cpp_exceptions is enabled. Enable CONFIG_COMPILER_CXX_EXCEPTIONS in Kconfig
+#endif
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+
+#include "i2c_cxx.hpp"
+
+namespace idf {
+
+/**
+ * @brief Description of an 8-bit register of an I2C device with 8-bit register addresses.
+ */
+struct I2CRegister {
+    /**
+     * The register address.
+     */
+    uint8_t address;
+
+    /**
+     * The device may change the register by itself (e.g. status or measurement registers).
+     * Volatile registers are never read from the cache.
+     */
+    bool is_volatile;
+
+    /**
+     * The device increments its register pointer after an access to this register.
+     * Only then, a burst write may continue at the next register address.
+     */
+    bool auto_increment;
+};
+
+/**
+ * @brief Check at compile time that the register addresses of a register map are strictly ascending.
+ *
+ * Strictly ascending addresses are unique and let \c I2CRegisterDevice find a register by binary search.
+ */
+template<size_t N>
+constexpr bool i2c_register_map_ascending(const std::array<I2CRegister, N> &register_map)
+{
+    for (size_t i = 1; i < N; i++) {
+        if (register_map[i - 1].address >= register_map[i].address) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief I2C device with a map of 8-bit registers, keeping a shadow copy of the non-volatile registers.
+ *
+ * The register map is a template argument: a \c constexpr \c std::array of \c I2CRegister with static storage
+ * duration, sorted by register address. It is checked at compile time and isn't copied into each device.
+ *
+ * Reads of non-volatile registers are served from the shadow copy after they have been read or written once.
+ * Writes are recorded in the shadow copy and sent to the device by \c flush(), which merges writes to adjacent
+ * register addresses into one burst write. This way, read-modify-write sequences via \c update_bits() cost no bus
+ * transfer for the read.
+ *
+ * Register accesses use the common protocol: a write transfers the register address followed by the data,
+ * a read writes the register address and reads the data after a repeated start condition.
+ *
+ * Example:
+ * @code
+ * static constexpr std::array<I2CRegister, 2> SENSOR_REGISTERS = {{ {0x10, false, true}, {0x11, true, false} }};
+ * I2CRegisterDevice<SENSOR_REGISTERS> sensor(master, I2CAddress(0x47));
+ * @endcode
+ *
+ * @note Pending writes are sent in ascending register address order, not in the order of the \c write() calls.
+ *      Call \c flush() in between if the order matters. Pending writes are not flushed by the destructor.
+ * @note This class is not thread-safe.
+ */
+template<const auto &RegisterMap>
+class I2CRegisterDevice {
+public:
+    static_assert(std::is_same<std::decay_t<decltype(RegisterMap)>,
+            std::array<I2CRegister, std::tuple_size<std::decay_t<decltype(RegisterMap)>>::value>>::value,
+            "register map must be a std::array of I2CRegister");
+
+    /**
+     * The number of registers in the register map.
+     */
+    static constexpr size_t N = std::tuple_size<std::decay_t<decltype(RegisterMap)>>::value;
+
+    static_assert(N > 0, "register map must contain at least one register");
+    static_assert(i2c_register_map_ascending(RegisterMap),
+            "register addresses of the register map must be unique and in ascending order");
+
+    /**
+     * @param master The master of the bus the device is connected to.
+     * @param i2c_addr The address of the device.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c master is empty
+     */
+    I2CRegisterDevice(std::shared_ptr<I2CMaster> master, I2CAddress i2c_addr);
+
+    /**
+     * @brief Read a register, from the shadow copy if it is non-volatile and has been accessed before.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the register is not in the register map or the error of the
+     *      bus transfer
+     */
+    uint8_t read(uint8_t reg_addr);
+
+    /**
+     * @brief Record a write to a register, it will be sent to the device by the next \c flush().
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the register is not in the register map
+     */
+    void write(uint8_t reg_addr, uint8_t value);
+
+    /**
+     * @brief Set the bits in \c mask of a register to the corresponding bits of \c value.
+     *
+     * The current value is read by \c read(), i.e. usually from the shadow copy. A write is only recorded if the
+     * register value changes.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the register is not in the register map or the error of the
+     *      bus transfer
+     */
+    void update_bits(uint8_t reg_addr, uint8_t mask, uint8_t value);
+
+    /**
+     * @brief Send all pending writes to the device, merging writes to adjacent registers into burst writes.
+     *
+     * @throws I2CException of the failed bus transfer. The writes which haven't been sent stay pending.
+     */
+    void flush();
+
+    /**
+     * @brief Forget the shadow copy, e.g. after a reset of the device. Pending writes are discarded.
+     */
+    void invalidate() noexcept;
+
+    /**
+     * @return true if there are writes which haven't been sent to the device yet.
+     */
+    bool has_pending_writes() const noexcept;
+
+private:
+    /**
+     * @return The index of the register in the register map.
+     * @throws I2CException with ESP_ERR_INVALID_ARG if the register is not in the register map
+     */
+    size_t index_of(uint8_t reg_addr) const;
+
+    std::shared_ptr<I2CMaster> master;
+
+    const I2CAddress i2c_addr;
+
+    /**
+     * The shadow copy, in the same order as the register map.
+     */
+    std::array<uint8_t, N> shadow;
+
+    /**
+     * Registers whose shadow copy is valid.
+     */
+    std::bitset<N> cached;
+
+    /**
+     * Registers with pending writes.
+     */
+    std::bitset<N> dirty;
+};
+
+template<const auto &RegisterMap>
+I2CRegisterDevice<RegisterMap>::I2CRegisterDevice(std::shared_ptr<I2CMaster> master_arg, I2CAddress i2c_addr_arg)
+    : master(std::move(master_arg)), i2c_addr(i2c_addr_arg), shadow(), cached(), dirty()
+{
+    if (!master) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+}
+
+template<const auto &RegisterMap>
+uint8_t I2CRegisterDevice<RegisterMap>::read(uint8_t reg_addr)
+{
+    size_t index = index_of(reg_addr);
+
+    if (!RegisterMap[index].is_volatile && cached.test(index)) {
+        return shadow[index];
+    }
+
+    // a volatile register has to be written before it can be read back
+    if (dirty.test(index)) {
+        flush();
+    }
+
+    uint8_t value;
+    master->sync_transfer(i2c_addr, &reg_addr, 1, &value, 1);
+
+    if (!RegisterMap[index].is_volatile) {
+        shadow[index] = value;
+        cached.set(index);
+    }
+
+    return value;
+}
+
+template<const auto &RegisterMap>
+void I2CRegisterDevice<RegisterMap>::write(uint8_t reg_addr, uint8_t value)
+{
+    size_t index = index_of(reg_addr);
+
+    shadow[index] = value;
+    cached.set(index);
+    dirty.set(index);
+}
+
+template<const auto &RegisterMap>
+void I2CRegisterDevice<RegisterMap>::update_bits(uint8_t reg_addr, uint8_t mask, uint8_t value)
+{
+    uint8_t old_value = read(reg_addr);
+    uint8_t new_value = (old_value & ~mask) | (value & mask);
+
+    if (new_value != old_value || RegisterMap[index_of(reg_addr)].is_volatile) {
+        write(reg_addr, new_value);
+    }
+}
+
+template<const auto &RegisterMap>
+void I2CRegisterDevice<RegisterMap>::flush()
+{
+    // register address followed by at most N values
+    std::array<uint8_t, N + 1> burst;
+
+    size_t index = 0;
+    while (index < N) {
+        if (!dirty.test(index)) {
+            index++;
+            continue;
+        }
+
+        size_t first = index;
+        burst[0] = RegisterMap[first].address;
+        size_t burst_len = 1;
+        burst[burst_len++] = shadow[index];
+
+        // extend the burst while the device moves on to the next register address, which has a pending write
+        while (RegisterMap[index].auto_increment
+                && index + 1 < N
+                && dirty.test(index + 1)
+                && RegisterMap[index + 1].address == RegisterMap[index].address + 1) {
+            index++;
+            burst[burst_len++] = shadow[index];
+        }
+
+        master->sync_write(i2c_addr, burst.data(), burst_len);
+
+        for (size_t i = first; i <= index; i++) {
+            dirty.reset(i);
+        }
+        index++;
+    }
+}
+
+template<const auto &RegisterMap>
+void I2CRegisterDevice<RegisterMap>::invalidate() noexcept
+{
+    cached.reset();
+    dirty.reset();
+}
+
+template<const auto &RegisterMap>
+bool I2CRegisterDevice<RegisterMap>::has_pending_writes() const noexcept
+{
+    return dirty.any();
+}
+
+template<const auto &RegisterMap>
+size_t I2CRegisterDevice<RegisterMap>::index_of(uint8_t reg_addr) const
+{
+    auto it = std::lower_bound(RegisterMap.begin(), RegisterMap.end(), reg_addr,
+            [](const I2CRegister &reg, uint8_t addr) { return reg.address < addr; });
+
+    if (it == RegisterMap.end() || it->address != reg_addr) {
+        throw I2CException(ESP_ERR_INVALID_ARG);
+    }
+
+    return it - RegisterMap.begin();
+}
+
+} // idf
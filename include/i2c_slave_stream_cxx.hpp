@@ -0,0 +1,276 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef __cpp_exceptions
+#error I2C class can only be used when __cpp_exceptions is enabled. Enable CONFIG_COMPILER_CXX_EXCEPTIONS in Kconfig
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "i2c_cxx.hpp"
+
+namespace idf {
+
+/**
+ * @brief Lock-free ring buffer of bytes for exactly one producer and one consumer thread.
+ *
+ * Both sides can work in place: the producer fills the region returned by \c prepare() and publishes it with
+ * \c commit(), the consumer reads the region returned by \c peek() and releases it with \c consume(). Each region is
+ * contiguous, so at the wrap-around of the buffer, it only reaches up to the end of the buffer.
+ *
+ * The read and write positions count modulo twice the capacity instead of running freely. This way, a full buffer
+ * can be told apart from an empty one and the offset in the buffer stays consistent when the positions wrap around,
+ * for any capacity.
+ *
+ * @note Only one thread may call the producer methods and only one thread may call the consumer methods.
+ *      \c size() and \c capacity() may be called by any thread.
+ */
+class I2CRingBuffer {
+public:
+    /**
+     * @param capacity The maximum number of bytes stored.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c capacity is 0 or larger than \c SIZE_MAX / 2
+     * @throws std::bad_alloc if the buffer can't be allocated
+     */
+    explicit I2CRingBuffer(size_t capacity);
+
+    I2CRingBuffer(const I2CRingBuffer&) = delete;
+    I2CRingBuffer &operator=(const I2CRingBuffer&) = delete;
+
+    /**
+     * @return The maximum number of bytes stored.
+     */
+    size_t capacity() const noexcept;
+
+    /**
+     * @return The number of bytes which can be consumed.
+     */
+    size_t size() const noexcept;
+
+    /**
+     * @brief Producer: get the contiguous free region at the write position.
+     *
+     * @param[out] free_len The size of the region, 0 if the buffer is full.
+     *
+     * @return The start of the region.
+     */
+    uint8_t *prepare(size_t &free_len) noexcept;
+
+    /**
+     * @brief Producer: publish \c len bytes written into the region returned by \c prepare().
+     *
+     * @throws I2CException with ESP_ERR_INVALID_SIZE if \c len exceeds the region returned by \c prepare()
+     */
+    void commit(size_t len);
+
+    /**
+     * @brief Producer: copy as many bytes of \c data into the buffer as fit.
+     *
+     * @return The number of bytes copied.
+     */
+    size_t write(const uint8_t *data, size_t len) noexcept;
+
+    /**
+     * @brief Consumer: get the contiguous region of bytes at the read position without removing them.
+     *
+     * The view stays valid until the bytes are consumed.
+     */
+    I2CByteView peek() const noexcept;
+
+    /**
+     * @brief Consumer: remove \c len bytes at the read position.
+     *
+     * \c len may exceed the region returned by \c peek() if the bytes after the wrap-around have been read as well.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_SIZE if \c len exceeds \c size()
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief Consumer: copy and remove up to \c len bytes.
+     *
+     * @return The number of bytes copied.
+     */
+    size_t read(uint8_t *buffer, size_t len) noexcept;
+
+private:
+    /**
+     * @return The position \c len bytes after \c pos, modulo twice the capacity.
+     */
+    size_t advance(size_t pos, size_t len) const noexcept;
+
+    /**
+     * @return The number of bytes from the read position \c read_pos up to the write position \c write_pos.
+     */
+    size_t used(size_t read_pos, size_t write_pos) const noexcept;
+
+    /**
+     * @return The offset of the position \c pos in \c buffer.
+     */
+    size_t offset(size_t pos) const noexcept;
+
+    std::unique_ptr<uint8_t[]> buffer;
+
+    const size_t buffer_size;
+
+    /**
+     * Write position, the number of bytes committed modulo twice the capacity. Only written by the producer.
+     */
+    std::atomic<size_t> written;
+
+    /**
+     * Read position, the number of bytes consumed modulo twice the capacity. Only written by the consumer.
+     */
+    std::atomic<size_t> consumed;
+};
+
+#if CONFIG_SOC_I2C_SUPPORT_SLAVE
+
+/**
+ * @brief Configuration of an \c I2CSlaveStream and its receive task.
+ */
+struct I2CSlaveStreamConfig {
+    /**
+     * Size of the ring buffer in bytes, in addition to the receive buffer of the driver.
+     */
+    size_t buffer_size = 256;
+
+    /**
+     * Stack size of the receive task in bytes.
+     */
+    size_t stack_size = 4096;
+
+    /**
+     * FreeRTOS priority of the receive task.
+     */
+    size_t priority = 5;
+
+    /**
+     * The core the receive task is pinned to, a negative value means no affinity.
+     */
+    int core_id = -1;
+};
+
+/**
+ * @brief Streams the data written by the master to an \c I2CSlave into a ring buffer.
+ *
+ * A receive task waits on the driver for data and moves it into an \c I2CRingBuffer, reading directly into the
+ * free region of the buffer. After each chunk of data, the optional receive callback is called from the receive
+ * task, and threads blocked in \c wait() are woken up. The application parses the data in place via \c peek() and
+ * \c consume().
+ *
+ * If the ring buffer is full, the receive task stops taking data out of the driver until the application has
+ * consumed data. Data is lost only if the receive buffer of the driver overflows meanwhile.
+ *
+ * @note The legacy slave driver doesn't signal the end of a write of the master. Hence, data is delivered as soon
+ *      as the driver has received it, a single write of the master may be delivered in several chunks.
+ * @note The consumer methods must be called by only one thread at a time, usually the receive callback or one
+ *      application task.
+ */
+class I2CSlaveStream {
+public:
+    /**
+     * Called by the receive task after new data has been put into the ring buffer. It must not throw.
+     */
+    using ReceiveCallback = std::function<void(I2CSlaveStream&)>;
+
+    /**
+     * @brief Create the ring buffer and start the receive task.
+     *
+     * @param slave The slave whose received data is streamed. No other code may read from it meanwhile.
+     * @param config Buffer size and task configuration.
+     * @param on_receive Optional callback called after new data has been received.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c slave is empty or the buffer size is 0
+     * @throws std::exception for failures in libstdc++, e.g. if the task can't be created
+     */
+    I2CSlaveStream(std::shared_ptr<I2CSlave> slave,
+            const I2CSlaveStreamConfig &config = I2CSlaveStreamConfig(),
+            ReceiveCallback on_receive = nullptr);
+
+    /**
+     * @brief Stop and join the receive task. Data still in the ring buffer is discarded.
+     */
+    ~I2CSlaveStream();
+
+    I2CSlaveStream(const I2CSlaveStream&) = delete;
+    I2CSlaveStream &operator=(const I2CSlaveStream&) = delete;
+
+    /**
+     * @return The number of received bytes which haven't been consumed yet.
+     */
+    size_t available() const noexcept;
+
+    /**
+     * @brief Get the contiguous region of received bytes without removing them, see \c I2CRingBuffer::peek().
+     */
+    I2CByteView peek() const noexcept;
+
+    /**
+     * @brief Remove \c len received bytes, see \c I2CRingBuffer::consume().
+     *
+     * @throws I2CException with ESP_ERR_INVALID_SIZE if \c len exceeds \c available()
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief Copy and remove up to \c len received bytes.
+     *
+     * @return The number of bytes copied.
+     */
+    size_t read(uint8_t *buffer, size_t len) noexcept;
+
+    /**
+     * @brief Block until received data is available or \c timeout has passed.
+     *
+     * @return true if data is available.
+     */
+    bool wait(std::chrono::milliseconds timeout);
+
+    /**
+     * Time the receive task blocks in the driver before it checks for a stop request.
+     */
+    static const std::chrono::milliseconds RECEIVE_TIMEOUT;
+
+private:
+    /**
+     * The loop running inside the receive task.
+     */
+    void run();
+
+    std::shared_ptr<I2CSlave> slave;
+
+    I2CRingBuffer ring;
+
+    ReceiveCallback on_receive;
+
+    /**
+     * Only used for \c wait(), the ring buffer itself is lock-free.
+     */
+    std::mutex notify_mutex;
+
+    std::condition_variable data_available;
+
+    std::atomic<bool> stop_requested;
+
+    /**
+     * The receive task itself.
+     */
+    std::thread receive_thread;
+};
+
+#endif // CONFIG_SOC_I2C_SUPPORT_SLAVE
+
+} // idf
@@ -0,0 +1,151 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifndef __cpp_exceptions
+#error I2C class can only be used when __cpp_exceptions is enabled. Enable CONFIG_COMPILER_CXX_EXCEPTIONS in Kconfig
+#endif
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "i2c_cxx.hpp"
+
+#if CONFIG_ESP_IDF_CXX_I2C_TRACE
+
+namespace idf {
+
+/**
+ * @brief Timing applied by \c I2CTrace when replaying a log.
+ */
+enum class I2CReplayTiming {
+    /**
+     * Replay the transactions as fast as possible.
+     */
+    NONE,
+
+    /**
+     * Each transaction takes as long as the recorded one.
+     */
+    DURATION,
+
+    /**
+     * Additionally, no transaction starts earlier after the start of the replay than the recorded one after the
+     * start of the recording.
+     */
+    ORIGINAL,
+};
+
+/**
+ * @brief Records the transactions of all command links into a binary log and replays such logs.
+ *
+ * Only available if CONFIG_ESP_IDF_CXX_I2C_TRACE is enabled. Each \c I2CCommandLink created during a recording
+ * stores its commands and, after its execution, passes them together with the read data, the result and the timing
+ * to the recorder. The recorder encodes them and hands the encoded bytes to a sink provided by the application, e.g.
+ * to store them in a file or send them over UART.
+ *
+ * During a replay, command links don't use the driver at all. Instead, each execution is matched against the next
+ * transaction of the log: the read buffers are filled with the recorded data and the recorded result is returned
+ * after waiting according to the \c I2CReplayTiming. This allows to run drivers for I2C devices on the Linux target
+ * against recorded traffic, e.g. to benchmark them.
+ *
+ * The log starts with the 4 bytes "I2CT" and a format version byte. Each transaction is stored as (all numbers
+ * little-endian):
+ *  - u8 I2C port
+ *  - i32 result
+ *  - u32 microseconds since the start of the previous transaction (since the start of the recording for the first)
+ *  - u32 duration in microseconds
+ *  - u16 number of commands, followed by the commands: u8 \c I2CTraceOpType, for writes and reads followed by the
+ *    u32 length and the written or read bytes.
+ *
+ * All methods are thread-safe. Recording and replay can't be active at the same time.
+ */
+class I2CTrace {
+public:
+    /**
+     * Receives encoded parts of the log. It is called with the internal lock of the recorder held and must not
+     * throw.
+     */
+    using Sink = std::function<void(const uint8_t *data, size_t len)>;
+
+    /**
+     * @brief Start recording, the log header is passed to \c sink immediately.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c sink is empty, with ESP_ERR_INVALID_STATE if a recording
+     *      or replay is active already
+     */
+    static void start_recording(Sink sink);
+
+    /**
+     * @brief Stop recording. Command links created during the recording still record their transaction.
+     */
+    static void stop_recording() noexcept;
+
+    /**
+     * @return true if a recording is active.
+     */
+    static bool is_recording() noexcept;
+
+    /**
+     * @brief Start the replay of a log.
+     *
+     * @param log The complete log as produced by a recording.
+     * @param timing The timing of the replayed transactions.
+     *
+     * @throws I2CException with ESP_ERR_INVALID_ARG if \c log is malformed, with ESP_ERR_INVALID_STATE if a
+     *      recording or replay is active already
+     */
+    static void start_replay(std::vector<uint8_t> log, I2CReplayTiming timing = I2CReplayTiming::DURATION);
+
+    /**
+     * @brief Stop the replay. Command links created during the replay fail with ESP_ERR_INVALID_STATE.
+     */
+    static void stop_replay() noexcept;
+
+    /**
+     * @return true if a replay is active.
+     */
+    static bool is_replaying() noexcept;
+
+    /**
+     * @return The number of transactions of the replayed log which haven't been executed yet.
+     */
+    static size_t replay_remaining() noexcept;
+
+    /**
+     * @brief Record an executed transaction, called by \c I2CCommandLink.
+     *
+     * @param i2c_num The bus of the transaction.
+     * @param ops The commands of the transaction, the read buffers contain the read data.
+     * @param result The result of the transaction.
+     * @param start_us The start time according to \c esp_timer_get_time().
+     * @param duration_us The duration of the transaction.
+     */
+    static void record(I2CNumber i2c_num,
+            const std::vector<I2CTraceOp> &ops,
+            esp_err_t result,
+            int64_t start_us,
+            int64_t duration_us) noexcept;
+
+    /**
+     * @brief Replay the next transaction of the log, called by \c I2CCommandLink instead of executing \c ops.
+     *
+     * @return The recorded result, ESP_ERR_INVALID_STATE if there is no replay, the log is exhausted or the next
+     *      transaction of the log doesn't match \c i2c_num and \c ops.
+     */
+    static esp_err_t replay(I2CNumber i2c_num, const std::vector<I2CTraceOp> &ops) noexcept;
+
+    /**
+     * Version of the log format.
+     */
+    static const uint8_t FORMAT_VERSION = 1;
+};
+
+} // idf
+
+#endif // CONFIG_ESP_IDF_CXX_I2C_TRACE
@@ -14,6 +14,7 @@
 #include <vector>
 #include <list>
 #include <future>
+#include <type_traits>
 
 #include "system_cxx.hpp"
 #include "spi_cxx.hpp"
@@ -27,6 +28,66 @@ struct SPITransferException : public SPIException {
     SPITransferException(esp_err_t error);
 };
 
+/**
+ * @brief The lengths of the phases the hardware sends before the data phase of a transaction.
+ *
+ * The command and address values are passed with the transaction, see \c SPIDevice::transfer(). During the dummy
+ * phase, the clock runs without data, e.g. to give a flash time to fetch the data. A phase with 0 bits is skipped.
+ */
+struct SPIPhaseBits {
+    /**
+     * Length of the command phase, 0 to 16 bits.
+     */
+    uint8_t command_bits = 0;
+
+    /**
+     * Length of the address phase, 0 to 64 bits.
+     */
+    uint8_t address_bits = 0;
+
+    /**
+     * Length of the dummy phase in clock cycles.
+     */
+    uint8_t dummy_bits = 0;
+};
+
+/**
+ * @brief The number of data lines used in the phases of a transaction, given as command-address-data lines.
+ *
+ * All modes except \c SINGLE need a half-duplex device, see \c SPIDeviceConfig::half_duplex, since the data lines
+ * are used in both directions. The quad modes also need the \c QSPIWP and \c QSPIHD pins of the \c SPIMaster.
+ */
+enum class SPILineMode {
+    SINGLE, ///< 1-1-1, standard SPI
+    DUAL,   ///< 1-1-2, e.g. the Fast Read Dual Output command of flashes
+    DIO,    ///< 1-2-2, e.g. the Fast Read Dual I/O command of flashes
+    QUAD,   ///< 1-1-4, e.g. the Fast Read Quad Output command of flashes
+    QIO,    ///< 1-4-4, e.g. the Fast Read Quad I/O command of flashes
+    QPI,    ///< 4-4-4, e.g. flashes and PSRAMs in QPI mode
+};
+
+/**
+ * @brief Optional configuration of an \c SPIDevice.
+ */
+struct SPIDeviceConfig {
+    /**
+     * The default lengths of the command, address and dummy phases of the transactions of the device.
+     */
+    SPIPhaseBits phase_bits;
+
+    /**
+     * The default line mode of the transactions of the device.
+     */
+    SPILineMode line_mode = SPILineMode::SINGLE;
+
+    /**
+     * Send and receive in separate phases of the transaction instead of at the same time. This is necessary for
+     * the dual and quad line modes. A transfer with data to send then receives as many bytes after sending them,
+     * which the driver doesn't support on buses with DMA. Use \c SPIDevice::read() to only receive.
+     */
+    bool half_duplex = false;
+};
+
 class SPIDevice;
 class SPIDeviceHandle;
 
@@ -34,12 +95,15 @@ class SPIDeviceHandle;
  * @brief Describes and encapsulates the transaction.
  *
  * @note This class is intended to be used internally by the SPI C++ classes, but not publicly.
- *      Furthermore, currently only one transaction per time can be handled. If you need to
- *      send several transactions in parallel, you need to build your own mechanism around a
- *      FreeRTOS task and a queue.
+ *      Several transactions of the same device can be in flight. The driver returns their results in the order
+ *      they have been started, so waiting for a transaction also finishes all transactions of the device started
+ *      before it. The transactions of a device must be started and waited for from the same task.
+ *      A descriptor can be reused for further transactions once its transaction is finished, its transaction
+ *      descriptor and owned buffers are then reused, so the driver data is only allocated once.
  */
 class SPITransactionDescriptor {
     friend class SPIDeviceHandle;
+    friend class SPIDevice;
 public:
     /**
      * @brief Create a SPITransactionDescriptor object, describing a full duplex transaction.
@@ -57,6 +121,31 @@ public:
             std::function<void(void *)> post_callback = nullptr,
             void* user_data = nullptr);
 
+    /**
+     * @brief Create a SPITransactionDescriptor object, describing a full duplex transaction on caller-owned buffers.
+     *
+     * The buffers are passed to the driver directly, nothing is copied. They must stay valid until the transaction
+     * is finished, i.e. until \c wait() or \c get() returned or \c wait_for() returned true.
+     *
+     * @param tx_buffer The data sent to the SPI device.
+     * @param rx_buffer Receives the data read from the SPI device.
+     * @param size The size of both buffers in bytes, which is the length of both write and read operation.
+     * @param handle to the internal driver handle
+     * @param pre_callback If non-empty, this callback will be called directly before the transaction.
+     * @param post_callback If non-empty, this callback will be called directly after the transaction.
+     * @param user_data optional data which will be accessible in the callbacks declared above
+     *
+     * @note The buffers should be DMA-capable (e.g. allocated with \c heap_caps_malloc() and MALLOC_CAP_DMA) and
+     *      word-aligned. Otherwise, the driver allocates temporary DMA buffers and copies the data.
+     */
+    SPITransactionDescriptor(const uint8_t *tx_buffer,
+            uint8_t *rx_buffer,
+            size_t size,
+            SPIDeviceHandle *handle,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
     /**
      * @brief Deinitialize and delete all data of the transaction.
      *
@@ -76,7 +165,8 @@ public:
      * @brief Synchronously (blocking) wait for the result and return the result data or throw an exception.
      *
      * @return The data read from the SPI device. Its length is the length of \c data_to_send passed in the
-     *      constructor.
+     *      constructor. If the transaction uses caller-owned buffers, the data is already in the RX buffer and the
+     *      returned vector is empty. It is also empty for transmit-only transactions.
      * @throws SPIException in case of an error of the underlying driver or if the driver returns a wrong
      *      transaction descriptor for some reason. In the former case, the error code is the one from the
      *      underlying driver, in the latter case, the error code is ESP_ERR_INVALID_STATE.
@@ -107,6 +197,102 @@ public:
     bool wait_for(const std::chrono::milliseconds &timeout);
 
 private:
+    /**
+     * @brief Create an unprepared descriptor, allocating the driver transaction descriptor but no buffers.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c handle is nullptr
+     */
+    explicit SPITransactionDescriptor(SPIDeviceHandle *handle);
+
+    /**
+     * @brief Prepare a new transaction like the vector constructor above, reusing the allocated buffers if they
+     *      are large enough.
+     *
+     * In contrast to the constructor, \c data_to_send may be empty for transactions consisting only of command and
+     * address phases.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_STATE if the previous transaction is still in flight
+     */
+    void prepare(const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data);
+
+    /**
+     * @brief Prepare a new transaction like the caller-owned buffer constructor above.
+     *
+     * In contrast to the constructor, one of the buffers may be nullptr for a transmit-only or receive-only
+     * transaction.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if both buffers are nullptr or \c size is 0, with
+     *      ESP_ERR_INVALID_STATE if the previous transaction is still in flight
+     */
+    void prepare(const uint8_t *tx_buffer,
+            uint8_t *rx_buffer,
+            size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data);
+
+    /**
+     * @brief Keep CS asserted after the prepared transaction.
+     */
+    void set_cs_keep_active() noexcept;
+
+    /**
+     * @brief Set the line mode of the prepared transaction.
+     */
+    void set_line_mode(SPILineMode line_mode) noexcept;
+
+    /**
+     * @brief Set the command and address of the prepared transaction, sent in the phases configured for the device.
+     */
+    void set_phases(uint16_t cmd, uint64_t addr) noexcept;
+
+    /**
+     * @brief Set the command and address of the prepared transaction, sent in phases with the given lengths
+     *      instead of the ones configured for the device.
+     */
+    void set_phases(const SPIPhaseBits &phase_bits, uint16_t cmd, uint64_t addr) noexcept;
+
+    /**
+     * @brief Prepare a new receive-only transaction of \c size bytes into the allocated RX buffer, which is grown if
+     *      necessary.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_STATE if the previous transaction is still in flight
+     */
+    void prepare_read(size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data);
+
+    /**
+     * @brief Prepare a new transmit-only transaction of \c data_to_send, which is copied into the allocated TX
+     *      buffer. The TX buffer is grown if necessary, the RX buffer isn't touched.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_STATE if the previous transaction is still in flight
+     */
+    void prepare_write(const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data);
+
+    /**
+     * @brief Grow the allocated TX and RX buffers to at least \c tx_size and \c rx_size bytes.
+     */
+    void reserve(size_t tx_size, size_t rx_size);
+
+    /**
+     * @brief Reset the driver transaction descriptor and the state for a new transaction on the given buffers.
+     *      A nullptr buffer skips the corresponding direction.
+     */
+    void reset(const uint8_t *tx_data,
+            uint8_t *rx_data,
+            size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data);
+
     /**
      * Private descriptor data.
      */
@@ -129,10 +315,31 @@ private:
 
     /**
      * Buffer in spi_transaction_t is const, so we have to declare it here because we want to
-     * allocate and delete it.
+     * allocate and delete it. Like \c rx_buffer, it is DMA-capable, word-aligned and padded to whole words.
      */
     uint8_t *tx_buffer;
 
+    /**
+     * Receives the data if the buffers are owned by this object. It is DMA-capable, word-aligned and padded to
+     * whole words, so the driver doesn't allocate a temporary DMA buffer for it.
+     */
+    uint8_t *rx_buffer;
+
+    /**
+     * The size of \c tx_buffer, it only grows when the descriptor is reused.
+     */
+    size_t tx_buffer_size;
+
+    /**
+     * The size of \c rx_buffer, it only grows when the descriptor is reused.
+     */
+    size_t rx_buffer_size;
+
+    /**
+     * Tells if the current transaction uses the buffers allocated by this object, otherwise they are caller-owned.
+     */
+    bool owns_buffers;
+
     /**
      * @brief User data which will be provided in the callbacks.
      */
@@ -188,6 +395,9 @@ public:
     /**
      * @brief Wait until the asynchronous operation is done and return the result or throw and exception.
      *
+     * As in std::future, the future releases its shared state and becomes invalid, so the device can reuse the
+     * transaction for later transfers.
+     *
      * @throws std::future_error if this future is not valid.
      * @throws SPIException in case of an error of the underlying driver or if the driver returns a wrong
      *      transaction descriptor for some reason. In the former case, the error code is the one from the
@@ -202,11 +412,17 @@ public:
      * @param timeout Maximum timeout value for waiting
      *
      * @return std::future_status::ready if result is available, std::future_status::timeout if wait timed out
+     *
+     * @throws std::future_error if this future is not valid.
      */
     std::future_status wait_for(std::chrono::milliseconds timeout);
 
     /**
      * @brief Wait for a result indefinitely.
+     *
+     * Unlike \c get(), the future stays valid and keeps its transaction descriptor, see \c SPIDevice.
+     *
+     * @throws std::future_error if this future is not valid.
      */
     void wait();
 
@@ -229,9 +445,59 @@ private:
 
 /**
  * @brief Represents an device on an initialized Master Bus.
+ *
+ * The device recycles a fixed pool of transaction descriptors, one per entry of its transaction queue. A future
+ * keeps its descriptor until \c SPIFuture::get() is called or the future is destroyed, \c SPIFuture::wait() and
+ * \c SPIFuture::wait_for() don't release it. While a future still holds the descriptor which is due for the next
+ * transfer, that transfer allocates a fresh descriptor on the heap.
  */
 class SPIDevice {
 public:
+    /**
+     * @brief Keeps the bus acquired by a device for a burst of transactions, as long as the session exists.
+     *
+     * Without a session, the device acquires the bus when it starts a transaction while none is in flight and
+     * releases it after the last one. A session acquires it once instead, so back-to-back queued and polling
+     * transactions of the device don't pay for locking the bus each time, and no other device can use the bus in
+     * between. The session can also keep CS asserted between transactions, e.g. for a command consisting of
+     * several transactions.
+     *
+     * @note The session must be destroyed before its device, in the task which created it. Transactions still in
+     *      flight when the session ends keep the bus acquired until they are finished.
+     */
+    class BusSession {
+    public:
+        /**
+         * @brief Acquire the bus for \c device.
+         *
+         * @param device The device which uses the bus during the session.
+         * @param keep_cs_active The initial setting of \c set_cs_keep_active().
+         *
+         * @throws SPIException with ESP_ERR_INVALID_STATE if \c device already has a session, with the IDF error
+         *      code if acquiring the bus fails
+         */
+        explicit BusSession(SPIDevice &device, bool keep_cs_active = false);
+
+        /**
+         * @brief Release the bus, or let the last transaction in flight release it.
+         */
+        ~BusSession();
+
+        BusSession(const BusSession&) = delete;
+        BusSession &operator=(const BusSession&) = delete;
+
+        /**
+         * @brief Keep CS asserted after the transactions of the device started from now on (SPI_TRANS_CS_KEEP_ACTIVE).
+         *
+         * CS is released after the next transaction started with \c keep set to false. Hence, the last part of
+         * a multi-part command should be started after disabling it.
+         */
+        void set_cs_keep_active(bool keep) noexcept;
+
+    private:
+        SPIDevice &device;
+    };
+
     /**
      * @brief Create and initialize a device on the master bus corresponding to spi_host.
      *
@@ -239,23 +505,25 @@ public:
      * @param spi_host the spi_host (bus) to which the device shall be attached.
      * @param frequency The devices frequency. this frequency will be set during transactions to the device which will be
      *      created.
-     * @param transaction_queue_size The of the transaction queue of this device. This determines how many
-     *      transactions can be queued at the same time. Currently, it is set to 1 since the
-     *      implementation exclusively acquires the bus for each transaction. This may change in the future.
+     * @param transaction_queue_size The size of the transaction queue of this device. This determines how many
+     *      transactions can be in flight at the same time, see \c transfer().
+     * @param config Further configuration of the device, e.g. its command, address and dummy phases.
+     *
+     * @throws SPIException with ESP_ERR_INVALID_ARG if \c transaction_queue_size is 0, the phase lengths in
+     *      \c config are out of range or \c config has a dual or quad line mode without half-duplex, with the IDF
+     *      error code if the underlying driver fails
      */
     SPIDevice(SPINum spi_host,
             CS cs,
             Frequency frequency = Frequency::MHz(1),
-            QueueSize transaction_queue_size = QueueSize(1u));
+            QueueSize transaction_queue_size = QueueSize(1u),
+            const SPIDeviceConfig &config = SPIDeviceConfig());
 
     SPIDevice(const SPIDevice&) = delete;
     SPIDevice operator=(const SPIDevice&) = delete;
 
     /**
-     * @brief De-initializes and destroys the device.
-     *
-     * @warning Behavior is undefined if a device is destroyed while there is still an ongoing transaction
-     *      from that device.
+     * @brief Waits for the transactions in flight, then de-initializes and destroys the device.
      */
     ~SPIDevice();
 
@@ -266,6 +534,18 @@ public:
      * It then queues that transfer and returns a "future" object. The future object will become ready once
      * the transfer finishes.
      *
+     * Up to the transaction queue size of the device, transfers are queued in the driver while earlier ones are
+     * still running (pipelining), so the hardware continues with the next transfer without waiting for the task.
+     * The device keeps the bus acquired as long as it has transfers in flight. If the queue is full, this method
+     * blocks until the oldest transfer has finished.
+     *
+     * The device owns a transaction descriptor with its buffers for each entry of the transaction queue, which are
+     * reused once the future of their previous transfer has been consumed by \c SPIFuture::get() or destroyed.
+     * Hence, transfers up to the largest size used before don't allocate heap memory. Only if a future is still
+     * held when its descriptor is due again, a new descriptor is allocated on the heap instead. This includes a
+     * future which has only been waited for with \c SPIFuture::wait() or \c SPIFuture::wait_for(), e.g. a named
+     * future kept until the end of its scope, so call \c SPIFuture::get() or let the future go out of scope first.
+     *
      * @param data_to_send Data which will be sent to the device. The length of the data determines the length
      *      of the full-deplex transfer. I.e., the same amount of bytes will be received from the device.
      * @param pre_callback If non-empty, this callback will be called directly before the transaction.
@@ -281,6 +561,292 @@ public:
             std::function<void(void *)> post_callback = nullptr,
             void* user_data = nullptr);
 
+    /**
+     * @brief Queue a full-duplex transfer on caller-owned buffers without copying them.
+     *
+     * In contrast to the other \c transfer() overloads, the buffers are passed to the driver directly. No buffers
+     * are allocated and no data is copied, neither before nor after the transfer.
+     *
+     * @param tx_buffer The data which will be sent to the device.
+     * @param rx_buffer Receives the data read from the device.
+     * @param size The size of both buffers in bytes, which is the length of the full-duplex transfer.
+     * @param pre_callback If non-empty, this callback will be called directly before the transaction.
+     *      If empty, it will be ignored.
+     * @param post_callback If non-empty, this callback will be called directly after the transaction.
+     *      If empty, it will be ignored.
+     * @param user_data This pointer will be sent to pre_callback and/or pre_callback, if any of them is non-empty.
+     *
+     * @return a future object which will become ready once the transfer has finished. Its \c get() returns an
+     *      empty vector since the read data is in \c rx_buffer. See also \c SPIFuture.
+     *
+     * @warning Both buffers must stay valid until the future is ready, i.e. until its \c wait() or \c get()
+     *      returned or its \c wait_for() returned \c std::future_status::ready. They should be DMA-capable and
+     *      word-aligned, otherwise the driver copies them into temporary DMA buffers.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if a buffer is nullptr or \c size is 0
+     */
+    SPIFuture transfer(const uint8_t *tx_buffer,
+            uint8_t *rx_buffer,
+            size_t size,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Queue a full-duplex transfer with command and address phases.
+     *
+     * The hardware sends \c cmd and \c addr in the command and address phases configured for the device, see
+     * \c SPIDeviceConfig, followed by the dummy phase and the data phase. Hence, opcodes and addresses, e.g. of
+     * flash or display commands, don't need to be packed into the data. Otherwise, the transfer behaves like the
+     * other \c transfer() overloads.
+     *
+     * @param cmd The command, only its lowest \c command_bits bits are sent.
+     * @param addr The address, only its lowest \c address_bits bits are sent.
+     * @param data_to_send The data sent in the data phase, its length determines the length of the data phase.
+     *      It may be empty if the transaction only consists of the command and address.
+     * @param pre_callback If non-empty, this callback will be called directly before the transaction.
+     *      If empty, it will be ignored.
+     * @param post_callback If non-empty, this callback will be called directly after the transaction.
+     *      If empty, it will be ignored.
+     * @param user_data This pointer will be sent to pre_callback and/or pre_callback, if any of them is non-empty.
+     *
+     * @return a future object which will become ready once the transfer has finished. Its result is the data
+     *      received during the data phase. See also \c SPIFuture.
+     */
+    SPIFuture transfer(uint16_t cmd,
+            uint64_t addr,
+            const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Like the \c transfer() overload above, but with phase lengths for this transfer only.
+     *
+     * Devices whose commands have different lengths, e.g. a flash with and without address or with a varying
+     * number of dummy cycles, use this overload instead of the phase lengths configured for the device.
+     *
+     * @param phase_bits The lengths of the command, address and dummy phases of this transfer.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if the phase lengths are out of range
+     */
+    SPIFuture transfer(const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Like the \c transfer() overload above, but with line mode and phase lengths for this transfer only.
+     *
+     * @param line_mode The line mode of this transfer.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if the phase lengths are out of range or
+     *      \c line_mode is a dual or quad mode on a full-duplex device
+     */
+    SPIFuture transfer(SPILineMode line_mode,
+            const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Queue a receive-only transfer with command and address phases, e.g. a flash read.
+     *
+     * The hardware sends \c cmd and \c addr in the configured phases, followed by the dummy phase, and then
+     * receives \c size bytes without sending data. Otherwise, the transfer behaves like the other \c transfer()
+     * overloads.
+     *
+     * @param cmd The command, only its lowest \c command_bits bits are sent.
+     * @param addr The address, only its lowest \c address_bits bits are sent.
+     * @param size The number of bytes to receive.
+     * @param pre_callback If non-empty, this callback will be called directly before the transaction.
+     *      If empty, it will be ignored.
+     * @param post_callback If non-empty, this callback will be called directly after the transaction.
+     *      If empty, it will be ignored.
+     * @param user_data This pointer will be sent to pre_callback and/or pre_callback, if any of them is non-empty.
+     *
+     * @return a future object which will become ready once the transfer has finished. Its result is the received
+     *      data. See also \c SPIFuture.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c size is 0
+     */
+    SPIFuture read(uint16_t cmd,
+            uint64_t addr,
+            size_t size,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Like the \c read() overload above, but with line mode and phase lengths for this transfer only.
+     *
+     * @param line_mode The line mode of this transfer.
+     * @param phase_bits The lengths of the command, address and dummy phases of this transfer.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c size is 0, the phase lengths are out of range or
+     *      \c line_mode is a dual or quad mode on a full-duplex device
+     */
+    SPIFuture read(SPILineMode line_mode,
+            const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            size_t size,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Queue a receive-only transfer of \c size bytes, e.g. reading a sensor FIFO.
+     *
+     * No data is sent, so no TX buffer is allocated or transferred. On a full-duplex device, MOSI stays idle
+     * during the transfer. Otherwise, the transfer behaves like the other \c transfer() overloads.
+     *
+     * @param size The number of bytes to receive.
+     * @param pre_callback If non-empty, this callback will be called directly before the transaction.
+     *      If empty, it will be ignored.
+     * @param post_callback If non-empty, this callback will be called directly after the transaction.
+     *      If empty, it will be ignored.
+     * @param user_data This pointer will be sent to pre_callback and/or pre_callback, if any of them is non-empty.
+     *
+     * @return a future object which will become ready once the transfer has finished. Its result is the received
+     *      data. See also \c SPIFuture.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c size is 0
+     */
+    SPIFuture read(size_t size,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Like the \c read() overload above, but receiving directly into a caller-owned buffer.
+     *
+     * @param rx_buffer Receives the data, it must stay valid until the future is ready. Like with the
+     *      caller-owned buffer \c transfer(), it should be DMA-capable and word-aligned.
+     * @param size The size of \c rx_buffer in bytes, which is the length of the transfer.
+     *
+     * @return a future object which will become ready once the transfer has finished. Its \c get() returns an
+     *      empty vector since the received data is in \c rx_buffer. See also \c SPIFuture.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c rx_buffer is nullptr or \c size is 0
+     */
+    SPIFuture read(uint8_t *rx_buffer,
+            size_t size,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Queue a transmit-only transfer of \c data_to_send.
+     *
+     * Nothing is received, so no RX buffer is allocated or transferred. Otherwise, the transfer behaves like the
+     * other \c transfer() overloads.
+     *
+     * @param data_to_send The data sent to the device.
+     * @param pre_callback If non-empty, this callback will be called directly before the transaction.
+     *      If empty, it will be ignored.
+     * @param post_callback If non-empty, this callback will be called directly after the transaction.
+     *      If empty, it will be ignored.
+     * @param user_data This pointer will be sent to pre_callback and/or pre_callback, if any of them is non-empty.
+     *
+     * @return a future object which will become ready once the transfer has finished. Its \c get() returns an
+     *      empty vector. See also \c SPIFuture.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c data_to_send is empty
+     */
+    SPIFuture write(const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Like the \c write() overload above, but sending directly from a caller-owned buffer.
+     *
+     * @param tx_buffer The data sent to the device, it must stay valid until the future is ready. Like with the
+     *      caller-owned buffer \c transfer(), it should be DMA-capable and word-aligned.
+     * @param size The size of \c tx_buffer in bytes, which is the length of the transfer.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c tx_buffer is nullptr or \c size is 0
+     */
+    SPIFuture write(const uint8_t *tx_buffer,
+            size_t size,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Queue a transmit-only transfer with command and address phases, e.g. a flash page program.
+     *
+     * @param cmd The command, only its lowest \c command_bits bits are sent.
+     * @param addr The address, only its lowest \c address_bits bits are sent.
+     * @param data_to_send The data sent after the command and address. It may be empty if the transaction only
+     *      consists of the command and address.
+     *
+     * For the other parameters and the result, see the \c write() overload above.
+     */
+    SPIFuture write(uint16_t cmd,
+            uint64_t addr,
+            const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Like the \c write() overload above, but with line mode and phase lengths for this transfer only.
+     *
+     * @param line_mode The line mode of this transfer.
+     * @param phase_bits The lengths of the command, address and dummy phases of this transfer.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if the phase lengths are out of range or
+     *      \c line_mode is a dual or quad mode on a full-duplex device
+     */
+    SPIFuture write(SPILineMode line_mode,
+            const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            const std::vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback = nullptr,
+            std::function<void(void *)> post_callback = nullptr,
+            void* user_data = nullptr);
+
+    /**
+     * @brief Execute a full-duplex transfer synchronously in polling mode.
+     *
+     * Instead of queueing the transfer and waiting for the SPI interrupt, the calling task busy-waits until the
+     * transfer is done. This avoids the interrupt and context switch overhead, which dominates the duration of
+     * short transfers, e.g. register accesses. Transfers of up to 4 bytes use the data fields inside the
+     * transaction, so no DMA buffers are involved. Transfers queued before are finished first.
+     *
+     * @param data_to_send Data which will be sent to the device. Its length determines the length of the transfer.
+     *
+     * @return The data read from the device, with the same length as \c data_to_send.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if \c data_to_send is empty, with the IDF error code
+     *      if the underlying driver fails
+     *
+     * @note The calling task blocks the CPU during the transfer, so this should only be used for short transfers.
+     *      The callbacks of queued transfers aren't available.
+     */
+    std::vector<uint8_t> polling_transfer(const std::vector<uint8_t> &data_to_send);
+
+    /**
+     * @brief Like \c polling_transfer() above, but on caller-owned buffers.
+     *
+     * @param tx_buffer The data which will be sent to the device.
+     * @param rx_buffer Receives the data read from the device.
+     * @param size The size of both buffers in bytes, which is the length of the transfer.
+     *
+     * @throws SPITransferException with ESP_ERR_INVALID_ARG if a buffer is nullptr or \c size is 0, with the IDF
+     *      error code if the underlying driver fails
+     */
+    void polling_transfer(const uint8_t *tx_buffer, uint8_t *rx_buffer, size_t size);
+
     /**
      * @brief Queue a transfer to this device like \c transfer, but using begin/end iterators instead of a
      *      data vector.
@@ -298,8 +864,12 @@ public:
      * @param user_data This pointer will be sent to pre_callback and/or pre_callback, if any of them is non-empty.
      *
      * @return a future object which will become ready once the transfer has finished. See also \c SPIFuture.
+     *
+     * @note Like the iterator constructor of std::vector, this overload doesn't take integers, which are the
+     *      command and address of the command/address overload instead.
      */
-    template<typename IteratorT>
+    template<typename IteratorT,
+            typename = typename std::enable_if<!std::is_integral<IteratorT>::value>::type>
     SPIFuture transfer(IteratorT begin,
             IteratorT end,
             std::function<void(void *)> pre_callback = nullptr,
@@ -313,10 +883,48 @@ private:
     SPIDeviceHandle *device_handle;
 
     /**
-     * Saves the current transaction descriptor in case the user's loses its future with the other
-     * reference to the transaction.
+     * @brief Get the next descriptor of the pool for a new transaction.
+     *
+     * If it is still in flight, i.e. the queue is full, wait for it first. If a future still refers to it,
+     * replace it with a new descriptor allocated on the heap.
      */
-    std::shared_ptr<SPITransactionDescriptor> current_transaction;
+    std::shared_ptr<SPITransactionDescriptor> &next_transaction();
+
+    /**
+     * @brief Start the prepared \c transaction from \c next_transaction() and advance to the next descriptor.
+     */
+    SPIFuture start(std::shared_ptr<SPITransactionDescriptor> &transaction);
+
+    /**
+     * @brief Wait until all transactions in flight are finished.
+     */
+    void wait_all();
+
+    /**
+     * The line mode of the transactions without their own line mode.
+     */
+    SPILineMode line_mode;
+
+    /**
+     * Tells if the device is half-duplex, which the dual and quad line modes require.
+     */
+    bool half_duplex;
+
+    /**
+     * Tells if the transactions keep CS asserted, set by a \c BusSession.
+     */
+    bool cs_keep_active;
+
+    /**
+     * One descriptor per entry of the transaction queue, used round-robin in the order transactions are started.
+     * The references also keep transactions in flight alive in case the user loses the futures.
+     */
+    std::vector<std::shared_ptr<SPITransactionDescriptor> > pool;
+
+    /**
+     * The index of the descriptor in \c pool used by the next transaction.
+     */
+    size_t next_slot;
 };
 
 /**
@@ -387,8 +995,14 @@ public:
      *
      * @param cs The pin number for the CS (chip select) signal to talk to the device.
      * @param f The frequency used to talk to the device.
+     * @param queue_depth The number of transfers of the device which can be in flight at the same time. With
+     *      more than one, transfers are pipelined, see \c SPIDevice::transfer().
+     * @param config Further configuration of the device, see \c SPIDeviceConfig.
      */
-    std::shared_ptr<SPIDevice> create_dev(CS cs, Frequency frequency = Frequency::MHz(1));
+    std::shared_ptr<SPIDevice> create_dev(CS cs,
+            Frequency frequency = Frequency::MHz(1),
+            QueueSize queue_depth = QueueSize(1u),
+            const SPIDeviceConfig &config = SPIDeviceConfig());
 
 private:
     /**
@@ -397,7 +1011,7 @@ private:
     SPINum spi_host;
 };
 
-template<typename IteratorT>
+template<typename IteratorT, typename>
 SPIFuture SPIDevice::transfer(IteratorT begin,
         IteratorT end,
         std::function<void(void *)> pre_callback,
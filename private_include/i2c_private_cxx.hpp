@@ -0,0 +1,70 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/**
+ * The code in this file includes IDF headers which public headers shouldn't depend on, hence it's a private include.
+ * It should only be used in the C++ source files of the I2C classes.
+ */
+
+#ifdef __cpp_exceptions
+
+#include "sdkconfig.h"
+#include "i2c_cxx.hpp"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_pthread.h"
+#endif
+
+namespace idf {
+
+#define I2C_CHECK_THROW(err) CHECK_THROW_SPECIFIC((err), I2CException)
+
+/**
+ * Write the lowest \c address_len bytes of the memory address \c mem_addr big-endian to \c dest, as expected by
+ * devices with an \c I2CPageLayout.
+ */
+inline void encode_mem_addr(uint8_t *dest, uint32_t mem_addr, size_t address_len) noexcept
+{
+    for (size_t i = 0; i < address_len; i++) {
+        dest[i] = static_cast<uint8_t>(mem_addr >> (8 * (address_len - 1 - i)));
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * Sets the pthread configuration for threads created by the calling thread during the lifetime of this object.
+ * The previous configuration is restored afterwards since the pthread configuration is thread-local.
+ */
+class PthreadConfigGuard {
+public:
+    PthreadConfigGuard(size_t stack_size, size_t priority, int core_id, const char *thread_name)
+    {
+        has_previous_cfg = esp_pthread_get_cfg(&previous_cfg) == ESP_OK;
+
+        esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+        cfg.stack_size = stack_size;
+        cfg.prio = priority;
+        cfg.pin_to_core = core_id < 0 ? tskNO_AFFINITY : core_id;
+        cfg.thread_name = thread_name;
+        I2C_CHECK_THROW(esp_pthread_set_cfg(&cfg));
+    }
+
+    ~PthreadConfigGuard()
+    {
+        esp_pthread_cfg_t cfg = has_previous_cfg ? previous_cfg : esp_pthread_get_default_config();
+        esp_pthread_set_cfg(&cfg);
+    }
+
+private:
+    esp_pthread_cfg_t previous_cfg;
+    bool has_previous_cfg;
+};
+#endif // !CONFIG_IDF_TARGET_LINUX
+
+} // idf
+
+#endif // __cpp_exceptions
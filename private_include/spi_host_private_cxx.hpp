@@ -40,20 +40,31 @@ public:
     /**
      * Create a device instance on the SPI bus identified by spi_host, allocate all corresponding resources.
      */
-    SPIDeviceHandle(SPINum spi_host, CS cs, Frequency frequency, QueueSize q_size)
+    SPIDeviceHandle(SPINum spi_host,
+            CS cs,
+            Frequency frequency,
+            QueueSize q_size,
+            const SPIDeviceConfig &config = SPIDeviceConfig()) : in_flight(0), in_session(false)
     {
         spi_device_interface_config_t dev_config = {};
+        dev_config.command_bits = config.phase_bits.command_bits;
+        dev_config.address_bits = config.phase_bits.address_bits;
+        dev_config.dummy_bits = config.phase_bits.dummy_bits;
         dev_config.clock_speed_hz = frequency.get_value();
         dev_config.spics_io_num = cs.get_value();
         dev_config.pre_cb = pr_cb;
         dev_config.post_cb = post_cb;
         dev_config.queue_size = q_size.get_size();
+        if (config.half_duplex) {
+            dev_config.flags |= SPI_DEVICE_HALFDUPLEX;
+        }
         SPI_CHECK_THROW(spi_bus_add_device(spi_host.get_value<spi_host_device_t>(), &dev_config, &handle));
     }
 
     SPIDeviceHandle(const SPIDeviceHandle &other) = delete;
 
-    SPIDeviceHandle(SPIDeviceHandle &&other) noexcept : handle(std::move(other.handle))
+    SPIDeviceHandle(SPIDeviceHandle &&other) noexcept
+        : handle(std::move(other.handle)), in_flight(other.in_flight), in_session(other.in_session)
     {
         // Only to indicate programming errors where users use an instance after moving it.
         other.handle = nullptr;
@@ -74,6 +85,8 @@ public:
     {
         if (this != &other) {
             handle = std::move(other.handle);
+            in_flight = other.in_flight;
+            in_session = other.in_session;
 
             // Only to indicate programming errors where users use an instance after moving it.
             other.handle = nullptr;
@@ -101,30 +114,135 @@ public:
         spi_device_release_bus(handle);
     }
 
+    esp_err_t polling_start(spi_transaction_t *trans_desc, TickType_t ticks_to_wait)
+    {
+        return spi_device_polling_start(handle, trans_desc, ticks_to_wait);
+    }
+
+    esp_err_t polling_end(TickType_t ticks_to_wait)
+    {
+        return spi_device_polling_end(handle, ticks_to_wait);
+    }
+
+    /**
+     * Queue a transaction, acquiring the bus first if it isn't acquired by this device yet.
+     * The bus stays acquired until the results of all queued transactions have been fetched with
+     * \c finish_trans(), so the transactions of the device are executed back-to-back.
+     */
+    esp_err_t start_trans(spi_transaction_t *trans_desc)
+    {
+        if (!bus_acquired()) {
+            esp_err_t err = acquire_bus(portMAX_DELAY);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+
+        esp_err_t err = queue_trans(trans_desc, 0);
+        if (err != ESP_OK) {
+            if (!bus_acquired()) {
+                release_bus();
+            }
+            return err;
+        }
+
+        in_flight++;
+        return ESP_OK;
+    }
+
+    /**
+     * Fetch the result of the oldest transaction in flight, the bus is released after the last one.
+     */
+    esp_err_t finish_trans(spi_transaction_t **trans_desc, TickType_t ticks_to_wait)
+    {
+        esp_err_t err = get_trans_result(trans_desc, ticks_to_wait);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        in_flight--;
+        if (!bus_acquired()) {
+            release_bus();
+        }
+        return ESP_OK;
+    }
+
+    /**
+     * Keep the bus acquired until \c end_session(), also while no transaction is in flight.
+     */
+    esp_err_t begin_session()
+    {
+        if (!bus_acquired()) {
+            esp_err_t err = acquire_bus(portMAX_DELAY);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+
+        in_session = true;
+        return ESP_OK;
+    }
+
+    /**
+     * End the session, the bus is released now or after the last transaction in flight.
+     */
+    void end_session()
+    {
+        in_session = false;
+        if (!bus_acquired()) {
+            release_bus();
+        }
+    }
+
+    bool session_active() const noexcept
+    {
+        return in_session;
+    }
+
 private:
     /**
      * Route the callback to the callback in the specific SPITransactionDescriptor instance.
+     * Polling transactions have no descriptor and no callbacks.
      */
     static void pr_cb(spi_transaction_t *driver_transaction)
     {
         SPITransactionDescriptor *transaction = static_cast<SPITransactionDescriptor*>(driver_transaction->user);
-        if (transaction->pre_callback) {
+        if (transaction && transaction->pre_callback) {
             transaction->pre_callback(transaction->user_data);
         }
     }
 
     /**
      * Route the callback to the callback in the specific SPITransactionDescriptor instance.
+     * Polling transactions have no descriptor and no callbacks.
      */
     static void post_cb(spi_transaction_t *driver_transaction)
     {
         SPITransactionDescriptor *transaction = static_cast<SPITransactionDescriptor*>(driver_transaction->user);
-        if (transaction->post_callback) {
+        if (transaction && transaction->post_callback) {
             transaction->post_callback(transaction->user_data);
         }
     }
 
     spi_device_handle_t handle;
+
+    /**
+     * Tells if this device holds the bus, because transactions are in flight or a session is active.
+     */
+    bool bus_acquired() const noexcept
+    {
+        return in_flight > 0 || in_session;
+    }
+
+    /**
+     * Number of queued transactions whose result hasn't been fetched yet.
+     */
+    size_t in_flight;
+
+    /**
+     * Tells if a bus session keeps the bus acquired.
+     */
+    bool in_session;
 };
 
 }
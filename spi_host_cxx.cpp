@@ -7,9 +7,15 @@
 #if __cpp_exceptions
 
 #include <stdint.h>
+#include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#endif
 #include "hal/spi_types.h"
 #include "driver/spi_master.h"
 #include "spi_host_cxx.hpp"
@@ -19,6 +25,72 @@ using namespace std;
 
 namespace idf {
 
+namespace {
+
+/**
+ * The driver supports commands of up to 16 bits and addresses of up to 64 bits.
+ */
+bool phase_bits_valid(const SPIPhaseBits &phase_bits)
+{
+    return phase_bits.command_bits <= 16 && phase_bits.address_bits <= 64;
+}
+
+/**
+ * The multi-line modes use the data lines in both directions, which the driver only supports for half-duplex devices.
+ */
+bool line_mode_valid(SPILineMode line_mode, bool half_duplex)
+{
+    return line_mode == SPILineMode::SINGLE || half_duplex;
+}
+
+uint32_t line_mode_flags(SPILineMode line_mode)
+{
+    switch (line_mode) {
+    case SPILineMode::DUAL:
+        return SPI_TRANS_MODE_DIO;
+    case SPILineMode::DIO:
+        return SPI_TRANS_MODE_DIO | SPI_TRANS_MULTILINE_ADDR;
+    case SPILineMode::QUAD:
+        return SPI_TRANS_MODE_QIO;
+    case SPILineMode::QIO:
+        return SPI_TRANS_MODE_QIO | SPI_TRANS_MULTILINE_ADDR;
+    case SPILineMode::QPI:
+        return SPI_TRANS_MODE_QIO | SPI_TRANS_MULTILINE_ADDR | SPI_TRANS_MULTILINE_CMD;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * The driver copies an RX buffer which isn't DMA-capable and word-aligned into a temporary buffer allocated for each
+ * transaction. The DMA also writes whole words, hence the size is rounded up to a multiple of 4 bytes.
+ */
+uint8_t *alloc_dma_buffer(size_t size)
+{
+    const size_t DMA_SIZE = (size + 3) & ~static_cast<size_t>(3);
+#if CONFIG_IDF_TARGET_LINUX
+    void *buffer = malloc(DMA_SIZE);
+#else
+    void *buffer = heap_caps_aligned_alloc(4, DMA_SIZE, MALLOC_CAP_DMA);
+#endif
+    if (buffer == nullptr) {
+        throw SPITransferException(ESP_ERR_NO_MEM);
+    }
+
+    return static_cast<uint8_t*>(buffer);
+}
+
+void free_dma_buffer(uint8_t *buffer) noexcept
+{
+#if CONFIG_IDF_TARGET_LINUX
+    free(buffer);
+#else
+    heap_caps_free(buffer);
+#endif
+}
+
+}
+
 SPIException::SPIException(esp_err_t error) : ESPException(error) { }
 
 SPITransferException::SPITransferException(esp_err_t error) : SPIException(error) { }
@@ -68,9 +140,12 @@ SPIMaster::~SPIMaster()
     spi_bus_free(spi_host.get_value<spi_host_device_t>());
 }
 
-shared_ptr<SPIDevice> SPIMaster::create_dev(CS cs, Frequency frequency)
+shared_ptr<SPIDevice> SPIMaster::create_dev(CS cs,
+        Frequency frequency,
+        QueueSize queue_depth,
+        const SPIDeviceConfig &config)
 {
-    return make_shared<SPIDevice>(spi_host, cs, frequency);
+    return make_shared<SPIDevice>(spi_host, cs, frequency, queue_depth, config);
 }
 
 SPIFuture::SPIFuture()
@@ -105,11 +180,18 @@ vector<uint8_t> SPIFuture::get()
         throw std::future_error(future_errc::no_state);
     }
 
-    return transaction->get();
+    // like std::future, the shared state is released, so the device can recycle the transaction
+    shared_ptr<SPITransactionDescriptor> consumed = std::move(transaction);
+    is_valid = false;
+    return consumed->get();
 }
 
 future_status SPIFuture::wait_for(chrono::milliseconds timeout)
 {
+    if (!is_valid) {
+        throw std::future_error(future_errc::no_state);
+    }
+
     if (transaction->wait_for(timeout)) {
         return std::future_status::ready;
     } else {
@@ -119,6 +201,10 @@ future_status SPIFuture::wait_for(chrono::milliseconds timeout)
 
 void SPIFuture::wait()
 {
+    if (!is_valid) {
+        throw std::future_error(future_errc::no_state);
+    }
+
     transaction->wait();
 }
 
@@ -127,13 +213,46 @@ bool SPIFuture::valid() const noexcept
     return is_valid;
 }
 
-SPIDevice::SPIDevice(SPINum spi_host, CS cs, Frequency frequency, QueueSize q_size) : device_handle()
+SPIDevice::SPIDevice(SPINum spi_host, CS cs, Frequency frequency, QueueSize q_size, const SPIDeviceConfig &config)
+    : device_handle(),
+    line_mode(config.line_mode),
+    half_duplex(config.half_duplex),
+    cs_keep_active(false),
+    pool(),
+    next_slot(0)
 {
-    device_handle = new SPIDeviceHandle(spi_host, cs, frequency, q_size);
+    const size_t queue_size = q_size.get_size();
+    if (queue_size == 0
+            || !phase_bits_valid(config.phase_bits)
+            || !line_mode_valid(config.line_mode, config.half_duplex)) {
+        throw SPIException(ESP_ERR_INVALID_ARG);
+    }
+
+    device_handle = new SPIDeviceHandle(spi_host, cs, frequency, q_size, config);
+
+    try {
+        for (size_t i = 0; i < queue_size; i++) {
+            pool.emplace_back(new SPITransactionDescriptor(device_handle));
+        }
+    } catch (...) {
+        pool.clear();
+        delete device_handle;
+        throw;
+    }
 }
 
 SPIDevice::~SPIDevice()
 {
+    // The driver must not access the descriptors or buffers after they are gone.
+    for (shared_ptr<SPITransactionDescriptor> &transaction : pool) {
+        if (transaction->started && !transaction->received_data) {
+            try {
+                transaction->wait();
+            } catch (const SPIException&) { }
+        }
+    }
+    pool.clear();
+
     delete device_handle;
 }
 
@@ -142,49 +261,380 @@ SPIFuture SPIDevice::transfer(const vector<uint8_t> &data_to_send,
             std::function<void(void *)> post_callback,
             void* user_data)
 {
-    current_transaction = make_shared<SPITransactionDescriptor>(data_to_send,
-            device_handle,
-            std::move(pre_callback),
-            std::move(post_callback),
-            user_data);
-    current_transaction->start();
-    return SPIFuture(current_transaction);
+    // C++11 vectors don't have size() or empty() members yet
+    if (data_to_send.begin() == data_to_send.end()) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::transfer(const uint8_t *tx_buffer,
+            uint8_t *rx_buffer,
+            size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (tx_buffer == nullptr || rx_buffer == nullptr) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare(tx_buffer, rx_buffer, size, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::transfer(uint16_t cmd,
+            uint64_t addr,
+            const vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    transaction->set_phases(cmd, addr);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::transfer(const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            const vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (!phase_bits_valid(phase_bits)) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    transaction->set_phases(phase_bits, cmd, addr);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::transfer(SPILineMode transfer_line_mode,
+            const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            const vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (!phase_bits_valid(phase_bits) || !line_mode_valid(transfer_line_mode, half_duplex)) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(transfer_line_mode);
+    transaction->set_phases(phase_bits, cmd, addr);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::read(uint16_t cmd,
+            uint64_t addr,
+            size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (size == 0) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare_read(size, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    transaction->set_phases(cmd, addr);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::read(SPILineMode transfer_line_mode,
+            const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (size == 0 || !phase_bits_valid(phase_bits) || !line_mode_valid(transfer_line_mode, half_duplex)) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare_read(size, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(transfer_line_mode);
+    transaction->set_phases(phase_bits, cmd, addr);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::read(size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (size == 0) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare_read(size, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::read(uint8_t *rx_buffer,
+            size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (rx_buffer == nullptr) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare(nullptr, rx_buffer, size, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::write(const vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    // C++11 vectors don't have size() or empty() members yet
+    if (data_to_send.begin() == data_to_send.end()) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare_write(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::write(const uint8_t *tx_buffer,
+            size_t size,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (tx_buffer == nullptr) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare(tx_buffer, nullptr, size, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::write(uint16_t cmd,
+            uint64_t addr,
+            const vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare_write(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(line_mode);
+    transaction->set_phases(cmd, addr);
+    return start(transaction);
+}
+
+SPIFuture SPIDevice::write(SPILineMode transfer_line_mode,
+            const SPIPhaseBits &phase_bits,
+            uint16_t cmd,
+            uint64_t addr,
+            const vector<uint8_t> &data_to_send,
+            std::function<void(void *)> pre_callback,
+            std::function<void(void *)> post_callback,
+            void* user_data)
+{
+    if (!phase_bits_valid(phase_bits) || !line_mode_valid(transfer_line_mode, half_duplex)) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    shared_ptr<SPITransactionDescriptor> &transaction = next_transaction();
+    transaction->prepare_write(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+    transaction->set_line_mode(transfer_line_mode);
+    transaction->set_phases(phase_bits, cmd, addr);
+    return start(transaction);
+}
+
+vector<uint8_t> SPIDevice::polling_transfer(const vector<uint8_t> &data_to_send)
+{
+    vector<uint8_t> result(data_to_send.size());
+
+    polling_transfer(data_to_send.data(), result.data(), result.size());
+
+    return result;
+}
+
+void SPIDevice::polling_transfer(const uint8_t *tx_buffer, uint8_t *rx_buffer, size_t size)
+{
+    if (tx_buffer == nullptr || rx_buffer == nullptr || size == 0) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    // the driver doesn't accept polling transactions while queued ones of the device are in flight
+    wait_all();
+
+    spi_transaction_t trans_desc = {};
+    trans_desc.flags = line_mode_flags(line_mode);
+    if (cs_keep_active) {
+        trans_desc.flags |= SPI_TRANS_CS_KEEP_ACTIVE;
+    }
+    trans_desc.length = size * 8;
+    const bool use_trans_data = size <= sizeof(trans_desc.tx_data);
+    if (use_trans_data) {
+        trans_desc.flags |= SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+        copy_n(tx_buffer, size, trans_desc.tx_data);
+    } else {
+        trans_desc.tx_buffer = tx_buffer;
+        trans_desc.rx_buffer = rx_buffer;
+    }
+
+    esp_err_t err = device_handle->polling_start(&trans_desc, portMAX_DELAY);
+    if (err == ESP_OK) {
+        err = device_handle->polling_end(portMAX_DELAY);
+    }
+    if (err != ESP_OK) {
+        throw SPITransferException(err);
+    }
+
+    if (use_trans_data) {
+        copy_n(trans_desc.rx_data, size, rx_buffer);
+    }
+}
+
+void SPIDevice::wait_all()
+{
+    for (shared_ptr<SPITransactionDescriptor> &transaction : pool) {
+        if (transaction->started && !transaction->received_data) {
+            transaction->wait();
+        }
+    }
+}
+
+shared_ptr<SPITransactionDescriptor> &SPIDevice::next_transaction()
+{
+    // The slots are used round-robin, so a slot in flight holds the oldest transaction, which has to finish first.
+    shared_ptr<SPITransactionDescriptor> &transaction = pool[next_slot];
+    if (transaction->started && !transaction->received_data) {
+        transaction->wait();
+    }
+
+    // A future still refers to the previous transaction of the slot, so it can't be recycled.
+    if (transaction.use_count() > 1) {
+        transaction.reset(new SPITransactionDescriptor(device_handle));
+    }
+
+    return transaction;
+}
+
+SPIFuture SPIDevice::start(shared_ptr<SPITransactionDescriptor> &transaction)
+{
+    if (cs_keep_active) {
+        transaction->set_cs_keep_active();
+    }
+    transaction->start();
+    next_slot = (next_slot + 1) % pool.size();
+    return SPIFuture(transaction);
+}
+
+SPIDevice::BusSession::BusSession(SPIDevice &device_arg, bool keep_cs_active)
+    : device(device_arg)
+{
+    if (device.device_handle->session_active()) {
+        throw SPIException(ESP_ERR_INVALID_STATE);
+    }
+
+    SPI_CHECK_THROW(device.device_handle->begin_session());
+    device.cs_keep_active = keep_cs_active;
+}
+
+SPIDevice::BusSession::~BusSession()
+{
+    device.cs_keep_active = false;
+    device.device_handle->end_session();
+}
+
+void SPIDevice::BusSession::set_cs_keep_active(bool keep) noexcept
+{
+    device.cs_keep_active = keep;
+}
+
+SPITransactionDescriptor::SPITransactionDescriptor(SPIDeviceHandle *handle)
+    : private_transaction_desc(nullptr),
+    device_handle(handle),
+    pre_callback(),
+    post_callback(),
+    tx_buffer(nullptr),
+    rx_buffer(nullptr),
+    tx_buffer_size(0),
+    rx_buffer_size(0),
+    owns_buffers(false),
+    user_data(nullptr),
+    received_data(false),
+    started(false)
+{
+    if (handle == nullptr) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+
+    // The extended descriptor starts with the base descriptor, it's only needed for variable phase lengths.
+    spi_transaction_ext_t *trans_desc = new spi_transaction_ext_t;
+    memset(trans_desc, 0, sizeof(spi_transaction_ext_t));
+    trans_desc->base.user = this;
+
+    private_transaction_desc = trans_desc;
 }
 
 SPITransactionDescriptor::SPITransactionDescriptor(const std::vector<uint8_t> &data_to_send,
         SPIDeviceHandle *handle,
         std::function<void(void *)> pre_callback,
         std::function<void(void *)> post_callback,
-        void* user_data_arg)
-    : device_handle(handle),
-    pre_callback(std::move(pre_callback)),
-    post_callback(std::move(post_callback)),
-    user_data(user_data_arg),
-    received_data(false),
-    started(false)
+        void* user_data)
+    : SPITransactionDescriptor(handle)
 {
     // C++11 vectors don't have size() or empty() members yet
     if (data_to_send.begin() == data_to_send.end()) {
         throw SPITransferException(ESP_ERR_INVALID_ARG);
     }
-    if (handle == nullptr) {
-        throw SPITransferException(ESP_ERR_INVALID_ARG);
-    }
 
-    size_t trans_size = data_to_send.size();
-    spi_transaction_t *trans_desc;
-    trans_desc = new spi_transaction_t;
-    memset(trans_desc, 0, sizeof(spi_transaction_t));
-    trans_desc->rx_buffer = new uint8_t [trans_size];
-    tx_buffer = new uint8_t [trans_size];
-    for (size_t i = 0; i < trans_size; i++) {
-        tx_buffer[i] = data_to_send[i];
+    prepare(data_to_send, std::move(pre_callback), std::move(post_callback), user_data);
+}
+
+SPITransactionDescriptor::SPITransactionDescriptor(const uint8_t *tx_buffer,
+        uint8_t *rx_buffer,
+        size_t size,
+        SPIDeviceHandle *handle,
+        std::function<void(void *)> pre_callback,
+        std::function<void(void *)> post_callback,
+        void* user_data)
+    : SPITransactionDescriptor(handle)
+{
+    if (tx_buffer == nullptr || rx_buffer == nullptr) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
     }
-    trans_desc->length = trans_size * 8;
-    trans_desc->tx_buffer = tx_buffer;
-    trans_desc->user = this;
 
-    private_transaction_desc = trans_desc;
+    prepare(tx_buffer, rx_buffer, size, std::move(pre_callback), std::move(post_callback), user_data);
 }
 
 SPITransactionDescriptor::~SPITransactionDescriptor()
@@ -194,17 +644,167 @@ SPITransactionDescriptor::~SPITransactionDescriptor()
                                 // driver may still write into it afterwards.
     }
 
+    free_dma_buffer(tx_buffer);
+    free_dma_buffer(rx_buffer);
+    delete reinterpret_cast<spi_transaction_ext_t*>(private_transaction_desc);
+}
+
+void SPITransactionDescriptor::prepare(const std::vector<uint8_t> &data_to_send,
+        std::function<void(void *)> pre_callback_arg,
+        std::function<void(void *)> post_callback_arg,
+        void* user_data_arg)
+{
+    if (started && !received_data) {
+        throw SPITransferException(ESP_ERR_INVALID_STATE);
+    }
+
+    const size_t trans_size = data_to_send.size();
+    reserve(trans_size, trans_size);
+    copy(data_to_send.begin(), data_to_send.end(), tx_buffer);
+
+    // a transaction without data phase has no buffers
+    if (trans_size == 0) {
+        reset(nullptr, nullptr, 0, std::move(pre_callback_arg), std::move(post_callback_arg), user_data_arg);
+    } else {
+        reset(tx_buffer, rx_buffer, trans_size, std::move(pre_callback_arg), std::move(post_callback_arg), user_data_arg);
+    }
+    owns_buffers = true;
+}
+
+void SPITransactionDescriptor::prepare(const uint8_t *tx_buffer_arg,
+        uint8_t *rx_buffer_arg,
+        size_t size,
+        std::function<void(void *)> pre_callback_arg,
+        std::function<void(void *)> post_callback_arg,
+        void* user_data_arg)
+{
+    if ((tx_buffer_arg == nullptr && rx_buffer_arg == nullptr) || size == 0) {
+        throw SPITransferException(ESP_ERR_INVALID_ARG);
+    }
+    if (started && !received_data) {
+        throw SPITransferException(ESP_ERR_INVALID_STATE);
+    }
+
+    reset(tx_buffer_arg, rx_buffer_arg, size, std::move(pre_callback_arg), std::move(post_callback_arg), user_data_arg);
+    owns_buffers = false;
+}
+
+void SPITransactionDescriptor::prepare_read(size_t size,
+        std::function<void(void *)> pre_callback_arg,
+        std::function<void(void *)> post_callback_arg,
+        void* user_data_arg)
+{
+    if (started && !received_data) {
+        throw SPITransferException(ESP_ERR_INVALID_STATE);
+    }
+
+    reserve(0, size);
+
+    reset(nullptr, rx_buffer, size, std::move(pre_callback_arg), std::move(post_callback_arg), user_data_arg);
+    owns_buffers = true;
+}
+
+void SPITransactionDescriptor::prepare_write(const std::vector<uint8_t> &data_to_send,
+        std::function<void(void *)> pre_callback_arg,
+        std::function<void(void *)> post_callback_arg,
+        void* user_data_arg)
+{
+    if (started && !received_data) {
+        throw SPITransferException(ESP_ERR_INVALID_STATE);
+    }
+
+    const size_t trans_size = data_to_send.size();
+    reserve(trans_size, 0);
+    copy(data_to_send.begin(), data_to_send.end(), tx_buffer);
+
+    reset(trans_size > 0 ? tx_buffer : nullptr,
+            nullptr,
+            trans_size,
+            std::move(pre_callback_arg),
+            std::move(post_callback_arg),
+            user_data_arg);
+    owns_buffers = true;
+}
+
+void SPITransactionDescriptor::reserve(size_t tx_size, size_t rx_size)
+{
+    // the buffers only grow, so transfers up to the largest size so far don't allocate
+    if (tx_size > tx_buffer_size) {
+        free_dma_buffer(tx_buffer);
+        tx_buffer = nullptr;
+        tx_buffer_size = 0;
+
+        tx_buffer = alloc_dma_buffer(tx_size);
+        tx_buffer_size = tx_size;
+    }
+
+    if (rx_size > rx_buffer_size) {
+        free_dma_buffer(rx_buffer);
+        rx_buffer = nullptr;
+        rx_buffer_size = 0;
+
+        rx_buffer = alloc_dma_buffer(rx_size);
+        rx_buffer_size = rx_size;
+    }
+}
+
+void SPITransactionDescriptor::set_cs_keep_active() noexcept
+{
     spi_transaction_t *trans_desc = reinterpret_cast<spi_transaction_t*>(private_transaction_desc);
-    delete [] tx_buffer;
-    delete [] static_cast<uint8_t*>(trans_desc->rx_buffer);
-    delete trans_desc;
+    trans_desc->flags |= SPI_TRANS_CS_KEEP_ACTIVE;
+}
+
+void SPITransactionDescriptor::set_line_mode(SPILineMode line_mode) noexcept
+{
+    spi_transaction_t *trans_desc = reinterpret_cast<spi_transaction_t*>(private_transaction_desc);
+    trans_desc->flags |= line_mode_flags(line_mode);
+}
+
+void SPITransactionDescriptor::set_phases(uint16_t cmd, uint64_t addr) noexcept
+{
+    spi_transaction_t *trans_desc = reinterpret_cast<spi_transaction_t*>(private_transaction_desc);
+    trans_desc->cmd = cmd;
+    trans_desc->addr = addr;
+}
+
+void SPITransactionDescriptor::set_phases(const SPIPhaseBits &phase_bits, uint16_t cmd, uint64_t addr) noexcept
+{
+    spi_transaction_ext_t *trans_desc = reinterpret_cast<spi_transaction_ext_t*>(private_transaction_desc);
+    trans_desc->base.flags |= SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_VARIABLE_DUMMY;
+    trans_desc->base.cmd = cmd;
+    trans_desc->base.addr = addr;
+    trans_desc->command_bits = phase_bits.command_bits;
+    trans_desc->address_bits = phase_bits.address_bits;
+    trans_desc->dummy_bits = phase_bits.dummy_bits;
+}
+
+void SPITransactionDescriptor::reset(const uint8_t *tx_data,
+        uint8_t *rx_data,
+        size_t size,
+        std::function<void(void *)> pre_callback_arg,
+        std::function<void(void *)> post_callback_arg,
+        void* user_data_arg)
+{
+    spi_transaction_t *trans_desc = reinterpret_cast<spi_transaction_t*>(private_transaction_desc);
+    memset(private_transaction_desc, 0, sizeof(spi_transaction_ext_t));
+    trans_desc->length = size * 8;
+    // half-duplex devices only receive with an explicit receive length
+    trans_desc->rxlength = rx_data != nullptr ? size * 8 : 0;
+    trans_desc->tx_buffer = tx_data;
+    trans_desc->rx_buffer = rx_data;
+    trans_desc->user = this;
+
+    pre_callback = std::move(pre_callback_arg);
+    post_callback = std::move(post_callback_arg);
+    user_data = user_data_arg;
+    received_data = false;
+    started = false;
 }
 
 void SPITransactionDescriptor::start()
 {
     spi_transaction_t *trans_desc = reinterpret_cast<spi_transaction_t*>(private_transaction_desc);
-    SPI_CHECK_THROW(device_handle->acquire_bus(portMAX_DELAY));
-    SPI_CHECK_THROW(device_handle->queue_trans(trans_desc, 0));
+    SPI_CHECK_THROW(device_handle->start_trans(trans_desc));
     started = true;
 }
 
@@ -223,24 +823,37 @@ bool SPITransactionDescriptor::wait_for(const chrono::milliseconds &timeout_dura
         throw SPITransferException(ESP_ERR_INVALID_STATE);
     }
 
-    spi_transaction_t *acquired_trans_desc;
-    esp_err_t err = device_handle->get_trans_result(&acquired_trans_desc,
-            (TickType_t) timeout_duration.count() / portTICK_PERIOD_MS);
+    const TickType_t timeout_ticks = (TickType_t) timeout_duration.count() / portTICK_PERIOD_MS;
+    const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + timeout_duration;
 
-    if (err == ESP_ERR_TIMEOUT) {
-        return false;
-    }
+    // The driver returns the results in queue order, so earlier transactions of the device may be finished first.
+    TickType_t ticks_to_wait = timeout_ticks;
+    while (!received_data) {
+        spi_transaction_t *acquired_trans_desc;
+        esp_err_t err = device_handle->finish_trans(&acquired_trans_desc, ticks_to_wait);
 
-    if (err != ESP_OK) {
-        throw SPITransferException(err);
-    }
+        if (err == ESP_ERR_TIMEOUT) {
+            return false;
+        }
 
-    if (acquired_trans_desc != reinterpret_cast<spi_transaction_t*>(private_transaction_desc)) {
-        throw SPITransferException(ESP_ERR_INVALID_STATE);
-    }
+        if (err != ESP_OK) {
+            throw SPITransferException(err);
+        }
 
-    received_data = true;
-    device_handle->release_bus();
+        SPITransactionDescriptor *finished = static_cast<SPITransactionDescriptor*>(acquired_trans_desc->user);
+        if (finished == nullptr || !finished->started || finished->received_data) {
+            throw SPITransferException(ESP_ERR_INVALID_STATE);
+        }
+
+        finished->received_data = true;
+
+        // the following fetches only get the rest of the timeout, waiting forever stays unlimited
+        if (timeout_ticks != portMAX_DELAY) {
+            chrono::milliseconds remaining
+                    = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+            ticks_to_wait = remaining.count() > 0 ? (TickType_t) remaining.count() / portTICK_PERIOD_MS : 0;
+        }
+    }
 
     return true;
 }
@@ -252,14 +865,14 @@ std::vector<uint8_t> SPITransactionDescriptor::get()
     }
 
     spi_transaction_t *trans_desc = reinterpret_cast<spi_transaction_t*>(private_transaction_desc);
-    const size_t TRANSACTION_LENGTH = trans_desc->length / 8;
-    vector<uint8_t> result(TRANSACTION_LENGTH);
-
-    for (int i = 0; i < TRANSACTION_LENGTH; i++) {
-        result[i] = static_cast<uint8_t*>(trans_desc->rx_buffer)[i];
+    if (!owns_buffers || trans_desc->rx_buffer == nullptr) {
+        // the data has been received directly into the caller's buffer or nothing has been received
+        return vector<uint8_t>();
     }
 
-    return result;
+    const size_t TRANSACTION_LENGTH = trans_desc->rxlength / 8;
+
+    return vector<uint8_t>(rx_buffer, rx_buffer + TRANSACTION_LENGTH);
 }
 
 } // idf